@@ -15,6 +15,7 @@ bin/bld_core.sh unit sanity_tests tests/sanity_tests.c
 bin/bld_core.sh unit unicode_test tests/unicode_test.c
 bin/bld_core.sh unit cpp_build_test tests/cpp_build_test.cpp
 bin/bld_core.sh unit expression_tests tests/expression_tests.c
+bin/bld_core.sh unit lexer_equivalence_test tests/lexer_equivalence_test.c
 
 echo
 
@@ -17,5 +17,8 @@ echo ~~~ Running Sanity Tests ~~~
 echo ~~~ Running Expression Tests ~~~
 ./expression_tests.exe
 
+echo ~~~ Running Lexer Equivalence Test ~~~
+./lexer_equivalence_test.exe ../tests/* ../examples/*/*
+
 ###### Restore Path ###########################################################
 cd $og_path
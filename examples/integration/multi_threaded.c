@@ -1,119 +1,28 @@
 /* 
 ** Example: multi threaded parse
 **
-** This example shows how to arrange a multi-threaded Metadesk parser. The
-** strategy used is to make each *.mdesk file into an independent task.
+** This example shows how to parse a set of Metadesk files on multiple threads.
+** The strategy used is to make each *.mdesk file into an independent task,
+** which MD_ParseFiles schedules for us: largest files first, with idle threads
+** stealing work from busy ones.
 **
 ** The goal in this example is to have all of the files parsed and visible at
 ** the same time by the end. Another conceivable way to make a multi-threaded
 ** Metadesk parser would be to use each parse as a temporary and throw them
 ** away after extracting out the important parts.
 **
-** This example depends directly on OS headers, intrinsics, and functions,
-** so you'll have to re-interpret those parts to whatever OS you are targeting.
+** The library only starts threads of its own when it is built with
+** MD_DEFAULT_THREADS, which needs -lpthread on Linux and Mac. Without it,
+** MD_ParseFiles parses the files one after another on this thread.
 **
 */
 
 //~ includes and globals //////////////////////////////////////////////////////
 
+#define MD_DEFAULT_THREADS 1
 #include "md.h"
 #include "md.c"
 
-#if MD_OS_WINDOWS
-# include <Windows.h>
-#elif MD_OS_MAC || MD_OS_LINUX
-# include <pthread.h>
-#else
-# error Not implemented for this OS
-#endif
-
-//~ multi-threaded parse setup ////////////////////////////////////////////////
-
-// for this intrinsic we're assume pre-increment behavior
-
-#if MD_COMPILER_CL
-# include <intrin.h>
-# define atomic_inc_then_eval_u64(p) _InterlockedIncrement64((volatile __int64*)p)
-#elif MD_COMPILER_CLANG || MD_COMPILER_GCC
-# define atomic_inc_then_eval_u64(p) __sync_add_and_fetch(p, 1)
-#else
-# error Not implemented for this compiler
-#endif
-
-// @notes We use one structure that describes the whole multi-threaded parse
-//  work load, and carries the shared state values for synchronizing the
-//  worker threads.
-typedef struct TaskData
-{
-    // the set of tasks
-    MD_u64 task_max;
-    char **tasks;
-    
-    // synchronization
-    volatile MD_u64 task_counter;
-    volatile MD_u64 thread_counter;
-} TaskData;
-
-// @notes Each thread gets it's own thread data.
-//
-// The library doesn't make any of it's data structures thread safe but all of
-// the calls are thread safe so long as different threads are operating on
-// different data structures. So we arrange for each worker thread to get it's
-// own arena, and set of lists for collecting parse results.
-typedef struct ThreadData
-{
-    // shared
-    TaskData *task;
-    
-    // unique-to-thread
-    MD_Arena *arena;
-    MD_Node *list;
-    MD_MessageList errors;
-} ThreadData;
-
-void
-parse_worker_loop(ThreadData *thread_data)
-{
-    TaskData *task = thread_data->task;
-    for (;;)
-    {
-        // atomically get the next unhandled task index
-        MD_u64 task_index = atomic_inc_then_eval_u64(&task->task_counter) - 1;
-        if (task_index >= task->task_max)
-        {
-            break;
-        }
-        
-        // load and parse the file specified by this task.
-        MD_String8 file_name = MD_S8CString(task->tasks[task_index]);
-        MD_ParseResult parse = MD_ParseWholeFile(thread_data->arena, file_name);
-        MD_MessageListConcat(&thread_data->errors, &parse.errors);
-        MD_PushNewReference(thread_data->arena, thread_data->list, parse.node);
-    }
-    
-    // atomically count the threads as they finish
-    atomic_inc_then_eval_u64(&task->thread_counter);
-}
-
-#if MD_OS_WINDOWS
-DWORD
-parse_worker_win32(LPVOID parameter)
-{
-    parse_worker_loop((ThreadData*)parameter);
-    return(0);
-}
-#elif MD_OS_MAC || MD_OS_LINUX
-void *
-parse_worker_pthread(void *parameter)
-{
-    parse_worker_loop((ThreadData*)parameter);
-    return(0);
-}
-#else
-# error Not implemented for this OS
-#endif
-
-
 //~ main //////////////////////////////////////////////////////////////////////
 
 int
@@ -126,107 +35,59 @@ main(int argc, char **argv)
         exit(1);
     }
     
-    // setup the shared task data
-    TaskData task = {0};
-    task.task_max = argc - 1;
-    task.tasks = argv + 1;
-    
-    // setup the per-thread data
+    // @notes The library doesn't make any of it's data structures thread safe
+    //  but all of the calls are thread safe so long as different threads are
+    //  operating on different data structures. So MD_ParseFiles wants one
+    //  arena for each thread it may use. Each file's nodes and messages are
+    //  allocated on the arena of the thread that parsed it, and the list of
+    //  results on the first arena, so all of them have to stay alive for as
+    //  long as we use the results.
 #define THREAD_COUNT 2
-    ThreadData threads[THREAD_COUNT] = {0};
+    MD_Arena *arenas[THREAD_COUNT];
     for (int i = 0; i < THREAD_COUNT; i += 1)
     {
-        threads[i].task = &task;
-        threads[i].arena = MD_ArenaAlloc();
-        threads[i].list = MD_MakeList(threads[i].arena);
+        arenas[i] = MD_ArenaAlloc();
     }
     
-    // launch the worker threads
-    //  (no worker thread 0)
-#if MD_OS_WINDOWS
-    HANDLE handles[THREAD_COUNT];
-    for (int i = 1; i < THREAD_COUNT; i += 1)
+    // gather the paths to parse
+    MD_String8List paths = {0};
+    for (int i = 1; i < argc; i += 1)
     {
-        handles[i] = CreateThread(0, 0, &parse_worker_win32, threads + i, 0, 0);
+        MD_S8ListPush(arenas[0], &paths, MD_S8CString(argv[i]));
     }
-#elif MD_OS_MAC || MD_OS_LINUX
-    pthread_t handles[THREAD_COUNT];
-    for (int i = 1; i < THREAD_COUNT; i += 1)
-    {
-        pthread_create(&handles[i], 0, &parse_worker_pthread, threads + i);
-    }
-#else
-# error Not implemented for this OS
-#endif
-
-    // let the main thread act as thread 0
-    parse_worker_loop(&threads[0]);
     
-    // wait for all threads to be finished
-#if MD_OS_WINDOWS
-    WaitForMultipleObjects(THREAD_COUNT-1, handles+1, TRUE, INFINITE);
-    for (int i = 1; i < THREAD_COUNT; i += 1)
-    {
-        CloseHandle(handles[i]);
-    }
-#elif MD_OS_MAC || MD_OS_LINUX
-    for (int i = 1; i < THREAD_COUNT; i += 1)
+    // @notes The result is a list with a reference to each file's root, in
+    //  the order the paths were given, no matter which thread parsed which
+    //  file. The errors from all files are merged in that same order.
+    MD_ParseResult parse = MD_ParseFiles(arenas, THREAD_COUNT, paths);
+    
+    // print the name of each root
+    for (MD_EachNode(root_it, parse.node->first_child))
     {
-        pthread_join(handles[i], 0);
+        MD_Node *root = MD_ResolveNodeFromReference(root_it);
+        fprintf(stdout, "%.*s\n", MD_S8VArg(root->string));
     }
-#else
-# error Not implemented for this OS
-#endif
     
-    // print results
-    for (int i = 0; i < THREAD_COUNT; i += 1)
+    // print the errors
+    for (MD_Message *message = parse.errors.first;
+         message != 0;
+         message = message->next)
     {
-        fprintf(stdout, "on thread %d:\n", i);
-        
-        // print the name of each root
-        for (MD_EachNode(root_it, threads[i].list->first_child))
-        {
-            MD_Node *root = MD_ResolveNodeFromReference(root_it);
-            fprintf(stdout, "%.*s\n", MD_S8VArg(root->string));
-        }
-        
-        // print the errors from this thread
-        MD_MessageList errors = threads[i].errors; 
-        for (MD_Message *message = errors.first;
-             message != 0;
-             message = message->next)
-        {
-            MD_CodeLoc loc = MD_CodeLocFromNode(message->node);
-            MD_PrintMessage(stdout, loc, message->kind, message->string);
-        }
+        MD_CodeLoc loc = MD_CodeLocFromNode(message->node);
+        MD_PrintMessage(stdout, loc, message->kind, message->string);
     }
     
     // @notes In this example we are done, but in some cases it might be useful
-    //  to merge the results of a multi-threaded parse to make it as if it was
-    //  a single threaded parse, and it turns out this is quite easy to do from
-    //  here.
-    //
-    //  We merge all of the arenas together so that we can handle all of the
-    //  memory with a single arena moving forward. This relies on the default
-    //  arena implementation which has an 'absorb' operation. If you plug in 
-    //  your own arena via oerrides it's up to that implementation what your
-    //  options are for this part.
+    //  to handle all of the memory with a single arena moving forward. This
+    //  relies on the default arena implementation which has an 'absorb'
+    //  operation. If you plug in your own arena via overrides it's up to that
+    //  implementation what your options are for this part.
     //
-    //  The list of roots and the list of messages can be concatenated.
-    //
-    //  All of these operations (absorb and the concat operations) move
-    //  information out of the right hand operand and into the left hand
-    //  operand, leaving the individual pieces from the worker threads invalid
-    //  after the merge.
-    
-    // combine results
-    MD_Arena *arena = threads[0].arena;
-    MD_Node *list = threads[0].list;
-    MD_MessageList errors = threads[0].errors; 
+    //  Absorbing moves everything out of the right hand operand and into the
+    //  left hand operand, leaving the worker arenas invalid after the merge.
+    MD_Arena *arena = arenas[0];
     for (int i = 1; i < THREAD_COUNT; i += 1)
     {
-        MD_ArenaDefaultAbsorb(arena, threads[i].arena);
-        MD_ListConcatInPlace(list, threads[i].list);
-        MD_MessageListConcat(&errors, &threads[i].errors);
+        MD_ArenaDefaultAbsorb(arena, arenas[i]);
     }
 }
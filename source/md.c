@@ -21,6 +21,20 @@
 **  "file load" ** OPTIONAL (required for MD_ParseWholeFile to work)
 **   #define MD_IMPL_LoadEntireFile     (MD_Arena*, MD_String8 filename) -> MD_String8   
 **
+**  "file info" ** OPTIONAL (without it, MD_ParseFiles schedules files in the order given)
+**   #define MD_IMPL_FileInfoFromPath   (MD_Arena*, MD_String8 path) -> MD_FileInfo
+**
+**  "threads" ** OPTIONAL (without it, the parallel entry points do all work on the calling thread)
+**   #define MD_IMPL_ThreadLaunch       (void (*)(void*), void*) -> uint64 (0 on failure)
+**   #define MD_IMPL_ThreadJoin         (uint64) -> void
+**   #define MD_IMPL_ThreadYield        () -> void (optional; without it, waiting threads spin)
+**   #define MD_IMPL_CpuPause           () -> void (optional; a spin-wait hint to the CPU)
+**
+**  "atomics" ** OPTIONAL (without it, MD_ParseFiles does all work on the calling thread)
+**   #define MD_IMPL_AtomicCompareExchangeU64 (volatile uint64*, uint64 exchange, uint64 comparand) -> uint64 (prior value)
+**   #define MD_IMPL_AtomicLoadAcquirePtr     (void *volatile*) -> void*
+**   #define MD_IMPL_AtomicStoreReleasePtr    (void *volatile*, void*) -> void
+**
 **  "low level memory" ** OPTIONAL (required when relying on the default arenas)
 **   #define MD_IMPL_Reserve            (uint64) -> void*
 **   #define MD_IMPL_Commit             (void*, uint64) -> MD_b32
@@ -42,6 +56,9 @@
 **   #define MD_IMPL_GetScratch         (MD_IMPL_Arena**, uint64) -> MD_IMPL_Arena*
 **  "scratch constants" ** OPTIONAL (required for default scratch)
 **   #define MD_IMPL_ScratchCount       uint64 [default 2]
+**  "scratch release" ** OPTIONAL (frees the calling thread's scratch arenas; run
+**                                 at the end of library-launched threads)
+**   #define MD_IMPL_ReleaseThreadScratch () -> void
 **
 **  "sprintf" ** REQUIRED
 **   #define MD_IMPL_Vsnprintf          (char*, uint64, char const*, va_list) -> uint64
@@ -60,6 +77,16 @@
 **   #define MD_DEFAULT_SCRATCH   -> construct "scratch" from "arena"
 **   #define MD_DEFAULT_SPRINTF   -> construct "vsnprintf" from internal implementaion
 **
+**  This control defaults to '0' i.e. 'disabled', since it needs the thread
+**  library at link time (-lpthread on Linux and Mac)
+**   #define MD_DEFAULT_THREADS   -> construct "threads" from OS headers, and "atomics"
+**                                   from compiler intrinsics
+**
+** Lexer Controls
+**  These controls default to '0' i.e. 'disabled'
+**   #define MD_DISABLE_SIMD      -> scan token runs one byte at a time, even where
+**                                   SSE2/AVX2 are available
+**
 */
 
 #if defined(_MSC_VER)
@@ -125,6 +152,68 @@ MD_CRT_LoadEntireFile(MD_Arena *arena, MD_String8 filename)
     return file_contents;
 }
 
+#if !defined(MD_IMPL_FileInfoFromPath)
+# define MD_IMPL_FileInfoFromPath MD_CRT_FileInfoFromPath
+#endif
+
+MD_FUNCTION MD_FileInfo
+MD_CRT_FileInfoFromPath(MD_Arena *arena, MD_String8 path)
+{
+    MD_FileInfo info = MD_ZERO_STRUCT;
+    MD_ArenaTemp scratch = MD_GetScratch(&arena, 1);
+    MD_String8 path_copy = MD_S8Copy(scratch.arena, path);
+    FILE *file = fopen((char*)path_copy.str, "rb");
+    if(file != 0)
+    {
+        fseek(file, 0, SEEK_END);
+        long file_size = ftell(file);
+        info.filename = MD_S8Copy(arena, MD_PathSkipLastSlash(path));
+        info.file_size = (file_size > 0 ? (MD_u64)file_size : 0);
+        fclose(file);
+    }
+    MD_ReleaseScratch(scratch);
+    return info;
+}
+
+#endif
+
+//~/////////////////////////////////////////////////////////////////////////////
+/////////////////////// Compiler Intrinsics Implementation /////////////////////
+////////////////////////////////////////////////////////////////////////////////
+
+//- intrinsics "atomics"
+#if MD_DEFAULT_THREADS && !defined(MD_IMPL_AtomicCompareExchangeU64)
+# if MD_COMPILER_CL
+#  include <intrin.h>
+#  define MD_IMPL_AtomicCompareExchangeU64(p,x,c) \
+((MD_u64)_InterlockedCompareExchange64((__int64 volatile*)(p), (__int64)(x), (__int64)(c)))
+# elif MD_COMPILER_GCC || MD_COMPILER_CLANG
+#  define MD_IMPL_AtomicCompareExchangeU64(p,x,c) __sync_val_compare_and_swap((p), (c), (x))
+# endif
+#endif
+#if MD_DEFAULT_THREADS && !defined(MD_IMPL_AtomicLoadAcquirePtr)
+# if MD_COMPILER_CL
+#  define MD_IMPL_AtomicLoadAcquirePtr(p) _InterlockedCompareExchangePointer((p), 0, 0)
+#  define MD_IMPL_AtomicStoreReleasePtr(p,v) ((void)_InterlockedExchangePointer((p), (v)))
+# elif MD_COMPILER_GCC || MD_COMPILER_CLANG
+#  define MD_IMPL_AtomicLoadAcquirePtr(p) __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#  define MD_IMPL_AtomicStoreReleasePtr(p,v) __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+# endif
+#endif
+
+//- intrinsics "threads"
+#if MD_DEFAULT_THREADS && !defined(MD_IMPL_CpuPause)
+# if MD_COMPILER_CL && (MD_ARCH_X64 || MD_ARCH_X86)
+#  include <intrin.h>
+#  define MD_IMPL_CpuPause() _mm_pause()
+# elif MD_COMPILER_CL && (MD_ARCH_ARM64 || MD_ARCH_ARM32)
+#  include <intrin.h>
+#  define MD_IMPL_CpuPause() __yield()
+# elif (MD_COMPILER_GCC || MD_COMPILER_CLANG) && (MD_ARCH_X64 || MD_ARCH_X86)
+#  define MD_IMPL_CpuPause() __builtin_ia32_pause()
+# elif (MD_COMPILER_GCC || MD_COMPILER_CLANG) && (MD_ARCH_ARM64 || MD_ARCH_ARM32)
+#  define MD_IMPL_CpuPause() __asm__ __volatile__("yield")
+# endif
 #endif
 
 
@@ -133,7 +222,7 @@ MD_CRT_LoadEntireFile(MD_Arena *arena, MD_String8 filename)
 ////////////////////////////////////////////////////////////////////////////////
 
 //- win32 header
-#if (MD_DEFAULT_FILE_ITER || MD_2DEFAULT_MEMORY) && MD_OS_WINDOWS
+#if (MD_DEFAULT_FILE_ITER || MD_2DEFAULT_MEMORY || MD_DEFAULT_THREADS) && MD_OS_WINDOWS
 # include <Windows.h>
 # pragma comment(lib, "User32.lib")
 #endif
@@ -280,6 +369,64 @@ MD_WIN32_Release(void *ptr, MD_u64 size)
 
 #endif
 
+//- win32 "threads"
+#if MD_DEFAULT_THREADS && MD_OS_WINDOWS
+
+#if !defined(MD_IMPL_ThreadLaunch)
+# define MD_IMPL_ThreadLaunch MD_WIN32_ThreadLaunch
+#endif
+#if !defined(MD_IMPL_ThreadJoin)
+# define MD_IMPL_ThreadJoin MD_WIN32_ThreadJoin
+#endif
+#if !defined(MD_IMPL_ThreadYield)
+# define MD_IMPL_ThreadYield() ((void)SwitchToThread())
+#endif
+
+typedef struct MD_WIN32_ThreadStart{
+    void (*func)(void*);
+    void *params;
+} MD_WIN32_ThreadStart;
+
+static DWORD WINAPI
+MD_WIN32_ThreadEntry(LPVOID ptr)
+{
+    MD_WIN32_ThreadStart start = *(MD_WIN32_ThreadStart*)ptr;
+    HeapFree(GetProcessHeap(), 0, ptr);
+    start.func(start.params);
+    return(0);
+}
+
+static MD_u64
+MD_WIN32_ThreadLaunch(void (*func)(void*), void *params)
+{
+    MD_u64 result = 0;
+    MD_WIN32_ThreadStart *start = (MD_WIN32_ThreadStart*)HeapAlloc(GetProcessHeap(), 0, sizeof(*start));
+    if (start != 0)
+    {
+        start->func = func;
+        start->params = params;
+        HANDLE handle = CreateThread(0, 0, MD_WIN32_ThreadEntry, start, 0, 0);
+        if (handle != 0)
+        {
+            result = (MD_u64)handle;
+        }
+        else
+        {
+            HeapFree(GetProcessHeap(), 0, start);
+        }
+    }
+    return(result);
+}
+
+static void
+MD_WIN32_ThreadJoin(MD_u64 handle)
+{
+    WaitForSingleObject((HANDLE)handle, INFINITE);
+    CloseHandle((HANDLE)handle);
+}
+
+#endif
+
 //~/////////////////////////////////////////////////////////////////////////////
 ////////////////////////// Linux Implementation ////////////////////////////////
 ////////////////////////////////////////////////////////////////////////////////
@@ -304,6 +451,11 @@ MD_WIN32_Release(void *ptr, MD_u64 size)
 #  define AT_SYMLINK_NOFOLLOW    0x100
 # endif
 #endif
+#if MD_DEFAULT_THREADS && (MD_OS_LINUX || MD_OS_MAC)
+# include <pthread.h>
+# include <sched.h>
+# include <stdlib.h>
+#endif
 
 //- linux "file iteration"
 #if MD_DEFAULT_FILE_ITER && MD_OS_LINUX
@@ -418,6 +570,63 @@ MD_LINUX_Release(void *ptr, MD_u64 size)
 
 #endif
 
+//- linux "threads"
+#if MD_DEFAULT_THREADS && (MD_OS_LINUX || MD_OS_MAC)
+
+#if !defined(MD_IMPL_ThreadLaunch)
+# define MD_IMPL_ThreadLaunch MD_LINUX_ThreadLaunch
+#endif
+#if !defined(MD_IMPL_ThreadJoin)
+# define MD_IMPL_ThreadJoin MD_LINUX_ThreadJoin
+#endif
+#if !defined(MD_IMPL_ThreadYield)
+# define MD_IMPL_ThreadYield() ((void)sched_yield())
+#endif
+
+typedef struct MD_LINUX_ThreadStart{
+    void (*func)(void*);
+    void *params;
+} MD_LINUX_ThreadStart;
+
+static void*
+MD_LINUX_ThreadEntry(void *ptr)
+{
+    MD_LINUX_ThreadStart start = *(MD_LINUX_ThreadStart*)ptr;
+    free(ptr);
+    start.func(start.params);
+    return(0);
+}
+
+static MD_u64
+MD_LINUX_ThreadLaunch(void (*func)(void*), void *params)
+{
+    MD_u64 result = 0;
+    MD_LINUX_ThreadStart *start = (MD_LINUX_ThreadStart*)malloc(sizeof(*start));
+    if (start != 0)
+    {
+        start->func = func;
+        start->params = params;
+        pthread_t thread;
+        if (pthread_create(&thread, 0, MD_LINUX_ThreadEntry, start) == 0)
+        {
+            result = (MD_u64)thread;
+        }
+        else
+        {
+            free(start);
+        }
+    }
+    return(result);
+}
+
+static void
+MD_LINUX_ThreadJoin(MD_u64 handle)
+{
+    pthread_join((pthread_t)handle, 0);
+}
+
+#endif
+
 //~/////////////////////////////////////////////////////////////////////////////
 ///////////// MD Arena From Reserve/Commit/Decommit/Release ////////////////////
 ////////////////////////////////////////////////////////////////////////////////
@@ -544,6 +753,7 @@ MD_ArenaDefaultPush(MD_ArenaDefault *arena, MD_u64 size)
             {
                 new_arena->base_pos = current->base_pos + current->cap;
                 new_arena->prev = current;
+                arena->current = new_arena;
                 current = new_arena;
                 pos_aligned = current->pos;
                 new_pos = pos_aligned + size;
@@ -664,6 +874,9 @@ MD_ArenaDefaultAbsorb(MD_ArenaDefault *arena, MD_ArenaDefault *sub_arena)
 #if !defined(MD_IMPL_GetScratch)
 # define MD_IMPL_GetScratch MD_GetScratchDefault
 #endif
+#if !defined(MD_IMPL_ReleaseThreadScratch)
+# define MD_IMPL_ReleaseThreadScratch MD_ReleaseThreadScratchDefault
+#endif
 
 MD_THREAD_LOCAL MD_Arena *md_thread_scratch_pool[MD_IMPL_ScratchCount] = {0, 0};
 
@@ -702,6 +915,22 @@ MD_GetScratchDefault(MD_Arena **conflicts, MD_u64 count)
     return(result);
 }
 
+#if defined(MD_IMPL_ThreadLaunch)
+static void
+MD_ReleaseThreadScratchDefault(void)
+{
+    MD_Arena **arena_ptr = md_thread_scratch_pool;
+    for (MD_u64 i = 0; i < MD_IMPL_ScratchCount; i += 1, arena_ptr += 1)
+    {
+        if (*arena_ptr != 0)
+        {
+            MD_ArenaRelease(*arena_ptr);
+            *arena_ptr = 0;
+        }
+    }
+}
+#endif
+
 #endif
 
 //~/////////////////////////////////////////////////////////////////////////////
@@ -727,7 +956,9 @@ static MD_Node _md_nil_node =
     &_md_nil_node,         // first_tag
     &_md_nil_node,         // last_tag
     MD_NodeKind_Nil,       // kind
+    0,                     // child_count
     0,                     // flags
+    0,                     // tag_count
     MD_ZERO_STRUCT,        // string
     MD_ZERO_STRUCT,        // raw_string
     0,                     // at
@@ -736,6 +967,20 @@ static MD_Node _md_nil_node =
     MD_ZERO_STRUCT,        // next_comment
 };
 
+static MD_CompactNode _md_nil_compact_node =
+{
+    &_md_nil_compact_node, // next
+    &_md_nil_compact_node, // parent
+    &_md_nil_compact_node, // first_child
+    &_md_nil_compact_node, // first_tag
+    MD_NodeKind_Nil,       // kind
+    0,                     // symbol
+    0,                     // flags
+    MD_ZERO_STRUCT,        // string
+};
+
+MD_StaticAssert(sizeof(MD_CompactNode) <= 64, compact_node_size_check);
+
 //~ Arena Functions
 
 MD_FUNCTION MD_Arena*
@@ -965,7 +1210,12 @@ MD_FUNCTION MD_b32
 MD_S8Match(MD_String8 a, MD_String8 b, MD_MatchFlags flags)
 {
     int result = 0;
-    if(a.size == b.size || flags & MD_StringMatchFlag_RightSideSloppy)
+    if(a.str == b.str && a.size == b.size)
+    {
+        // NOTE: interned strings share storage, so matching them is free.
+        result = 1;
+    }
+    else if(a.size == b.size || flags & MD_StringMatchFlag_RightSideSloppy)
     {
         result = 1;
         for(MD_u64 i = 0; i < a.size && i < b.size; i += 1)
@@ -1878,6 +2128,8 @@ MD_StringFromNodeKind(MD_NodeKind kind)
         
         "List",
         "Reference",
+        
+        "Unparsed",
     };
     return MD_S8CString(cstrs[kind]);
 }
@@ -2075,1346 +2327,6168 @@ MD_MapOverwrite(MD_Arena *arena, MD_Map *map, MD_MapKey key, void *val)
     return(result);
 }
 
-//~ Parsing
+//~ Symbol Tables
 
-MD_FUNCTION MD_Token
-MD_TokenFromString(MD_String8 string)
+MD_FUNCTION MD_SymbolTable
+MD_SymbolTableMake(MD_Arena *arena)
 {
-    MD_Token token = MD_ZERO_STRUCT;
-    
-    MD_u8 *one_past_last = string.str + string.size;
-    MD_u8 *first = string.str;
-    
-    if(first < one_past_last)
+    MD_SymbolTable result = MD_ZERO_STRUCT;
+    result.map = MD_MapMake(arena);
+    result.count = 1;
+    return result;
+}
+
+MD_FUNCTION MD_u32
+MD_SymbolFromString(MD_Arena *arena, MD_SymbolTable *table, MD_String8 string)
+{
+    if(table->count == 0)
     {
-        MD_u8 *at = first;
-        MD_u32 skip_n = 0;
-        MD_u32 chop_n = 0;
+        *table = MD_SymbolTableMake(arena);
+    }
+    MD_u32 result = MD_SymbolLookup(table, string);
+    if(result == 0 && string.size != 0)
+    {
+        result = table->count;
+        table->count += 1;
         
-#define MD_TokenizerScan(cond) for (; at < one_past_last && (cond); at += 1)
+        //- grow the chunk directory
+        MD_u64 chunk_idx = result / MD_SYMBOL_CHUNK_SIZE;
+        if(chunk_idx >= table->chunk_cap)
+        {
+            MD_u64 new_cap = MD_Max(16, table->chunk_cap*2);
+            MD_String8 **new_chunks = MD_PushArrayZero(arena, MD_String8 *, new_cap);
+            MD_MemoryCopy(new_chunks, table->chunks, sizeof(MD_String8 *)*table->chunk_cap);
+            table->chunks = new_chunks;
+            table->chunk_cap = new_cap;
+        }
+        if(table->chunks[chunk_idx] == 0)
+        {
+            table->chunks[chunk_idx] = MD_PushArrayZero(arena, MD_String8, MD_SYMBOL_CHUNK_SIZE);
+        }
         
-        switch (*at)
+        //- rehash into more buckets once the chains get long
+        if(result >= table->map.bucket_count*2)
         {
-            // NOTE(allen): Whitespace parsing
-            case '\n':
-            {
-                token.kind = MD_TokenKind_Newline;
-                at += 1;
-            }break;
-            
-            case ' ': case '\r': case '\t': case '\f': case '\v':
-            {
-                token.kind = MD_TokenKind_Whitespace;
-                at += 1;
-                MD_TokenizerScan(*at == ' ' || *at == '\r' || *at == '\t' || *at == '\f' || *at == '\v');
-            }break;
-            
-            // NOTE(allen): Comment parsing
-            case '/':
-            {
-                if (at + 1 < one_past_last)
-                {
-                    if (at[1] == '/')
-                    {
-                        // trim off the first '//'
-                        skip_n = 2;
-                        at += 2;
-                        token.kind = MD_TokenKind_Comment;
-                        MD_TokenizerScan(*at != '\n' && *at != '\r');
-                    }
-                    else if (at[1] == '*')
-                    {
-                        // trim off the first '/*'
-                        skip_n = 2;
-                        at += 2;
-                        token.kind = MD_TokenKind_BrokenComment;
-                        int counter = 1;
-                        for (;at < one_past_last && counter > 0; at += 1)
-                        {
-                            if (at + 1 < one_past_last)
-                            {
-                                if (at[0] == '*' && at[1] == '/')
-                                {
-                                    at += 1;
-                                    counter -= 1;
-                                }
-                                else if (at[0] == '/' && at[1] == '*')
-                                {
-                                    at += 1;
-                                    counter += 1;
-                                }
-                            }
-                        }
-                        if(counter == 0)
-                        {
-                            token.kind = MD_TokenKind_Comment;
-                            chop_n = 2;
-                        }
-                    }
-                }
-                if (token.kind == 0) goto symbol_lex;
-            }break;
-            
-            // NOTE(allen): Strings
-            case '"':
-            case '\'':
-            case '`':
+            MD_Map map = MD_MapMakeBucketCount(arena, table->map.bucket_count*4 + 1);
+            for(MD_u32 symbol = 1; symbol < result; symbol += 1)
             {
-                token.kind = MD_TokenKind_BrokenStringLiteral;
-                
-                // determine delimiter setup
-                MD_u8 d = *at;
-                MD_b32 is_triplet = (at + 2 < one_past_last && at[1] == d && at[2] == d);
-                
-                // lex triple-delimiter string
-                if (is_triplet)
-                {
-                    skip_n = 3;
-                    at += 3;
-                    MD_u32 consecutive_d = 0;
-                    for (;;)
-                    {
-                        // fail condition
-                        if (at >= one_past_last)
-                        {
-                            break;
-                        }
-                        
-                        if(at[0] == d)
-                        {
-                            consecutive_d += 1;
-                            at += 1;
-                            // close condition
-                            if (consecutive_d == 3)
-                            {
-                                chop_n = 3;
-                                token.kind = MD_TokenKind_StringLiteral;
-                                break;
-                            }
-                        }
-                        else
-                        {
-                            consecutive_d = 0;
-                            
-                            // escaping rule
-                            if(at[0] == '\\')
-                            {
-                                at += 1;
-                                if(at < one_past_last && (at[0] == d || at[0] == '\\'))
-                                {
-                                    at += 1;
-                                }
-                            }
-                            else{
-                                at += 1;
-                            }
-                        }
-                    }
-                }
-                
-                // lex single-delimiter string
-                if (!is_triplet)
-                {
-                    skip_n = 1;
-                    at += 1;
-                    for (;at < one_past_last;)
-                    {
-                        // close condition
+                MD_String8 symbol_string = MD_StringFromSymbol(table, symbol);
+                MD_MapInsert(arena, &map, MD_MapKeyStr(symbol_string), (void *)(MD_u64)symbol);
+            }
+            table->map = map;
+        }
+        
+        //- store the one copy of the string
+        MD_String8 copy = MD_S8Copy(arena, string);
+        table->chunks[chunk_idx][result % MD_SYMBOL_CHUNK_SIZE] = copy;
+        MD_MapInsert(arena, &table->map, MD_MapKeyStr(copy), (void *)(MD_u64)result);
+    }
+    return result;
+}
+
+MD_FUNCTION MD_u32
+MD_SymbolLookup(MD_SymbolTable *table, MD_String8 string)
+{
+    MD_u32 result = 0;
+    if(string.size != 0)
+    {
+        MD_MapSlot *slot = MD_MapLookup(&table->map, MD_MapKeyStr(string));
+        if(slot != 0)
+        {
+            result = (MD_u32)(MD_u64)slot->val;
+        }
+    }
+    return result;
+}
+
+MD_FUNCTION MD_String8
+MD_StringFromSymbol(MD_SymbolTable *table, MD_u32 symbol)
+{
+    MD_String8 result = MD_ZERO_STRUCT;
+    if(symbol != 0 && symbol < table->count)
+    {
+        result = table->chunks[symbol / MD_SYMBOL_CHUNK_SIZE][symbol % MD_SYMBOL_CHUNK_SIZE];
+    }
+    return result;
+}
+
+// NOTE: an interned node's string is the table's one copy of it, so a node
+// has a symbol exactly when its string points there.
+MD_FUNCTION MD_u32
+MD_SymbolFromNode(MD_SymbolTable *table, MD_Node *node)
+{
+    MD_u32 result = MD_SymbolLookup(table, node->string);
+    if(result != 0 && MD_StringFromSymbol(table, result).str != node->string.str)
+    {
+        result = 0;
+    }
+    return result;
+}
+
+MD_FUNCTION void
+MD_InternNodeSymbols(MD_Arena *arena, MD_SymbolTable *table, MD_Node *node)
+{
+    MD_ArenaTemp scratch = MD_GetScratch(&arena, 1);
+    for(MD_NodeIter it = MD_NodeIterBegin(scratch.arena, node, MD_NodeIterFlags_Tree);
+        !MD_NodeIsNil(MD_NodeIterNext(&it));)
+    {
+        if(it.node->string.size != 0)
+        {
+            MD_u32 symbol = MD_SymbolFromString(arena, table, it.node->string);
+            it.node->string = MD_StringFromSymbol(table, symbol);
+        }
+    }
+    MD_ReleaseScratch(scratch);
+}
+
+//~ Threads
+
+// Work handed to MD_ThreadJobLaunch runs on a thread of its own when a
+// "threads" implementation is available, and on the calling thread (before
+// MD_ThreadJobLaunch returns) when it is not or when launching fails, so the
+// parallel entry points produce the same results either way.
+
+typedef struct MD_ThreadJob MD_ThreadJob;
+struct MD_ThreadJob
+{
+    void (*func)(void *params);
+    void *params;
+    MD_u64 handle;
+};
+
+#if defined(MD_IMPL_ThreadLaunch)
+static void
+MD_ThreadJobEntry(void *params)
+{
+    MD_ThreadJob *job = (MD_ThreadJob*)params;
+    job->func(job->params);
+#if defined(MD_IMPL_ReleaseThreadScratch)
+    MD_IMPL_ReleaseThreadScratch();
+#endif
+}
+#endif
+
+static void
+MD_ThreadJobLaunch(MD_ThreadJob *job, void (*func)(void *params), void *params)
+{
+    job->func = func;
+    job->params = params;
+    job->handle = 0;
+#if defined(MD_IMPL_ThreadLaunch)
+    job->handle = MD_IMPL_ThreadLaunch(MD_ThreadJobEntry, job);
+#endif
+    if(job->handle == 0)
+    {
+        func(params);
+    }
+}
+
+static void
+MD_ThreadJobJoin(MD_ThreadJob *job)
+{
+#if defined(MD_IMPL_ThreadJoin)
+    if(job->handle != 0)
+    {
+        MD_IMPL_ThreadJoin(job->handle);
+        job->handle = 0;
+    }
+#else
+    (void)job;
+#endif
+}
+
+// Without an "atomics" implementation this is a plain compare-and-store, so
+// callers must keep to one thread when MD_IMPL_AtomicCompareExchangeU64 is
+// not defined.
+static MD_u64
+MD_AtomicCompareExchangeU64(volatile MD_u64 *ptr, MD_u64 exchange, MD_u64 comparand)
+{
+#if defined(MD_IMPL_AtomicCompareExchangeU64)
+    MD_u64 result = MD_IMPL_AtomicCompareExchangeU64(ptr, exchange, comparand);
+#else
+    MD_u64 result = *ptr;
+    if(result == comparand)
+    {
+        *ptr = exchange;
+    }
+#endif
+    return result;
+}
+
+// Without an "atomics" implementation these are plain accesses, with the
+// same one-thread caveat as above.
+static MD_Node *
+MD_AtomicLoadAcquireNode(MD_Node *volatile *ptr)
+{
+#if defined(MD_IMPL_AtomicLoadAcquirePtr)
+    MD_Node *result = (MD_Node *)MD_IMPL_AtomicLoadAcquirePtr((void *volatile *)ptr);
+#else
+    MD_Node *result = *ptr;
+#endif
+    return result;
+}
+
+static void
+MD_AtomicStoreReleaseNode(MD_Node *volatile *ptr, MD_Node *value)
+{
+#if defined(MD_IMPL_AtomicStoreReleasePtr)
+    MD_IMPL_AtomicStoreReleasePtr((void *volatile *)ptr, (void *)value);
+#else
+    *ptr = value;
+#endif
+}
+
+static void
+MD_ThreadYield(void)
+{
+#if defined(MD_IMPL_ThreadYield)
+    MD_IMPL_ThreadYield();
+#endif
+}
+
+static void
+MD_CpuPause(void)
+{
+#if defined(MD_IMPL_CpuPause)
+    MD_IMPL_CpuPause();
+#endif
+}
+
+// Spins on the CPU for a while before giving up the time slice, since the
+// holder of a short lock is most likely running on another core.
+static void
+MD_SpinLockAcquire(volatile MD_u64 *lock)
+{
+    for(MD_u64 spins = 0; MD_AtomicCompareExchangeU64(lock, 1, 0) != 0; spins += 1)
+    {
+        if(spins < 64)
+        {
+            MD_CpuPause();
+        }
+        else
+        {
+            MD_ThreadYield();
+        }
+    }
+}
+
+static void
+MD_SpinLockRelease(volatile MD_u64 *lock)
+{
+    MD_AtomicCompareExchangeU64(lock, 0, 1);
+}
+
+// A fixed list of work items, by index. Each thread takes from the front
+// of its own deque, and when that runs dry, steals from the back of the
+// others. No work is added once the threads start, so a deque is just a
+// [first, opl) range packed into one u64 that owners and thieves both
+// shrink with a compare-exchange.
+typedef struct MD_WorkDeque MD_WorkDeque;
+struct MD_WorkDeque
+{
+    volatile MD_u64 range;
+    MD_u32 *indices;
+    MD_u8 padding[48];
+};
+
+static MD_b32
+MD_WorkDequeTake(MD_WorkDeque *deque, MD_b32 from_back, MD_u32 *idx_out)
+{
+    MD_b32 result = 0;
+    
+    // a compare-exchange that stores what is already there doubles as an
+    // atomic load
+    MD_u64 seen = MD_AtomicCompareExchangeU64(&deque->range, 0, 0);
+    for(;;)
+    {
+        MD_u64 first = (seen & 0xffffffff);
+        MD_u64 opl = (seen >> 32);
+        if(first >= opl)
+        {
+            break;
+        }
+        MD_u64 taken = (from_back ? opl - 1 : first);
+        MD_u64 rest = (from_back ? (first | ((opl - 1) << 32)) : ((first + 1) | (opl << 32)));
+        MD_u64 prior = MD_AtomicCompareExchangeU64(&deque->range, rest, seen);
+        if(prior == seen)
+        {
+            *idx_out = deque->indices[taken];
+            result = 1;
+            break;
+        }
+        seen = prior;
+    }
+    
+    return result;
+}
+
+static MD_b32
+MD_WorkDequesTake(MD_WorkDeque *deques, MD_u64 thread_idx, MD_u64 thread_count, MD_u32 *idx_out)
+{
+    MD_b32 result = MD_WorkDequeTake(&deques[thread_idx], 0, idx_out);
+    for(MD_u64 victim_offset = 1; !result && victim_offset < thread_count; victim_offset += 1)
+    {
+        MD_u64 victim_idx = (thread_idx + victim_offset) % thread_count;
+        result = MD_WorkDequeTake(&deques[victim_idx], 1, idx_out);
+    }
+    return result;
+}
+
+// Deals the items round-robin, so that each deque keeps their order, and
+// items early in the order (the largest, for callers that sort) are taken
+// first.
+static MD_WorkDeque *
+MD_WorkDequesFromOrder(MD_Arena *arena, MD_u32 *order, MD_u64 count, MD_u64 thread_count)
+{
+    MD_WorkDeque *deques = MD_PushArrayZero(arena, MD_WorkDeque, thread_count);
+    for(MD_u64 thread_idx = 0; thread_idx < thread_count; thread_idx += 1)
+    {
+        MD_u64 deque_count = (count + thread_count - 1 - thread_idx) / thread_count;
+        deques[thread_idx].indices = MD_PushArrayZero(arena, MD_u32, deque_count);
+        for(MD_u64 deque_idx = 0; deque_idx < deque_count; deque_idx += 1)
+        {
+            deques[thread_idx].indices[deque_idx] = order[deque_idx*thread_count + thread_idx];
+        }
+        deques[thread_idx].range = (deque_count << 32);
+    }
+    return deques;
+}
+
+// Splits the items into one run per thread, in order, with about the same
+// total size in each, for work where neighboring items share memory.
+static MD_WorkDeque *
+MD_WorkDequesFromSizes(MD_Arena *arena, MD_u64 *sizes, MD_u64 count, MD_u64 thread_count)
+{
+    MD_WorkDeque *deques = MD_PushArrayZero(arena, MD_WorkDeque, thread_count);
+    MD_u32 *indices = MD_PushArrayZero(arena, MD_u32, count);
+    MD_u64 total_size = 0;
+    for(MD_u64 idx = 0; idx < count; idx += 1)
+    {
+        indices[idx] = (MD_u32)idx;
+        total_size += sizes[idx];
+    }
+    MD_u64 size = 0;
+    MD_u64 first = 0;
+    MD_u64 idx = 0;
+    for(MD_u64 thread_idx = 0; thread_idx < thread_count; thread_idx += 1)
+    {
+        MD_u64 size_opl = total_size*(thread_idx + 1)/thread_count;
+        for(;idx < count && (size < size_opl || thread_idx + 1 == thread_count); idx += 1)
+        {
+            size += sizes[idx];
+        }
+        deques[thread_idx].indices = indices + first;
+        deques[thread_idx].range = ((idx - first) << 32);
+        first = idx;
+    }
+    return deques;
+}
+
+//~ Parsing
+
+//- Lexer scanning helpers
+//
+// The run-scanning loops of MD_TokenFromString go through these. Each returns
+// the first byte in [at, opl) that is not part of the run, or, for
+// MD_LexScanUntil, the first byte that the caller has to look at. With SSE2 (always
+// available on x64) or AVX2 (when the compiler targets it), whole 16/32 byte
+// blocks are classified at once; the scalar loop handles the tail, and
+// MD_DISABLE_SIMD forces it for everything.
+
+#if !MD_DISABLE_SIMD && MD_ARCH_X64
+# define MD_LEX_SSE2 1
+# include <emmintrin.h>
+# if defined(__AVX2__)
+#  define MD_LEX_AVX2 1
+#  include <immintrin.h>
+# endif
+#endif
+#if !defined(MD_LEX_SSE2)
+# define MD_LEX_SSE2 0
+#endif
+#if !defined(MD_LEX_AVX2)
+# define MD_LEX_AVX2 0
+#endif
+
+#if MD_LEX_SSE2
+
+#if MD_COMPILER_CL
+# include <intrin.h>
+#endif
+
+static MD_u32
+MD_LexCountTrailingZeros32(MD_u32 x)
+{
+#if MD_COMPILER_CL
+    unsigned long result = 0;
+    _BitScanForward(&result, x);
+    return (MD_u32)result;
+#else
+    return (MD_u32)__builtin_ctz(x);
+#endif
+}
+
+// Byte compares are signed, so bytes >= 0x80 fall outside every range.
+#define MD_LexSSE2Range(c, lo, hi) _mm_and_si128(_mm_cmpgt_epi8((c), _mm_set1_epi8((char)((lo) - 1))), \
+_mm_cmpgt_epi8(_mm_set1_epi8((char)((hi) + 1)), (c)))
+
+static __m128i
+MD_LexSSE2IsWhitespace(__m128i c)
+{
+    __m128i ctrl = _mm_andnot_si128(_mm_cmpeq_epi8(c, _mm_set1_epi8('\n')), MD_LexSSE2Range(c, '\t', '\r'));
+    return _mm_or_si128(ctrl, _mm_cmpeq_epi8(c, _mm_set1_epi8(' ')));
+}
+
+static __m128i
+MD_LexSSE2IsAlphaNumeric(__m128i c)
+{
+    __m128i lower = _mm_or_si128(c, _mm_set1_epi8(0x20));
+    return _mm_or_si128(MD_LexSSE2Range(lower, 'a', 'z'), MD_LexSSE2Range(c, '0', '9'));
+}
+
+#endif
+
+#if MD_LEX_AVX2
+
+#define MD_LexAVX2Range(c, lo, hi) _mm256_and_si256(_mm256_cmpgt_epi8((c), _mm256_set1_epi8((char)((lo) - 1))), \
+_mm256_cmpgt_epi8(_mm256_set1_epi8((char)((hi) + 1)), (c)))
+
+static __m256i
+MD_LexAVX2IsWhitespace(__m256i c)
+{
+    __m256i ctrl = _mm256_andnot_si256(_mm256_cmpeq_epi8(c, _mm256_set1_epi8('\n')), MD_LexAVX2Range(c, '\t', '\r'));
+    return _mm256_or_si256(ctrl, _mm256_cmpeq_epi8(c, _mm256_set1_epi8(' ')));
+}
+
+static __m256i
+MD_LexAVX2IsAlphaNumeric(__m256i c)
+{
+    __m256i lower = _mm256_or_si256(c, _mm256_set1_epi8(0x20));
+    return _mm256_or_si256(MD_LexAVX2Range(lower, 'a', 'z'), MD_LexAVX2Range(c, '0', '9'));
+}
+
+#endif
+
+// Expands to the SIMD block loops shared by the run scanners. For each
+// width, `classify` maps a register of bytes to 0xFF for bytes in the run.
+#if MD_LEX_AVX2
+# define MD_LexScanBlocksAVX2(classify_avx2) \
+for(; at + 32 <= opl; at += 32)\
+{\
+__m256i c = _mm256_loadu_si256((__m256i *)at);\
+MD_u32 stop = ~(MD_u32)_mm256_movemask_epi8(classify_avx2);\
+if(stop != 0)\
+{\
+return at + MD_LexCountTrailingZeros32(stop);\
+}\
+}
+#else
+# define MD_LexScanBlocksAVX2(classify_avx2)
+#endif
+#if MD_LEX_SSE2
+# define MD_LexScanBlocksSSE2(classify_sse2) \
+for(; at + 16 <= opl; at += 16)\
+{\
+__m128i c = _mm_loadu_si128((__m128i *)at);\
+MD_u32 stop = (~(MD_u32)_mm_movemask_epi8(classify_sse2)) & 0xFFFF;\
+if(stop != 0)\
+{\
+return at + MD_LexCountTrailingZeros32(stop);\
+}\
+}
+#else
+# define MD_LexScanBlocksSSE2(classify_sse2)
+#endif
+
+static MD_u8 *
+MD_LexScanWhitespace(MD_u8 *at, MD_u8 *opl)
+{
+    MD_LexScanBlocksAVX2(MD_LexAVX2IsWhitespace(c));
+    MD_LexScanBlocksSSE2(MD_LexSSE2IsWhitespace(c));
+    for(; at < opl && (*at == ' ' || *at == '\r' || *at == '\t' || *at == '\f' || *at == '\v'); at += 1);
+    return at;
+}
+
+static MD_u8 *
+MD_LexScanIdentifier(MD_u8 *at, MD_u8 *opl)
+{
+    MD_LexScanBlocksAVX2(_mm256_or_si256(MD_LexAVX2IsAlphaNumeric(c), _mm256_cmpeq_epi8(c, _mm256_set1_epi8('_'))));
+    MD_LexScanBlocksSSE2(_mm_or_si128(MD_LexSSE2IsAlphaNumeric(c), _mm_cmpeq_epi8(c, _mm_set1_epi8('_'))));
+    for(; at < opl && (MD_CharIsAlpha(*at) || MD_CharIsDigit(*at) || *at == '_'); at += 1);
+    return at;
+}
+
+static MD_u8 *
+MD_LexScanNumeric(MD_u8 *at, MD_u8 *opl)
+{
+    MD_LexScanBlocksAVX2(_mm256_or_si256(_mm256_or_si256(MD_LexAVX2IsAlphaNumeric(c), _mm256_cmpeq_epi8(c, _mm256_set1_epi8('_'))),
+                                         _mm256_cmpeq_epi8(c, _mm256_set1_epi8('.'))));
+    MD_LexScanBlocksSSE2(_mm_or_si128(_mm_or_si128(MD_LexSSE2IsAlphaNumeric(c), _mm_cmpeq_epi8(c, _mm_set1_epi8('_'))),
+                                      _mm_cmpeq_epi8(c, _mm_set1_epi8('.'))));
+    for(; at < opl && (MD_CharIsAlpha(*at) || MD_CharIsDigit(*at) || *at == '.' || *at == '_'); at += 1);
+    return at;
+}
+
+// Skips to the first occurrence of any of b0, b1 or b2 (pass a byte twice
+// to search for fewer). Strings and comments use this to jump over bytes
+// that cannot close, escape or break them.
+static MD_u8 *
+MD_LexScanUntil(MD_u8 *at, MD_u8 *opl, MD_u8 b0, MD_u8 b1, MD_u8 b2)
+{
+#if MD_LEX_AVX2
+    {
+        __m256i v0 = _mm256_set1_epi8((char)b0);
+        __m256i v1 = _mm256_set1_epi8((char)b1);
+        __m256i v2 = _mm256_set1_epi8((char)b2);
+        for(; at + 32 <= opl; at += 32)
+        {
+            __m256i c = _mm256_loadu_si256((__m256i *)at);
+            __m256i hit = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(c, v0), _mm256_cmpeq_epi8(c, v1)),
+                                          _mm256_cmpeq_epi8(c, v2));
+            MD_u32 mask = (MD_u32)_mm256_movemask_epi8(hit);
+            if(mask != 0)
+            {
+                return at + MD_LexCountTrailingZeros32(mask);
+            }
+        }
+    }
+#endif
+#if MD_LEX_SSE2
+    {
+        __m128i v0 = _mm_set1_epi8((char)b0);
+        __m128i v1 = _mm_set1_epi8((char)b1);
+        __m128i v2 = _mm_set1_epi8((char)b2);
+        for(; at + 16 <= opl; at += 16)
+        {
+            __m128i c = _mm_loadu_si128((__m128i *)at);
+            __m128i hit = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(c, v0), _mm_cmpeq_epi8(c, v1)),
+                                       _mm_cmpeq_epi8(c, v2));
+            MD_u32 mask = (MD_u32)_mm_movemask_epi8(hit);
+            if(mask != 0)
+            {
+                return at + MD_LexCountTrailingZeros32(mask);
+            }
+        }
+    }
+#endif
+    for(; at < opl && *at != b0 && *at != b1 && *at != b2; at += 1);
+    return at;
+}
+
+MD_FUNCTION MD_Token
+MD_TokenFromString(MD_String8 string)
+{
+    MD_Token token = MD_ZERO_STRUCT;
+    
+    MD_u8 *one_past_last = string.str + string.size;
+    MD_u8 *first = string.str;
+    
+    if(first < one_past_last)
+    {
+        MD_u8 *at = first;
+        MD_u32 skip_n = 0;
+        MD_u32 chop_n = 0;
+        
+#define MD_TokenizerScan(cond) for (; at < one_past_last && (cond); at += 1)
+        
+        switch (*at)
+        {
+            // NOTE(allen): Whitespace parsing
+            case '\n':
+            {
+                token.kind = MD_TokenKind_Newline;
+                at += 1;
+            }break;
+            
+            case ' ': case '\r': case '\t': case '\f': case '\v':
+            {
+                token.kind = MD_TokenKind_Whitespace;
+                at = MD_LexScanWhitespace(at + 1, one_past_last);
+            }break;
+            
+            // NOTE(allen): Comment parsing
+            case '/':
+            {
+                if (at + 1 < one_past_last)
+                {
+                    if (at[1] == '/')
+                    {
+                        // trim off the first '//'
+                        skip_n = 2;
+                        at += 2;
+                        token.kind = MD_TokenKind_Comment;
+                        at = MD_LexScanUntil(at, one_past_last, '\n', '\r', '\r');
+                    }
+                    else if (at[1] == '*')
+                    {
+                        // trim off the first '/*'
+                        skip_n = 2;
+                        at += 2;
+                        token.kind = MD_TokenKind_BrokenComment;
+                        int counter = 1;
+                        for (;at < one_past_last && counter > 0; at += 1)
+                        {
+                            // only '*' and '/' can open or close a level
+                            at = MD_LexScanUntil(at, one_past_last, '*', '/', '/');
+                            if (at >= one_past_last)
+                            {
+                                break;
+                            }
+                            if (at + 1 < one_past_last)
+                            {
+                                if (at[0] == '*' && at[1] == '/')
+                                {
+                                    at += 1;
+                                    counter -= 1;
+                                }
+                                else if (at[0] == '/' && at[1] == '*')
+                                {
+                                    at += 1;
+                                    counter += 1;
+                                }
+                            }
+                        }
+                        if(counter == 0)
+                        {
+                            token.kind = MD_TokenKind_Comment;
+                            chop_n = 2;
+                        }
+                    }
+                }
+                if (token.kind == 0) goto symbol_lex;
+            }break;
+            
+            // NOTE(allen): Strings
+            case '"':
+            case '\'':
+            case '`':
+            {
+                token.kind = MD_TokenKind_BrokenStringLiteral;
+                
+                // determine delimiter setup
+                MD_u8 d = *at;
+                MD_b32 is_triplet = (at + 2 < one_past_last && at[1] == d && at[2] == d);
+                
+                // lex triple-delimiter string
+                if (is_triplet)
+                {
+                    skip_n = 3;
+                    at += 3;
+                    MD_u32 consecutive_d = 0;
+                    for (;;)
+                    {
+                        // jump to the next delimiter or escape; anything in
+                        // between breaks a run of delimiters
+                        MD_u8 *next = MD_LexScanUntil(at, one_past_last, d, '\\', d);
+                        if (next != at)
+                        {
+                            consecutive_d = 0;
+                            at = next;
+                        }
+                        
+                        // fail condition
+                        if (at >= one_past_last)
+                        {
+                            break;
+                        }
+                        
+                        if(at[0] == d)
+                        {
+                            consecutive_d += 1;
+                            at += 1;
+                            // close condition
+                            if (consecutive_d == 3)
+                            {
+                                chop_n = 3;
+                                token.kind = MD_TokenKind_StringLiteral;
+                                break;
+                            }
+                        }
+                        else
+                        {
+                            consecutive_d = 0;
+                            
+                            // escaping rule
+                            if(at[0] == '\\')
+                            {
+                                at += 1;
+                                if(at < one_past_last && (at[0] == d || at[0] == '\\'))
+                                {
+                                    at += 1;
+                                }
+                            }
+                            else{
+                                at += 1;
+                            }
+                        }
+                    }
+                }
+                
+                // lex single-delimiter string
+                if (!is_triplet)
+                {
+                    skip_n = 1;
+                    at += 1;
+                    for (;at < one_past_last;)
+                    {
+                        // jump to the next delimiter, newline or escape
+                        at = MD_LexScanUntil(at, one_past_last, d, '\n', '\\');
+                        if (at >= one_past_last)
+                        {
+                            break;
+                        }
+                        
+                        // close condition
                         if (*at == d)
                         {
-                            at += 1;
-                            chop_n = 1;
-                            token.kind = MD_TokenKind_StringLiteral;
-                            break;
+                            at += 1;
+                            chop_n = 1;
+                            token.kind = MD_TokenKind_StringLiteral;
+                            break;
+                        }
+                        
+                        // fail condition
+                        if (*at == '\n')
+                        {
+                            break;
+                        }
+                        
+                        // escaping rule
+                        if (at[0] == '\\')
+                        {
+                            at += 1;
+                            if (at < one_past_last && (at[0] == d || at[0] == '\\'))
+                            {
+                                at += 1;
+                            }
+                        }
+                        else
+                        {
+                            at += 1;
+                        }
+                    }
+                }
+                
+                //- rjf: set relevant node flags on token
+                token.node_flags |= MD_NodeFlag_StringLiteral;
+                switch(d)
+                {
+                    case '\'': token.node_flags |= MD_NodeFlag_StringSingleQuote; break;
+                    case '"':  token.node_flags |= MD_NodeFlag_StringDoubleQuote; break;
+                    case '`':  token.node_flags |= MD_NodeFlag_StringTick; break;
+                    default: break;
+                }
+                if(is_triplet)
+                {
+                    token.node_flags |= MD_NodeFlag_StringTriplet;
+                }
+                
+            }break;
+            
+            // NOTE(allen): Identifiers, Numbers, Symbols
+            default:
+            {
+                if (MD_CharIsAlpha(*at) || *at == '_')
+                {
+                    token.node_flags |= MD_NodeFlag_Identifier;
+                    token.kind = MD_TokenKind_Identifier;
+                    at = MD_LexScanIdentifier(at + 1, one_past_last);
+                }
+                
+                else if (MD_CharIsDigit(*at))
+                {
+                    token.node_flags |= MD_NodeFlag_Numeric;
+                    token.kind = MD_TokenKind_Numeric;
+                    at += 1;
+                    
+                    for (;;)
+                    {
+                        at = MD_LexScanNumeric(at, one_past_last);
+                        
+                        // an exponent marker may be followed by a sign, which continues the number
+                        if (at < one_past_last && (*at == '+' || *at == '-') &&
+                            (at[-1] == 'e' || at[-1] == 'E'))
+                        {
+                            at += 1;
+                            continue;
+                        }
+                        break;
+                    }
+                }
+                
+                else if (MD_CharIsUnreservedSymbol(*at))
+                {
+                    symbol_lex:
+                    
+                    token.node_flags |= MD_NodeFlag_Symbol;
+                    token.kind = MD_TokenKind_Symbol;
+                    at += 1;
+                    MD_TokenizerScan(MD_CharIsUnreservedSymbol(*at));
+                }
+                
+                else if (MD_CharIsReservedSymbol(*at))
+                {
+                    token.kind = MD_TokenKind_Reserved;
+                    at += 1;
+                }
+                
+                else
+                {
+                    token.kind = MD_TokenKind_BadCharacter;
+                    at += 1;
+                }
+            }break;
+        }
+        
+        token.raw_string = MD_S8Range(first, at);
+        token.string = MD_S8Substring(token.raw_string, skip_n, token.raw_string.size - chop_n);
+        
+#undef MD_TokenizerScan
+        
+    }
+    
+    return token;
+}
+
+MD_FUNCTION MD_u64
+MD_LexAdvanceFromSkips(MD_String8 string, MD_TokenKind skip_kinds)
+{
+    MD_u64 result = string.size;
+    MD_u64 p = 0;
+    for (;;)
+    {
+        MD_Token token = MD_TokenFromString(MD_S8Skip(string, p));
+        if ((skip_kinds & token.kind) == 0)
+        {
+            result = p;
+            break;
+        }
+        p += token.raw_string.size;
+    }
+    return(result);
+}
+
+MD_FUNCTION MD_ParseResult
+MD_ParseResultZero(void)
+{
+    MD_ParseResult result = MD_ZERO_STRUCT;
+    result.node = MD_NilNode();
+    return result;
+}
+
+//- Token arrays
+
+#define MD_TOKEN_CHUNK_CAP 4096
+
+// Below this many bytes per thread, MD_TokenizeStringParallel lexes serially.
+#if !defined(MD_PARALLEL_LEX_MIN_CHUNK_SIZE)
+# define MD_PARALLEL_LEX_MIN_CHUNK_SIZE (256llu << 10)
+#endif
+
+typedef struct MD_TokenChunk MD_TokenChunk;
+struct MD_TokenChunk
+{
+    MD_TokenChunk *next;
+    MD_u64 count;
+    MD_TokenKind kinds[MD_TOKEN_CHUNK_CAP];
+    MD_u32 node_flags[MD_TOKEN_CHUNK_CAP];
+    MD_u64 offsets[MD_TOKEN_CHUNK_CAP];
+    MD_u8 skips[MD_TOKEN_CHUNK_CAP];
+    MD_u8 chops[MD_TOKEN_CHUNK_CAP];
+};
+
+typedef struct MD_TokenChunkList MD_TokenChunkList;
+struct MD_TokenChunkList
+{
+    MD_TokenChunk *first;
+    MD_TokenChunk *last;
+    MD_u64 count;
+};
+
+static void
+MD_TokenChunkListPush(MD_Arena *arena, MD_TokenChunkList *list, MD_Token token, MD_u64 off)
+{
+    if(list->last == 0 || list->last->count == MD_TOKEN_CHUNK_CAP)
+    {
+        MD_TokenChunk *chunk = MD_PushArray(arena, MD_TokenChunk, 1);
+        chunk->next = 0;
+        chunk->count = 0;
+        MD_QueuePush(list->first, list->last, chunk);
+    }
+    MD_TokenChunk *chunk = list->last;
+    MD_u64 idx = chunk->count;
+    chunk->kinds[idx] = token.kind;
+    chunk->node_flags[idx] = (MD_u32)token.node_flags;
+    chunk->offsets[idx] = off;
+    chunk->skips[idx] = (MD_u8)(token.string.str - token.raw_string.str);
+    chunk->chops[idx] = (MD_u8)((token.raw_string.str + token.raw_string.size) -
+                                (token.string.str + token.string.size));
+    chunk->count += 1;
+    list->count += 1;
+}
+
+static MD_TokenArray
+MD_TokenArrayAlloc(MD_Arena *arena, MD_String8 string, MD_u64 count)
+{
+    MD_TokenArray result = MD_ZERO_STRUCT;
+    result.string = string;
+    result.count = count;
+    result.kinds = MD_PushArray(arena, MD_TokenKind, count);
+    result.node_flags = MD_PushArray(arena, MD_u32, count);
+    result.offsets = MD_PushArray(arena, MD_u64, count + 1);
+    result.skips = MD_PushArray(arena, MD_u8, count);
+    result.chops = MD_PushArray(arena, MD_u8, count);
+    return result;
+}
+
+static void
+MD_TokenArrayCopyFromChunkList(MD_TokenArray *dst, MD_u64 dst_idx, MD_TokenChunkList *list)
+{
+    for(MD_TokenChunk *chunk = list->first; chunk != 0; chunk = chunk->next)
+    {
+        MD_MemoryCopy(dst->kinds + dst_idx, chunk->kinds, sizeof(chunk->kinds[0])*chunk->count);
+        MD_MemoryCopy(dst->node_flags + dst_idx, chunk->node_flags, sizeof(chunk->node_flags[0])*chunk->count);
+        MD_MemoryCopy(dst->offsets + dst_idx, chunk->offsets, sizeof(chunk->offsets[0])*chunk->count);
+        MD_MemoryCopy(dst->skips + dst_idx, chunk->skips, sizeof(chunk->skips[0])*chunk->count);
+        MD_MemoryCopy(dst->chops + dst_idx, chunk->chops, sizeof(chunk->chops[0])*chunk->count);
+        dst_idx += chunk->count;
+    }
+}
+
+static void
+MD_TokenArrayCopyRange(MD_TokenArray *dst, MD_u64 dst_idx, MD_TokenArray *src, MD_u64 first, MD_u64 opl)
+{
+    MD_u64 count = opl - first;
+    MD_MemoryCopy(dst->kinds + dst_idx, src->kinds + first, sizeof(src->kinds[0])*count);
+    MD_MemoryCopy(dst->node_flags + dst_idx, src->node_flags + first, sizeof(src->node_flags[0])*count);
+    MD_MemoryCopy(dst->offsets + dst_idx, src->offsets + first, sizeof(src->offsets[0])*count);
+    MD_MemoryCopy(dst->skips + dst_idx, src->skips + first, sizeof(src->skips[0])*count);
+    MD_MemoryCopy(dst->chops + dst_idx, src->chops + first, sizeof(src->chops[0])*count);
+}
+
+// Lexes every token of `string` that starts in [first, opl), assuming a token
+// starts at `first`. The last token may run past `opl`; offsets[count] is
+// where it ends.
+static MD_TokenArray
+MD_TokenArrayFromRange(MD_Arena *arena, MD_String8 string, MD_u64 first, MD_u64 opl)
+{
+    MD_ArenaTemp scratch = MD_GetScratch(&arena, 1);
+    
+    //- lex every token once, into chunks on the scratch arena
+    MD_TokenChunkList list = MD_ZERO_STRUCT;
+    MD_u64 off = first;
+    for(; off < opl;)
+    {
+        MD_Token token = MD_TokenFromString(MD_S8Skip(string, off));
+        MD_TokenChunkListPush(scratch.arena, &list, token, off);
+        off += token.raw_string.size;
+    }
+    
+    //- flatten chunks into the result arrays
+    MD_TokenArray result = MD_TokenArrayAlloc(arena, string, list.count);
+    MD_TokenArrayCopyFromChunkList(&result, 0, &list);
+    result.offsets[list.count] = off;
+    
+    MD_ReleaseScratch(scratch);
+    return result;
+}
+
+MD_FUNCTION MD_TokenArray
+MD_TokenizeString(MD_Arena *arena, MD_String8 string)
+{
+    return MD_TokenArrayFromRange(arena, string, 0, string.size);
+}
+
+//- Parallel tokenizing
+//
+// A token depends only on the bytes from its first byte onward, so the one
+// piece of state the lexer carries between tokens is where the next token
+// starts. Each chunk is lexed speculatively from its first byte. When that
+// byte falls inside a string or comment, the chunk's first few guesses are
+// wrong. A chunk's stream is exact from the first boundary it shares with the
+// true stream.
+//
+// The stitch pass follows the true stream. It carries the end of the last
+// accepted token into each chunk and re-lexes serially from there until it
+// lands on one of the chunk's own boundaries. From that point it takes the
+// rest of the chunk unchanged.
+
+typedef struct MD_LexChunkTask MD_LexChunkTask;
+struct MD_LexChunkTask
+{
+    MD_Arena *arena;
+    MD_String8 string;
+    MD_u64 first;
+    MD_u64 opl;
+    MD_TokenArray tokens;
+};
+
+static void
+MD_LexChunkTaskRun(void *params)
+{
+    MD_LexChunkTask *task = (MD_LexChunkTask*)params;
+    task->tokens = MD_TokenArrayFromRange(task->arena, task->string, task->first, task->opl);
+}
+
+MD_FUNCTION MD_TokenArray
+MD_TokenizeStringParallel(MD_Arena *arena, MD_String8 string, MD_u64 thread_count)
+{
+    MD_TokenArray result = MD_ZERO_STRUCT;
+    MD_u64 chunk_count = MD_Min(thread_count, string.size / MD_PARALLEL_LEX_MIN_CHUNK_SIZE);
+    if(chunk_count <= 1)
+    {
+        result = MD_TokenizeString(arena, string);
+    }
+    else
+    {
+        MD_ArenaTemp scratch = MD_GetScratch(&arena, 1);
+        MD_LexChunkTask *tasks = MD_PushArrayZero(scratch.arena, MD_LexChunkTask, chunk_count);
+        MD_ThreadJob *jobs = MD_PushArrayZero(scratch.arena, MD_ThreadJob, chunk_count);
+        
+        //- split into chunks, preferring to start each one after a newline,
+        // which is a token boundary unless it is inside a string or comment
+        {
+            MD_u64 first = 0;
+            for(MD_u64 chunk_idx = 0; chunk_idx < chunk_count; chunk_idx += 1)
+            {
+                MD_u64 opl = string.size;
+                if(chunk_idx + 1 < chunk_count)
+                {
+                    opl = MD_Max(first, string.size / chunk_count * (chunk_idx + 1));
+                    MD_u64 search_opl = MD_Min(string.size, opl + 4096);
+                    for(MD_u64 off = opl; off < search_opl; off += 1)
+                    {
+                        if(string.str[off] == '\n')
+                        {
+                            opl = off + 1;
+                            break;
+                        }
+                    }
+                }
+                tasks[chunk_idx].arena = (chunk_idx == 0 ? scratch.arena : MD_ArenaAlloc());
+                tasks[chunk_idx].string = string;
+                tasks[chunk_idx].first = first;
+                tasks[chunk_idx].opl = opl;
+                first = opl;
+            }
+        }
+        
+        //- lex every chunk speculatively; this thread takes the first one
+        for(MD_u64 chunk_idx = 1; chunk_idx < chunk_count; chunk_idx += 1)
+        {
+            MD_ThreadJobLaunch(&jobs[chunk_idx], MD_LexChunkTaskRun, &tasks[chunk_idx]);
+        }
+        MD_LexChunkTaskRun(&tasks[0]);
+        for(MD_u64 chunk_idx = 1; chunk_idx < chunk_count; chunk_idx += 1)
+        {
+            MD_ThreadJobJoin(&jobs[chunk_idx]);
+        }
+        
+        //- stitch: follow the true token boundaries through the chunks
+        MD_TokenChunkList *fixups = MD_PushArrayZero(scratch.arena, MD_TokenChunkList, chunk_count);
+        MD_u64 *takes = MD_PushArrayZero(scratch.arena, MD_u64, chunk_count);
+        MD_u64 count = 0;
+        {
+            MD_u64 pos = 0;
+            for(MD_u64 chunk_idx = 0; chunk_idx < chunk_count; chunk_idx += 1)
+            {
+                MD_TokenArray *tokens = &tasks[chunk_idx].tokens;
+                MD_b32 is_last = (chunk_idx + 1 == chunk_count);
+                MD_u64 idx = 0;
+                for(;;)
+                {
+                    for(; idx < tokens->count && tokens->offsets[idx] < pos; idx += 1);
+                    if(idx < tokens->count ? tokens->offsets[idx] == pos : (!is_last || pos >= string.size))
+                    {
+                        break;
+                    }
+                    MD_Token token = MD_TokenFromString(MD_S8Skip(string, pos));
+                    MD_TokenChunkListPush(scratch.arena, &fixups[chunk_idx], token, pos);
+                    pos += token.raw_string.size;
+                }
+                takes[chunk_idx] = idx;
+                if(idx < tokens->count)
+                {
+                    pos = tokens->offsets[tokens->count];
+                }
+                count += fixups[chunk_idx].count + (tokens->count - idx);
+            }
+        }
+        
+        //- gather the accepted tokens in stream order
+        result = MD_TokenArrayAlloc(arena, string, count);
+        {
+            MD_u64 dst_idx = 0;
+            for(MD_u64 chunk_idx = 0; chunk_idx < chunk_count; chunk_idx += 1)
+            {
+                MD_TokenArray *tokens = &tasks[chunk_idx].tokens;
+                MD_TokenArrayCopyFromChunkList(&result, dst_idx, &fixups[chunk_idx]);
+                dst_idx += fixups[chunk_idx].count;
+                MD_TokenArrayCopyRange(&result, dst_idx, tokens, takes[chunk_idx], tokens->count);
+                dst_idx += tokens->count - takes[chunk_idx];
+            }
+            result.offsets[count] = string.size;
+        }
+        
+        for(MD_u64 chunk_idx = 1; chunk_idx < chunk_count; chunk_idx += 1)
+        {
+            MD_ArenaRelease(tasks[chunk_idx].arena);
+        }
+        MD_ReleaseScratch(scratch);
+    }
+    return result;
+}
+
+MD_FUNCTION MD_Token
+MD_TokenFromTokenArray(MD_TokenArray *tokens, MD_u64 idx)
+{
+    MD_Token token = MD_ZERO_STRUCT;
+    if(idx < tokens->count)
+    {
+        token.kind = tokens->kinds[idx];
+        token.node_flags = tokens->node_flags[idx];
+        token.raw_string = MD_S8Range(tokens->string.str + tokens->offsets[idx],
+                                      tokens->string.str + tokens->offsets[idx + 1]);
+        token.string = MD_S8Substring(token.raw_string, tokens->skips[idx],
+                                      token.raw_string.size - tokens->chops[idx]);
+    }
+    return token;
+}
+
+MD_FUNCTION MD_u64
+MD_TokenIndexAdvanceFromSkips(MD_TokenArray *tokens, MD_u64 idx, MD_TokenKind skip_kinds)
+{
+    MD_u64 result = idx;
+    for(;result < tokens->count && (tokens->kinds[result] & skip_kinds) != 0; result += 1);
+    return result;
+}
+
+//- Parser
+
+// The parser walks a token array by index; `at` is the index of the next token
+// to consume. Node offsets and error locations stay relative to `string`, which
+// may begin before the first token.
+typedef struct MD_ParseCtx MD_ParseCtx;
+struct MD_ParseCtx
+{
+    MD_Arena *arena;
+    MD_String8 string;
+    MD_TokenArray tokens;
+    MD_u64 at;
+    MD_SymbolTable *symbols;
+    MD_ParseFlags flags;
+    MD_u64 lazy_fail_at;
+    MD_ParseLazyState *lazy_state;
+    MD_ParseEventFunc *event_func;
+    void *event_user_data;
+    MD_ParseFilterFunc *filter_func;
+    void *filter_user_data;
+    // When set, `tokens` only covers a window of `string`, which the parser
+    // refills on this arena once `at` passes `window_refill_at`.
+    MD_Arena *window_arena;
+    MD_u64 window_span;
+    MD_u64 window_refill_at;
+};
+
+static void
+MD_ParseInternNode(MD_ParseCtx *ctx, MD_Node *node)
+{
+    if(ctx->symbols != 0 && node->string.size != 0)
+    {
+        MD_u32 symbol = MD_SymbolFromString(ctx->arena, ctx->symbols, node->string);
+        node->string = MD_StringFromSymbol(ctx->symbols, symbol);
+    }
+}
+
+// With an event callback, the parser builds no tree. Each node and tag is
+// made in storage that its frame owns, reported to the callback, and reused
+// for the next one, and errors are reported rather than pushed.
+
+static MD_Node *
+MD_ParseMakeNode(MD_ParseCtx *ctx, MD_Node *storage, MD_NodeKind kind, MD_String8 string,
+                 MD_String8 raw_string, MD_u64 offset)
+{
+    MD_Node *result = 0;
+    if(ctx->event_func != 0)
+    {
+        result = storage;
+        MD_MemoryZeroStruct(result);
+        result->kind = kind;
+        result->string = string;
+        result->raw_string = raw_string;
+        result->next = result->prev = result->parent =
+            result->first_child = result->last_child =
+            result->first_tag = result->last_tag = result->ref_target = MD_NilNode();
+        result->offset = offset;
+    }
+    else
+    {
+        result = MD_MakeNode(ctx->arena, kind, string, raw_string, offset);
+    }
+    if(ctx->flags & MD_ParseFlag_SkipLocations)
+    {
+        result->offset = 0;
+        MD_MemoryZeroStruct(&result->raw_string);
+    }
+    return result;
+}
+
+static void
+MD_ParseEmitEvent(MD_ParseCtx *ctx, MD_ParseEventKind kind, MD_Node *node)
+{
+    if(ctx->event_func != 0)
+    {
+        MD_ParseEvent event = MD_ZERO_STRUCT;
+        event.kind = kind;
+        event.node = node;
+        event.offset = node->offset;
+        ctx->event_func(ctx->event_user_data, &event);
+    }
+}
+
+// Errors at a token have no node; the tree parser gives them an error marker.
+static void
+MD_ParsePushError(MD_ParseCtx *ctx, MD_MessageList *errors, MD_Node *node, MD_u64 offset,
+                  MD_MessageKind kind, MD_String8 string)
+{
+    if(ctx->event_func != 0)
+    {
+        MD_ParseEvent event = MD_ZERO_STRUCT;
+        event.kind = MD_ParseEventKind_Error;
+        event.node = node;
+        event.offset = offset;
+        event.message_kind = kind;
+        event.message = string;
+        ctx->event_func(ctx->event_user_data, &event);
+        if(kind > errors->max_message_kind)
+        {
+            errors->max_message_kind = kind;
+        }
+    }
+    else
+    {
+        if(MD_NodeIsNil(node))
+        {
+            node = MD_MakeErrorMarkerNode(ctx->arena, ctx->string, offset);
+        }
+        MD_MessageListPush(errors, MD_MakeNodeError(ctx->arena, node, kind, string));
+    }
+}
+
+static void
+MD_ParsePushTokenError(MD_ParseCtx *ctx, MD_MessageList *errors, MD_Token token, MD_MessageKind kind,
+                       MD_String8 string)
+{
+    MD_ParsePushError(ctx, errors, MD_NilNode(), token.raw_string.str - ctx->string.str, kind, string);
+}
+
+// Skips the whitespace, newlines and comments before a node, and returns the
+// comment that belongs to it, if any.
+static MD_String8
+MD_ParsePrevCommentFromCtx(MD_ParseCtx *ctx)
+{
+    MD_TokenArray *tokens = &ctx->tokens;
+    MD_u64 off = ctx->at;
+    MD_String8 prev_comment = MD_ZERO_STRUCT;
+    MD_Token comment_token = MD_ZERO_STRUCT;
+    for(;off < tokens->count;)
+    {
+        MD_TokenKind kind = tokens->kinds[off];
+        if(kind == MD_TokenKind_Comment)
+        {
+            comment_token = MD_TokenFromTokenArray(tokens, off);
+            off += 1;
+        }
+        else if(kind == MD_TokenKind_Newline)
+        {
+            off += 1;
+            MD_Token next_token = MD_TokenFromTokenArray(tokens, off);
+            if(next_token.kind == MD_TokenKind_Comment)
+            {
+                // NOTE(mal): If more than one comment, use the last comment
+                comment_token = next_token;
+            }
+            else if(next_token.kind == MD_TokenKind_Newline)
+            {
+                MD_MemoryZeroStruct(&comment_token);
+            }
+        }
+        else if((kind & MD_TokenGroup_Whitespace) != 0)
+        {
+            off += 1;
+        }
+        else
+        {
+            break;
+        }
+        prev_comment = comment_token.string;
+    }
+    ctx->at = off;
+    return prev_comment;
+}
+
+// Skips to the next regular token and consumes it if it is a ',' or ';'.
+static MD_NodeFlags
+MD_ParseTrailingSeparatorFromCtx(MD_ParseCtx *ctx)
+{
+    MD_NodeFlags result = 0;
+    MD_u64 off = MD_TokenIndexAdvanceFromSkips(&ctx->tokens, ctx->at, MD_TokenGroup_Irregular);
+    MD_Token trailing_separator = MD_TokenFromTokenArray(&ctx->tokens, off);
+    if (trailing_separator.kind == MD_TokenKind_Reserved)
+    {
+        MD_u8 c = trailing_separator.string.str[0];
+        if(c == ',')
+        {
+            result |= MD_NodeFlag_IsBeforeComma;
+            off += 1;
+        }
+        else if(c == ';')
+        {
+            result |= MD_NodeFlag_IsBeforeSemicolon;
+            off += 1;
+        }
+    }
+    ctx->at = off;
+    return result;
+}
+
+static MD_u64
+MD_ParseCtxByteAdvance(MD_ParseCtx *ctx, MD_u64 first_idx)
+{
+    return ctx->tokens.offsets[ctx->at] - ctx->tokens.offsets[first_idx];
+}
+
+//- Token windows
+//
+// A parse that builds no tree has no use for the tokens behind it, so event
+// parses only keep a window of tokens, lexed off `string` from where the
+// parser is. No step of the parser reads more than three regular tokens past
+// where it starts, so the window is refilled before a step that starts with
+// fewer than MD_PARSE_WINDOW_LOOKAHEAD regular tokens left in it, unless it
+// runs to the end of `string`. Tokens are lexed against the whole string, so
+// the last one in a window is never cut short. A window that can not hold
+// that many regular tokens (a long run of comments, say) grows until it can,
+// so memory stays bounded by the window rather than by the string.
+
+#define MD_PARSE_WINDOW_LOOKAHEAD 4
+
+#if !defined(MD_PARSE_WINDOW_MIN_SPAN)
+# define MD_PARSE_WINDOW_MIN_SPAN (16 << 10)
+#endif
+
+// Lexes a new window from byte `first` of `string`, and returns the index of
+// the token at `first` in it, which is 0.
+static MD_u64
+MD_ParseCtxFillWindow(MD_ParseCtx *ctx, MD_u64 first)
+{
+    MD_String8 string = ctx->string;
+    for(;;)
+    {
+        MD_ArenaClear(ctx->window_arena);
+        MD_u64 opl = MD_Min(string.size, first + ctx->window_span);
+        ctx->tokens = MD_TokenArrayFromRange(ctx->window_arena, string, first, opl);
+        MD_TokenArray *tokens = &ctx->tokens;
+        if(tokens->offsets[tokens->count] >= string.size)
+        {
+            ctx->window_refill_at = tokens->count;
+            break;
+        }
+        MD_u64 regular_count = 0;
+        MD_u64 idx = tokens->count;
+        for(;idx > 0 && regular_count < MD_PARSE_WINDOW_LOOKAHEAD;)
+        {
+            idx -= 1;
+            if((tokens->kinds[idx] & MD_TokenGroup_Irregular) == 0)
+            {
+                regular_count += 1;
+            }
+        }
+        if(regular_count == MD_PARSE_WINDOW_LOOKAHEAD)
+        {
+            ctx->window_refill_at = idx;
+            break;
+        }
+        ctx->window_span *= 2;
+    }
+    return 0;
+}
+
+// The parser is driven by an explicit stack of frames rather than by
+// recursion, so nesting depth is limited by memory instead of by the thread's
+// stack. A node frame parses one node (comments, tags, label), and a set frame
+// parses the children of a set; each pushes the other where the grammar
+// nests, and picks up at its `step` once that frame has been popped.
+
+typedef enum MD_ParseStep
+{
+    MD_ParseStep_NodeBegin,
+    MD_ParseStep_NodeTags,
+    MD_ParseStep_NodeTagArgsDone,
+    MD_ParseStep_NodeBody,
+    MD_ParseStep_NodeEnd,
+    MD_ParseStep_SetBegin,
+    MD_ParseStep_SetChildren,
+    MD_ParseStep_SetChildDone,
+    MD_ParseStep_SetEnd,
+}
+MD_ParseStep;
+
+typedef struct MD_ParseFrame MD_ParseFrame;
+struct MD_ParseFrame
+{
+    MD_ParseFrame *next;
+    MD_ParseStep step;
+    
+    // Node frames.
+    MD_String8 prev_comment;
+    MD_Node *first_tag;
+    MD_Node *last_tag;
+    MD_u32 tag_count;
+    MD_Node *tag;
+    MD_Node *parsed_node;
+    MD_b32 rejected;
+    MD_ArenaTemp node_temp;
+    MD_u64 node_error_count;
+    // Where the node and its tags are made, when the parser reports events.
+    MD_Node node_storage;
+    MD_Node tag_storage;
+    
+    // Set frames.
+    MD_Node *parent;
+    MD_ParseSetRule rule;
+    // Whether this set's body, and the bodies of sets nested in it, may be skipped.
+    MD_b32 lazy;
+    MD_b32 lazy_nested;
+    MD_Token initial_token;
+    MD_u8 set_opener;
+    MD_b32 close_with_brace;
+    MD_b32 close_with_paren;
+    MD_b32 close_with_separator;
+    MD_b32 parse_all;
+    MD_b32 got_closer;
+    MD_u64 parsed_child_count;
+    MD_NodeFlags next_child_flags;
+};
+
+typedef struct MD_ParseStack MD_ParseStack;
+struct MD_ParseStack
+{
+    MD_Arena *arena;
+    MD_ParseFrame *top;
+    MD_ParseFrame *free;
+};
+
+static MD_ParseFrame *
+MD_ParseStackPush(MD_ParseStack *stack, MD_ParseStep step)
+{
+    MD_ParseFrame *frame = stack->free;
+    if(frame != 0)
+    {
+        stack->free = frame->next;
+    }
+    else
+    {
+        frame = MD_PushArray(stack->arena, MD_ParseFrame, 1);
+    }
+    frame->step = step;
+    MD_StackPush(stack->top, frame);
+    return frame;
+}
+
+static void
+MD_ParseStackPop(MD_ParseStack *stack)
+{
+    MD_ParseFrame *frame = stack->top;
+    stack->top = frame->next;
+    MD_StackPush(stack->free, frame);
+}
+
+// With MD_ParseFlag_LazySets, the body of a delimited set that follows a node's label
+// (or that is a node by itself) is not parsed. Its tokens are skipped up to the
+// matching closer, and the set gets a single MD_NodeKind_Unparsed child that
+// spans the body, from which MD_ParseLazyChildren parses it later.
+//
+// MD_ReparseWholeString uses the same placeholder to defer moving kept
+// children onto the new string. There the placeholder holds the real children
+// in its own child links, with the shift that their strings and offsets still
+// need, and the children are moved when they are first read.
+
+// Nesting depth up to which lazy set bodies are skipped; deeper bodies are
+// parsed as usual.
+#if !defined(MD_PARSE_LAZY_SET_MAX_DEPTH)
+# define MD_PARSE_LAZY_SET_MAX_DEPTH 4096
+#endif
+
+typedef struct MD_ParseLazySet MD_ParseLazySet;
+struct MD_ParseLazySet
+{
+    // NOTE: must be first, so that the Unparsed node can be cast back.
+    MD_Node node;
+    MD_ParseLazyState *state;
+    // NOTE: only for moved children, in `node.first_child`: added to the
+    // addresses of their non-empty strings, and to their offsets.
+    MD_u64 string_shift;
+    MD_i64 offset_shift;
+    MD_String8 contents;
+};
+
+static MD_String8
+MD_LazyShiftString(MD_String8 string, MD_u64 shift)
+{
+    if(string.size != 0)
+    {
+        string.str = (MD_u8 *)(void *)((MD_u64)(void *)string.str + shift);
+    }
+    return string;
+}
+
+static void
+MD_LazyShiftNodeFields(MD_Node *node, MD_u64 string_shift, MD_i64 offset_shift, MD_String8 contents)
+{
+    node->string = MD_LazyShiftString(node->string, string_shift);
+    node->raw_string = MD_LazyShiftString(node->raw_string, string_shift);
+    node->prev_comment = MD_LazyShiftString(node->prev_comment, string_shift);
+    node->next_comment = MD_LazyShiftString(node->next_comment, string_shift);
+    node->offset = (MD_u64)((MD_i64)node->offset + offset_shift);
+    if(node->kind == MD_NodeKind_ErrorMarker)
+    {
+        node->raw_string = contents;
+    }
+}
+
+// Moves a node and its tags by a shift, and defers its children: they go
+// under a placeholder that carries the shift, or that adds it to the shift
+// it already carries.
+static void
+MD_LazyMoveNode(MD_ParseLazyState *state, MD_Node *node, MD_u64 string_shift, MD_i64 offset_shift,
+                MD_String8 contents)
+{
+    MD_LazyShiftNodeFields(node, string_shift, offset_shift, contents);
+    
+    //- tags, with their arguments, are never deferred
+    for(MD_Node *tag_node = node->first_tag; !MD_NodeIsNil(tag_node);)
+    {
+        MD_LazyShiftNodeFields(tag_node, string_shift, offset_shift, contents);
+        MD_Node *next = 0;
+        if(!MD_NodeIsNil(tag_node->first_tag))
+        {
+            next = tag_node->first_tag;
+        }
+        else if(!MD_NodeIsNil(tag_node->first_child))
+        {
+            next = tag_node->first_child;
+        }
+        for(MD_Node *up = tag_node; next == 0 && up != node; up = up->parent)
+        {
+            if(!MD_NodeIsNil(up->next))
+            {
+                next = up->next;
+            }
+            else if(up->kind == MD_NodeKind_Tag && up->parent != node && !MD_NodeIsNil(up->parent->first_child))
+            {
+                next = up->parent->first_child;
+            }
+        }
+        tag_node = (next != 0 ? next : MD_NilNode());
+    }
+    
+    //- children
+    MD_Node *first = node->first_child;
+    if(first->kind == MD_NodeKind_Unparsed)
+    {
+        MD_ParseLazySet *lazy = (MD_ParseLazySet *)first;
+        lazy->string_shift += string_shift;
+        lazy->offset_shift += offset_shift;
+        lazy->contents = contents;
+    }
+    else if(!MD_NodeIsNil(first))
+    {
+        MD_ParseLazySet *lazy = MD_PushArrayZero(state->arena, MD_ParseLazySet, 1);
+        MD_Node *moved = &lazy->node;
+        moved->kind = MD_NodeKind_Unparsed;
+        moved->next = moved->prev = moved->first_tag = moved->last_tag = moved->ref_target = MD_NilNode();
+        moved->parent = node;
+        moved->offset = node->offset;
+        moved->first_child = node->first_child;
+        moved->last_child = node->last_child;
+        lazy->state = state;
+        lazy->string_shift = string_shift;
+        lazy->offset_shift = offset_shift;
+        lazy->contents = contents;
+        node->first_child = node->last_child = moved;
+    }
+}
+
+// Finds the token that closes the set opened by `opener`, where `first` is the
+// index just past the opener. The parser closes '(' and '[' sets with either
+// ')' or ']', and '{' sets only with '}', and it takes a closer that follows a
+// node's tags or a bad token as a stray one. Only when every closer in the
+// body matches the innermost open set that way, and none is stray, does
+// parsing the body stop exactly at the matching closer. Returns the index of that closer, or of
+// the token where the scan gave up (the token count at the end), with
+// `*matched` set to whether the closer was found.
+static MD_u64
+MD_ParseLazySetCloser(MD_TokenArray *tokens, MD_u64 first, MD_u8 opener, MD_b32 *matched)
+{
+    MD_u64 is_brace[MD_PARSE_LAZY_SET_MAX_DEPTH/64] = {0};
+    MD_u64 is_tag_args[MD_PARSE_LAZY_SET_MAX_DEPTH/64] = {0};
+    MD_u64 depth = 0;
+    MD_b32 stray_closer = 0;
+    is_brace[0] = (opener == '{');
+    *matched = 0;
+    MD_u64 idx = first;
+    for(;idx < tokens->count; idx += 1)
+    {
+        MD_TokenKind kind = tokens->kinds[idx];
+        if(kind == MD_TokenKind_Reserved)
+        {
+            MD_u8 c = tokens->string.str[tokens->offsets[idx]];
+            if(c == '@')
+            {
+                stray_closer = 1;
+                if(idx + 1 < tokens->count && (tokens->kinds[idx + 1] & MD_TokenGroup_Label) != 0)
+                {
+                    idx += 1;
+                    if(idx + 1 < tokens->count && tokens->kinds[idx + 1] == MD_TokenKind_Reserved &&
+                       tokens->string.str[tokens->offsets[idx + 1]] == '(')
+                    {
+                        idx += 1;
+                        depth += 1;
+                        if(depth == MD_PARSE_LAZY_SET_MAX_DEPTH)
+                        {
+                            break;
+                        }
+                        MD_u64 bit = 1ull << (depth % 64);
+                        is_brace[depth/64] &= ~bit;
+                        is_tag_args[depth/64] |= bit;
+                        stray_closer = 0;
+                    }
+                }
+            }
+            else if(c == '{' || c == '(' || c == '[')
+            {
+                depth += 1;
+                if(depth == MD_PARSE_LAZY_SET_MAX_DEPTH)
+                {
+                    break;
+                }
+                MD_u64 bit = 1ull << (depth % 64);
+                is_brace[depth/64] = (c == '{' ? is_brace[depth/64] | bit : is_brace[depth/64] & ~bit);
+                is_tag_args[depth/64] &= ~bit;
+                stray_closer = 0;
+            }
+            else if(c == '}' || c == ')' || c == ']')
+            {
+                MD_b32 top_is_brace = (is_brace[depth/64] >> (depth % 64)) & 1;
+                if(stray_closer || top_is_brace != (c == '}'))
+                {
+                    break;
+                }
+                if(depth == 0)
+                {
+                    *matched = 1;
+                    break;
+                }
+                stray_closer = (is_tag_args[depth/64] >> (depth % 64)) & 1;
+                depth -= 1;
+            }
+            else
+            {
+                stray_closer = 0;
+            }
+        }
+        else if(kind & MD_TokenGroup_Error)
+        {
+            stray_closer = 1;
+        }
+        else if((kind & MD_TokenGroup_Irregular) == 0)
+        {
+            stray_closer = 0;
+        }
+    }
+    return idx;
+}
+
+// Skips the delimited set that starts at the next regular token after `*off`
+// with MD_ParseLazySetCloser, when parsing it would stop at the matching
+// closer. Returns whether it was skipped, with `*off` moved past the closer.
+static MD_b32
+MD_ParseSkipSetFromCtx(MD_ParseCtx *ctx, MD_u64 *off)
+{
+    MD_b32 result = 0;
+    MD_TokenArray *tokens = &ctx->tokens;
+    MD_u64 opener_off = MD_TokenIndexAdvanceFromSkips(tokens, *off, MD_TokenGroup_Irregular);
+    if(opener_off < tokens->count && tokens->kinds[opener_off] == MD_TokenKind_Reserved &&
+       opener_off + 1 > ctx->lazy_fail_at)
+    {
+        MD_u8 c = tokens->string.str[tokens->offsets[opener_off]];
+        if(c == '{' || c == '(' || c == '[')
+        {
+            MD_b32 matched = 0;
+            MD_u64 closer_off = MD_ParseLazySetCloser(tokens, opener_off + 1, c, &matched);
+            if(matched)
+            {
+                *off = closer_off + 1;
+                result = 1;
+            }
+            else
+            {
+                ctx->lazy_fail_at = closer_off;
+            }
+        }
+    }
+    return result;
+}
+
+// Top-level nodes that the filter rejects are left out of the tree. When
+// possible, the set of a rejected node is skipped with
+// MD_ParseSkipSetFromCtx instead of being parsed.
+static MD_b32
+MD_ParseRejectNode(MD_ParseCtx *ctx, MD_ParseFrame *frame, MD_Node *node)
+{
+    MD_b32 result = 0;
+    if(ctx->filter_func != 0 && frame->next != 0 && frame->next->parse_all)
+    {
+        node->first_tag = frame->first_tag;
+        node->last_tag = frame->last_tag;
+        node->tag_count = frame->tag_count;
+        result = !ctx->filter_func(ctx->filter_user_data, node);
+    }
+    return result;
+}
+
+static MD_ParseResult
+MD_ParseFromCtx(MD_ParseCtx *ctx, MD_ParseStep first_step, MD_Node *parent, MD_ParseSetRule rule)
+{
+    MD_ParseResult result = MD_ParseResultZero();
+    MD_Arena *arena = ctx->arena;
+    MD_String8 string = ctx->string;
+    MD_TokenArray *tokens = &ctx->tokens;
+    MD_u64 off = ctx->at;
+    MD_u64 first_offset = tokens->offsets[off];
+    MD_ArenaTemp scratch = MD_GetScratch(&arena, 1);
+    
+    MD_ParseStack stack = MD_ZERO_STRUCT;
+    stack.arena = scratch.arena;
+    MD_ParseFrame *first_frame = MD_ParseStackPush(&stack, first_step);
+    first_frame->parent = parent;
+    first_frame->rule = rule;
+    first_frame->lazy = 0;
+    first_frame->lazy_nested = !!(ctx->flags & MD_ParseFlag_LazySets);
+    
+    // NOTE: the node returned by the most recently popped frame.
+    MD_Node *returned = MD_NilNode();
+    
+    for(;stack.top != 0;)
+    {
+        if(ctx->window_arena != 0 && off > ctx->window_refill_at)
+        {
+            off = MD_ParseCtxFillWindow(ctx, tokens->offsets[off]);
+        }
+        
+        MD_ParseFrame *frame = stack.top;
+        switch(frame->step)
+        {
+            //- rjf: parse pre-comment
+            case MD_ParseStep_NodeBegin:
+            {
+                if(ctx->flags & MD_ParseFlag_SkipComments)
+                {
+                    off = MD_TokenIndexAdvanceFromSkips(tokens, off, MD_TokenGroup_Irregular);
+                    MD_MemoryZeroStruct(&frame->prev_comment);
+                }
+                else
+                {
+                    ctx->at = off;
+                    frame->prev_comment = MD_ParsePrevCommentFromCtx(ctx);
+                    off = ctx->at;
+                }
+                frame->first_tag = frame->last_tag = MD_NilNode();
+                frame->tag_count = 0;
+                frame->tag = MD_NilNode();
+                frame->parsed_node = MD_NilNode();
+                frame->rejected = 0;
+                frame->node_temp = MD_ArenaBeginTemp(arena);
+                frame->node_error_count = result.errors.node_count;
+                frame->step = MD_ParseStep_NodeTags;
+            }break;
+            
+            //- rjf: parse tag list, one tag at a time
+            case MD_ParseStep_NodeTags:
+            {
+                frame->step = MD_ParseStep_NodeBody;
+                if(off >= tokens->count)
+                {
+                    break;
+                }
+                
+                //- rjf: parse @ symbol, signifying start of tag
+                off = MD_TokenIndexAdvanceFromSkips(tokens, off, MD_TokenGroup_Irregular);
+                MD_Token next_token = MD_TokenFromTokenArray(tokens, off);
+                if(next_token.kind != MD_TokenKind_Reserved ||
+                   next_token.string.str[0] != '@')
+                {
+                    break;
+                }
+                off += 1;
+                
+                //- rjf: parse string of tag node
+                MD_Token name = MD_TokenFromTokenArray(tokens, off);
+                MD_u64 name_off = name.raw_string.str - string.str;
+                if((name.kind & MD_TokenGroup_Label) == 0)
+                {
+                    // NOTE(rjf): @error Improper token for tag string
+                    MD_String8 error_str = MD_S8Fmt(arena, "\"%.*s\" is not a proper tag label",
+                                                    MD_S8VArg(name.raw_string));
+                    MD_ParsePushTokenError(ctx, &result.errors, name, MD_MessageKind_Error, error_str);
+                    break;
+                }
+                off += 1;
+                
+                //- rjf: build tag
+                MD_Node *tag = MD_ParseMakeNode(ctx, &frame->tag_storage, MD_NodeKind_Tag, name.string,
+                                                name.raw_string, name_off);
+                MD_ParseInternNode(ctx, tag);
+                MD_ParseEmitEvent(ctx, MD_ParseEventKind_Tag, tag);
+                frame->tag = tag;
+                frame->step = MD_ParseStep_NodeTagArgsDone;
+                
+                //- rjf: parse tag arguments
+                MD_Token open_paren = MD_TokenFromTokenArray(tokens, off);
+                if(open_paren.kind == MD_TokenKind_Reserved &&
+                   open_paren.string.str[0] == '(')
+                {
+                    MD_ParseFrame *args_frame = MD_ParseStackPush(&stack, MD_ParseStep_SetBegin);
+                    args_frame->parent = tag;
+                    args_frame->rule = MD_ParseSetRule_EndOnDelimiter;
+                    args_frame->lazy = 0;
+                    args_frame->lazy_nested = 0;
+                }
+            }break;
+            
+            //- rjf: push tag to result
+            case MD_ParseStep_NodeTagArgsDone:
+            {
+                if(ctx->event_func == 0)
+                {
+                    MD_NodeDblPushBack(frame->first_tag, frame->last_tag, frame->tag);
+                    frame->tag_count += 1;
+                }
+                frame->step = MD_ParseStep_NodeTags;
+            }break;
+            
+            //- rjf: parse node
+            case MD_ParseStep_NodeBody:
+            {
+                frame->step = MD_ParseStep_NodeEnd;
+                
+                // NOTE: tags are dropped along with their arguments when no node
+                // follows them, so nothing in tag arguments is skipped, to keep
+                // the errors from them.
+                MD_b32 lazy_nested = (frame->next != 0 ? frame->next->lazy_nested :
+                                      !!(ctx->flags & MD_ParseFlag_LazySets));
+                
+                //- rjf: try to parse an unnamed set
+                off = MD_TokenIndexAdvanceFromSkips(tokens, off, MD_TokenGroup_Irregular);
+                MD_Token unnamed_set_opener = MD_TokenFromTokenArray(tokens, off);
+                if(unnamed_set_opener.kind == MD_TokenKind_Reserved)
+                {
+                    MD_u8 c = unnamed_set_opener.string.str[0];
+                    if (c == '(' || c == '{' || c == '[')
+                    {
+                        frame->parsed_node = MD_ParseMakeNode(ctx, &frame->node_storage, MD_NodeKind_Main,
+                                                              MD_S8Lit(""), MD_S8Lit(""),
+                                                              unnamed_set_opener.raw_string.str - string.str);
+                        frame->parsed_node->prev_comment = frame->prev_comment;
+                        MD_ParseEmitEvent(ctx, MD_ParseEventKind_BeginNode, frame->parsed_node);
+                        frame->rejected = MD_ParseRejectNode(ctx, frame, frame->parsed_node);
+                        if(!frame->rejected || !MD_ParseSkipSetFromCtx(ctx, &off))
+                        {
+                            MD_ParseFrame *children_frame = MD_ParseStackPush(&stack, MD_ParseStep_SetBegin);
+                            children_frame->parent = frame->parsed_node;
+                            children_frame->rule = MD_ParseSetRule_EndOnDelimiter;
+                            children_frame->lazy = children_frame->lazy_nested = lazy_nested;
+                        }
+                    }
+                    else if (c == ')' || c == '}' || c == ']')
+                    {
+                        // NOTE(rjf): @error Unexpected set closing symbol
+                        MD_String8 error_str = MD_S8Fmt(arena, "Unbalanced \"%c\"", c);
+                        MD_ParsePushTokenError(ctx, &result.errors, unnamed_set_opener,
+                                               MD_MessageKind_FatalError, error_str);
+                        off += 1;
+                    }
+                    else
+                    {
+                        // NOTE(rjf): @error Unexpected reserved symbol
+                        MD_String8 error_str = MD_S8Fmt(arena, "Unexpected reserved symbol \"%c\"", c);
+                        MD_ParsePushTokenError(ctx, &result.errors, unnamed_set_opener,
+                                               MD_MessageKind_Error, error_str);
+                        off += 1;
+                    }
+                    break;
+                }
+                
+                //- rjf: try to parse regular node, with/without children
+                MD_Token label_name = unnamed_set_opener;
+                if((label_name.kind & MD_TokenGroup_Label) != 0)
+                {
+                    off += 1;
+                    MD_Node *parsed_node = MD_ParseMakeNode(ctx, &frame->node_storage, MD_NodeKind_Main,
+                                                            label_name.string, label_name.raw_string,
+                                                            label_name.raw_string.str - string.str);
+                    parsed_node->flags |= label_name.node_flags;
+                    parsed_node->prev_comment = frame->prev_comment;
+                    MD_ParseInternNode(ctx, parsed_node);
+                    MD_ParseEmitEvent(ctx, MD_ParseEventKind_BeginNode, parsed_node);
+                    frame->parsed_node = parsed_node;
+                    frame->rejected = MD_ParseRejectNode(ctx, frame, parsed_node);
+                    
+                    //- rjf: try to parse children for this node
+                    MD_u64 colon_check_off = MD_TokenIndexAdvanceFromSkips(tokens, off, MD_TokenGroup_Irregular);
+                    MD_Token colon = MD_TokenFromTokenArray(tokens, colon_check_off);
+                    if(colon.kind == MD_TokenKind_Reserved &&
+                       colon.string.str[0] == ':')
+                    {
+                        colon_check_off += 1;
+                        off = colon_check_off;
+                        if(frame->rejected && MD_ParseSkipSetFromCtx(ctx, &off))
+                        {
+                            break;
+                        }
+                        
+                        MD_ParseFrame *children_frame = MD_ParseStackPush(&stack, MD_ParseStep_SetBegin);
+                        children_frame->parent = parsed_node;
+                        children_frame->rule = MD_ParseSetRule_EndOnDelimiter;
+                        children_frame->lazy = children_frame->lazy_nested = lazy_nested;
+                    }
+                    break;
+                }
+                
+                //- rjf: collect bad token
+                MD_Token bad_token = unnamed_set_opener;
+                if(bad_token.kind & MD_TokenGroup_Error)
+                {
+                    off += 1;
+                    
+                    switch (bad_token.kind)
+                    {
+                        case MD_TokenKind_BadCharacter:
+                        {
+                            MD_String8List bytes = {0};
+                            for(int i_byte = 0; i_byte < bad_token.raw_string.size; ++i_byte)
+                            {
+                                MD_u8 b = bad_token.raw_string.str[i_byte];
+                                MD_S8ListPush(arena, &bytes, MD_CStyleHexStringFromU64(arena, b, 1));
+                            }
+                            
+                            MD_StringJoin join = MD_ZERO_STRUCT;
+                            join.mid = MD_S8Lit(" ");
+                            MD_String8 byte_string = MD_S8ListJoin(arena, bytes, &join);
+                            
+                            // NOTE(rjf): @error Bad character
+                            MD_String8 error_str = MD_S8Fmt(arena, "Non-ASCII character \"%.*s\"",
+                                                            MD_S8VArg(byte_string));
+                            MD_ParsePushTokenError(ctx, &result.errors, bad_token, MD_MessageKind_Error,
+                                                   error_str);
+                        }break;
+                        
+                        case MD_TokenKind_BrokenComment:
+                        {
+                            // NOTE(rjf): @error Broken Comments
+                            MD_ParsePushTokenError(ctx, &result.errors, bad_token, MD_MessageKind_Error,
+                                                   MD_S8Lit("Unterminated comment"));
+                        }break;
+                        
+                        case MD_TokenKind_BrokenStringLiteral:
+                        {
+                            // NOTE(rjf): @error Broken String Literals
+                            MD_ParsePushTokenError(ctx, &result.errors, bad_token, MD_MessageKind_Error,
+                                                   MD_S8Lit("Unterminated string literal"));
+                        }break;
+                    }
+                    
+                    // NOTE: retry
+                    frame->step = MD_ParseStep_NodeBody;
+                }
+            }break;
+            
+            case MD_ParseStep_NodeEnd:
+            {
+                //- rjf: parse comments after nodes.
+                MD_String8 next_comment = MD_ZERO_STRUCT;
+                if(ctx->flags & MD_ParseFlag_SkipComments)
+                {
+                    // NOTE: implicitly-delimited sets end on the newline after a
+                    // node, so the same tokens are stepped over either way.
+                    off = MD_TokenIndexAdvanceFromSkips(tokens, off, MD_TokenKind_Whitespace);
+                    if(off < tokens->count && tokens->kinds[off] == MD_TokenKind_Comment)
+                    {
+                        off += 1;
+                    }
+                }
+                else
+                {
+                    MD_Token comment_token = MD_ZERO_STRUCT;
+                    for(;off < tokens->count;)
+                    {
+                        MD_TokenKind kind = tokens->kinds[off];
+                        if(kind == MD_TokenKind_Comment)
+                        {
+                            comment_token = MD_TokenFromTokenArray(tokens, off);
+                            off += 1;
+                            break;
+                        }
+                        
+                        else if(kind == MD_TokenKind_Newline)
+                        {
+                            break;
+                        }
+                        else if((kind & MD_TokenGroup_Whitespace) != 0)
+                        {
+                            off += 1;
+                        }
+                        else
+                        {
+                            break;
+                        }
+                    }
+                    next_comment = comment_token.string;
+                }
+                
+                //- rjf: fill result
+                MD_Node *parsed_node = frame->parsed_node;
+                if(!MD_NodeIsNil(parsed_node))
+                {
+                    parsed_node->next_comment = next_comment;
+                    parsed_node->first_tag = frame->first_tag;
+                    parsed_node->last_tag = frame->last_tag;
+                    parsed_node->tag_count = frame->tag_count;
+                    for(MD_Node *tag = frame->first_tag; !MD_NodeIsNil(tag); tag = tag->next)
+                    {
+                        tag->parent = parsed_node;
+                    }
+                    
+                    // NOTE: a node in a set gets its separator flags from the set,
+                    // which reports its end once they are known.
+                    if(frame->next == 0)
+                    {
+                        MD_ParseEmitEvent(ctx, MD_ParseEventKind_EndNode, parsed_node);
+                    }
+                }
+                
+                //- report tags that no node follows, which are dropped
+                else if(!MD_NodeIsNil(frame->tag))
+                {
+                    MD_ParseEmitEvent(ctx, MD_ParseEventKind_EndNode, parsed_node);
+                }
+                returned = parsed_node;
+                
+                //- free a rejected node, unless messages or symbols were pushed after it
+                if(frame->rejected)
+                {
+                    if(result.errors.node_count == frame->node_error_count && ctx->symbols == 0)
+                    {
+                        MD_ArenaEndTemp(frame->node_temp);
+                    }
+                    returned = MD_NilNode();
+                }
+                MD_ParseStackPop(&stack);
+            }break;
+            
+            //- rjf: fill data from set opener
+            case MD_ParseStep_SetBegin:
+            {
+                frame->set_opener = 0;
+                frame->close_with_brace = 0;
+                frame->close_with_paren = 0;
+                frame->close_with_separator = 0;
+                frame->parse_all = 0;
+                frame->got_closer = 0;
+                frame->parsed_child_count = 0;
+                frame->next_child_flags = 0;
+                frame->initial_token = MD_TokenFromTokenArray(tokens, off);
+                MD_NodeFlags set_opener_flags = 0;
+                switch(frame->rule)
+                {
+                    default: break;
+                    
+                    case MD_ParseSetRule_EndOnDelimiter:
+                    {
+                        MD_u64 opener_check_off = MD_TokenIndexAdvanceFromSkips(tokens, off, MD_TokenGroup_Irregular);
+                        frame->initial_token = MD_TokenFromTokenArray(tokens, opener_check_off);
+                        if(frame->initial_token.kind == MD_TokenKind_Reserved)
+                        {
+                            MD_u8 c = frame->initial_token.raw_string.str[0];
+                            if(c == '{')
+                            {
+                                frame->set_opener = '{';
+                                set_opener_flags |= MD_NodeFlag_HasBraceLeft;
+                                opener_check_off += 1;
+                                off = opener_check_off;
+                                frame->close_with_brace = 1;
+                            }
+                            else if(c == '(')
+                            {
+                                frame->set_opener = '(';
+                                set_opener_flags |= MD_NodeFlag_HasParenLeft;
+                                opener_check_off += 1;
+                                off = opener_check_off;
+                                frame->close_with_paren = 1;
+                            }
+                            else if(c == '[')
+                            {
+                                frame->set_opener = '[';
+                                set_opener_flags |= MD_NodeFlag_HasBracketLeft;
+                                opener_check_off += 1;
+                                off = opener_check_off;
+                                frame->close_with_paren = 1;
+                            }
+                            else
+                            {
+                                frame->close_with_separator = 1;
+                            }
+                        }
+                        else
+                        {
+                            frame->close_with_separator = 1;
+                        }
+                    }break;
+                    
+                    case MD_ParseSetRule_Global:
+                    {
+                        frame->parse_all = 1;
+                    }break;
+                }
+                
+                //- rjf: fill parent data from opener
+                frame->parent->flags |= set_opener_flags;
+                if(!frame->parse_all)
+                {
+                    MD_ParseEmitEvent(ctx, MD_ParseEventKind_BeginChildren, frame->parent);
+                }
+                
+                if(frame->set_opener != 0 || frame->close_with_separator || frame->parse_all)
+                {
+                    frame->step = MD_ParseStep_SetChildren;
+                }
+                else
+                {
+                    frame->step = MD_ParseStep_SetEnd;
+                }
+                
+                //- skip the body of a lazy set up to its closer
+                // NOTE: once a scan gives up at some token, sets opened before
+                // that token are parsed as usual rather than scanned again.
+                if(frame->lazy && frame->set_opener != 0 && off > ctx->lazy_fail_at)
+                {
+                    MD_b32 matched = 0;
+                    MD_u64 closer_off = MD_ParseLazySetCloser(tokens, off, frame->set_opener, &matched);
+                    if(!matched)
+                    {
+                        ctx->lazy_fail_at = closer_off;
+                    }
+                    else
+                    {
+                        MD_u8 c = tokens->string.str[tokens->offsets[closer_off]];
+                        frame->parent->flags |= (c == '}' ? MD_NodeFlag_HasBraceRight :
+                                                 c == ']' ? MD_NodeFlag_HasBracketRight :
+                                                 MD_NodeFlag_HasParenRight);
+                        if(MD_TokenIndexAdvanceFromSkips(tokens, off, MD_TokenGroup_Irregular) < closer_off)
+                        {
+                            MD_Token opener = frame->initial_token;
+                            MD_Token closer = MD_TokenFromTokenArray(tokens, closer_off);
+                            MD_ParseLazySet *lazy = MD_PushArrayZero(arena, MD_ParseLazySet, 1);
+                            MD_Node *unparsed = &lazy->node;
+                            unparsed->kind = MD_NodeKind_Unparsed;
+                            unparsed->raw_string = MD_S8Range(opener.raw_string.str,
+                                                              closer.raw_string.str + closer.raw_string.size);
+                            unparsed->next = unparsed->prev = unparsed->parent =
+                                unparsed->first_child = unparsed->last_child =
+                                unparsed->first_tag = unparsed->last_tag = unparsed->ref_target = MD_NilNode();
+                            unparsed->offset = opener.raw_string.str - string.str;
+                            lazy->state = ctx->lazy_state;
+                            MD_PushChild(frame->parent, unparsed);
                         }
-                        
-                        // fail condition
-                        if (*at == '\n')
+                        off = closer_off + 1;
+                        frame->got_closer = 1;
+                        frame->step = MD_ParseStep_SetEnd;
+                    }
+                }
+            }break;
+            
+            //- rjf: parse children, one child at a time
+            case MD_ParseStep_SetChildren:
+            {
+                frame->step = MD_ParseStep_SetEnd;
+                if(off >= tokens->count)
+                {
+                    break;
+                }
+                
+                //- rjf: check for separator closers
+                if(frame->close_with_separator)
+                {
+                    MD_u64 closer_check_off = off;
+                    
+                    //- rjf: check newlines
+                    {
+                        if(tokens->kinds[closer_check_off] == MD_TokenKind_Newline)
                         {
-                            break;
+                            closer_check_off += 1;
+                            // TODO(rjf): As far as I can tell, we can't actually do this,
+                            // because higher-level unscoped sets may depend on this newline
+                            // so they can be terminated.
+                            // off = closer_check_off;
+                            
+                            // NOTE(rjf): always terminate with a newline if we have >0 children
+                            if(frame->parsed_child_count > 0)
+                            {
+                                // TODO(rjf): As far as I can tell, we can't actually do this,
+                                // because higher-level unscoped sets may depend on this newline
+                                // so they can be terminated.
+                                // off = closer_check_off;
+                                frame->got_closer = 1;
+                                break;
+                            }
+                            
+                            // NOTE(rjf): terminate after double newline if we have 0 children
+                            if(closer_check_off < tokens->count &&
+                               tokens->kinds[closer_check_off] == MD_TokenKind_Newline)
+                            {
+                                closer_check_off += 1;
+                                off = closer_check_off;
+                                frame->got_closer = 1;
+                                break;
+                            }
                         }
-                        
-                        // escaping rule
-                        if (at[0] == '\\')
+                    }
+                    
+                    //- rjf: check separators and possible braces from higher parents
+                    {
+                        closer_check_off = MD_TokenIndexAdvanceFromSkips(tokens, off, MD_TokenGroup_Irregular);
+                        MD_Token potential_closer = MD_TokenFromTokenArray(tokens, closer_check_off);
+                        if(potential_closer.kind == MD_TokenKind_Reserved)
                         {
-                            at += 1;
-                            if (at < one_past_last && (at[0] == d || at[0] == '\\'))
+                            MD_u8 c = potential_closer.raw_string.str[0];
+                            if(c == ',' || c == ';')
                             {
-                                at += 1;
+                                off = closer_check_off;
+                                closer_check_off += 1;
+                                break;
+                            }
+                            else if(c == '}' || c == ']'|| c == ')')
+                            {
+                                break;
                             }
                         }
-                        else
+                    }
+                    
+                }
+                
+                //- rjf: check for non-separator closers
+                if(!frame->close_with_separator && !frame->parse_all)
+                {
+                    MD_u64 closer_check_off = MD_TokenIndexAdvanceFromSkips(tokens, off, MD_TokenGroup_Irregular);
+                    MD_Token potential_closer = MD_TokenFromTokenArray(tokens, closer_check_off);
+                    if(potential_closer.kind == MD_TokenKind_Reserved)
+                    {
+                        MD_u8 c = potential_closer.raw_string.str[0];
+                        if(frame->close_with_brace && c == '}')
                         {
-                            at += 1;
+                            closer_check_off += 1;
+                            off = closer_check_off;
+                            frame->parent->flags |= MD_NodeFlag_HasBraceRight;
+                            frame->got_closer = 1;
+                            break;
+                        }
+                        else if(frame->close_with_paren && c == ']')
+                        {
+                            closer_check_off += 1;
+                            off = closer_check_off;
+                            frame->parent->flags |= MD_NodeFlag_HasBracketRight;
+                            frame->got_closer = 1;
+                            break;
+                        }
+                        else if(frame->close_with_paren && c == ')')
+                        {
+                            closer_check_off += 1;
+                            off = closer_check_off;
+                            frame->parent->flags |= MD_NodeFlag_HasParenRight;
+                            frame->got_closer = 1;
+                            break;
                         }
                     }
                 }
                 
-                //- rjf: set relevant node flags on token
-                token.node_flags |= MD_NodeFlag_StringLiteral;
-                switch(d)
+                //- rjf: parse next child
+                frame->step = MD_ParseStep_SetChildDone;
+                MD_ParseStackPush(&stack, MD_ParseStep_NodeBegin);
+            }break;
+            
+            case MD_ParseStep_SetChildDone:
+            {
+                MD_Node *child = returned;
+                
+                //- rjf: hook child into parent
+                if(!MD_NodeIsNil(child))
+                {
+                    // NOTE(rjf): @error No unnamed set children of implicitly-delimited sets
+                    if(frame->close_with_separator &&
+                       child->string.size == 0 &&
+                       child->flags & (MD_NodeFlag_HasParenLeft    |
+                                       MD_NodeFlag_HasParenRight   |
+                                       MD_NodeFlag_HasBracketLeft  |
+                                       MD_NodeFlag_HasBracketRight |
+                                       MD_NodeFlag_HasBraceLeft    |
+                                       MD_NodeFlag_HasBraceRight   ))
+                    {
+                        MD_String8 error_str = MD_S8Lit("Unnamed set children of implicitly-delimited sets are not legal.");
+                        MD_ParsePushError(ctx, &result.errors, child, child->offset, MD_MessageKind_Warning,
+                                          error_str);
+                    }
+                    
+                    if(ctx->event_func == 0)
+                    {
+                        MD_PushChild(frame->parent, child);
+                    }
+                    frame->parsed_child_count += 1;
+                }
+                
+                //- rjf: check trailing separator
+                MD_NodeFlags trailing_separator_flags = 0;
+                if(!frame->close_with_separator)
+                {
+                    ctx->at = off;
+                    trailing_separator_flags = MD_ParseTrailingSeparatorFromCtx(ctx);
+                    off = ctx->at;
+                }
+                
+                //- rjf: fill child flags
+                if(!MD_NodeIsNil(child))
+                {
+                    child->flags |= frame->next_child_flags | trailing_separator_flags;
+                    MD_ParseEmitEvent(ctx, MD_ParseEventKind_EndNode, child);
+                }
+                
+                //- rjf: setup next_child_flags
+                frame->next_child_flags = MD_NodeFlag_AfterFromBefore(trailing_separator_flags);
+                frame->step = MD_ParseStep_SetChildren;
+            }break;
+            
+            case MD_ParseStep_SetEnd:
+            {
+                //- rjf: push missing closer error, if we have one
+                if(frame->set_opener != 0 && frame->got_closer == 0)
+                {
+                    // NOTE(rjf): @error We didn't get a closer for the set
+                    MD_String8 error_str = MD_S8Fmt(arena, "Unbalanced \"%c\"", frame->set_opener);
+                    MD_ParsePushTokenError(ctx, &result.errors, frame->initial_token,
+                                           MD_MessageKind_FatalError, error_str);
+                }
+                
+                //- rjf: push empty implicit set error,
+                if(frame->close_with_separator && frame->parsed_child_count == 0)
+                {
+                    // NOTE(rjf): @error No empty implicitly-delimited sets
+                    MD_ParsePushTokenError(ctx, &result.errors, frame->initial_token, MD_MessageKind_Error,
+                                           MD_S8Lit("Empty implicitly-delimited node list"));
+                }
+                
+                if(!frame->parse_all)
+                {
+                    MD_ParseEmitEvent(ctx, MD_ParseEventKind_EndChildren, frame->parent);
+                }
+                returned = frame->parent;
+                MD_ParseStackPop(&stack);
+            }break;
+        }
+    }
+    
+    //- rjf: fill result info
+    MD_ReleaseScratch(scratch);
+    ctx->at = off;
+    result.node = returned;
+    result.string_advance = tokens->offsets[off] - first_offset;
+    return result;
+}
+
+static MD_ParseResult
+MD_ParseNodeSetFromCtx(MD_ParseCtx *ctx, MD_Node *parent, MD_ParseSetRule rule)
+{
+    return MD_ParseFromCtx(ctx, MD_ParseStep_SetBegin, parent, rule);
+}
+
+static MD_ParseResult
+MD_ParseOneNodeFromCtx(MD_ParseCtx *ctx)
+{
+    return MD_ParseFromCtx(ctx, MD_ParseStep_NodeBegin, MD_NilNode(), MD_ParseSetRule_Global);
+}
+
+// MD_ParseNodeSet and MD_ParseOneNode only need the tokens of what they parse,
+// so they tokenize a prefix of the rest of the string, and grow it until the
+// parse can no longer change: either the prefix is the whole rest, or the
+// next regular token after the parse is followed by another token, and so
+// cannot be cut short. Growing geometrically keeps the work proportional to
+// what is parsed, so calling them in a loop over a string stays linear. A set
+// under the global rule runs to the end of the string, so all of it is
+// tokenized at once.
+
+#define MD_PARSE_PREFIX_MIN_SPAN 64
+
+static MD_ParseResult
+MD_ParsePrefixFromString(MD_Arena *arena, MD_String8 string, MD_u64 offset, MD_ParseStep first_step,
+                         MD_Node *parent, MD_ParseSetRule rule)
+{
+    MD_ArenaTemp scratch = MD_GetScratch(&arena, 1);
+    MD_ArenaTemp attempt = MD_ArenaBeginTemp(arena);
+    MD_String8 rest = MD_S8Skip(string, offset);
+    MD_u64 span = rest.size;
+    if(first_step == MD_ParseStep_NodeBegin || rule != MD_ParseSetRule_Global)
+    {
+        span = MD_Min(rest.size, MD_PARSE_PREFIX_MIN_SPAN);
+    }
+    MD_Node parent_before = *parent;
+    MD_ParseResult result = MD_ParseResultZero();
+    for(;;)
+    {
+        MD_ArenaEndTemp(attempt);
+        MD_ArenaEndTemp(scratch);
+        if(!MD_NodeIsNil(parent))
+        {
+            *parent = parent_before;
+        }
+        MD_ParseCtx ctx = MD_ZERO_STRUCT;
+        ctx.arena = arena;
+        ctx.string = string;
+        ctx.tokens = MD_TokenizeString(scratch.arena, MD_S8Prefix(rest, span));
+        result = MD_ParseFromCtx(&ctx, first_step, parent, rule);
+        MD_u64 lookahead = MD_TokenIndexAdvanceFromSkips(&ctx.tokens, ctx.at, MD_TokenGroup_Irregular);
+        if(span == rest.size || lookahead + 1 < ctx.tokens.count)
+        {
+            break;
+        }
+        span = MD_Min(rest.size, span*2);
+    }
+    MD_ReleaseScratch(scratch);
+    return result;
+}
+
+MD_FUNCTION MD_ParseResult
+MD_ParseNodeSet(MD_Arena *arena, MD_String8 string, MD_u64 offset, MD_Node *parent,
+                MD_ParseSetRule rule)
+{
+    return MD_ParsePrefixFromString(arena, string, offset, MD_ParseStep_SetBegin, parent, rule);
+}
+
+MD_FUNCTION MD_ParseResult
+MD_ParseOneNode(MD_Arena *arena, MD_String8 string, MD_u64 offset)
+{
+    return MD_ParsePrefixFromString(arena, string, offset, MD_ParseStep_NodeBegin, MD_NilNode(),
+                                    MD_ParseSetRule_Global);
+}
+
+MD_FUNCTION MD_ParseResult
+MD_ParseWholeString(MD_Arena *arena, MD_String8 filename, MD_String8 contents)
+{
+    return MD_ParseWholeStringEx(arena, filename, contents, 0);
+}
+
+MD_FUNCTION MD_ParseResult
+MD_ParseWholeStringWithSymbols(MD_Arena *arena, MD_SymbolTable *symbols, MD_String8 filename,
+                               MD_String8 contents)
+{
+    MD_ParseOptions options = MD_ZERO_STRUCT;
+    options.symbols = symbols;
+    return MD_ParseWholeStringEx(arena, filename, contents, &options);
+}
+
+MD_FUNCTION MD_ParseResult
+MD_ParseWholeStringLazy(MD_Arena *arena, MD_String8 filename, MD_String8 contents)
+{
+    MD_ParseOptions options = MD_ZERO_STRUCT;
+    options.flags = MD_ParseFlag_LazySets;
+    return MD_ParseWholeStringEx(arena, filename, contents, &options);
+}
+
+MD_FUNCTION MD_ParseResult
+MD_ParseWholeStringEx(MD_Arena *arena, MD_String8 filename, MD_String8 contents,
+                      MD_ParseOptions *options)
+{
+    MD_ArenaTemp scratch = MD_GetScratch(&arena, 1);
+    MD_Node *root = MD_MakeNode(arena, MD_NodeKind_File, filename, contents, 0);
+    MD_ParseCtx ctx = MD_ZERO_STRUCT;
+    ctx.arena = arena;
+    ctx.string = contents;
+    if(options != 0)
+    {
+        ctx.symbols = options->symbols;
+        ctx.flags = options->flags;
+        ctx.event_func = options->event_func;
+        ctx.event_user_data = options->event_user_data;
+        ctx.filter_func = options->filter_func;
+        ctx.filter_user_data = options->filter_user_data;
+        if(ctx.event_func != 0)
+        {
+            ctx.flags &= ~MD_ParseFlag_LazySets;
+            ctx.filter_func = 0;
+        }
+    }
+    if(ctx.flags & MD_ParseFlag_LazySets)
+    {
+        MD_ParseLazyState *state = MD_PushArrayZero(arena, MD_ParseLazyState, 1);
+        state->arena = arena;
+        state->contents = contents;
+        state->symbols = ctx.symbols;
+        state->flags = ctx.flags;
+        ctx.lazy_state = state;
+    }
+    if(ctx.event_func != 0)
+    {
+        ctx.window_arena = MD_ArenaAlloc();
+        ctx.window_span = MD_PARSE_WINDOW_MIN_SPAN;
+        ctx.at = MD_ParseCtxFillWindow(&ctx, 0);
+    }
+    else
+    {
+        ctx.tokens = MD_TokenizeString(scratch.arena, contents);
+    }
+    MD_ParseResult result = MD_ParseNodeSetFromCtx(&ctx, root, MD_ParseSetRule_Global);
+    if(ctx.window_arena != 0)
+    {
+        MD_ArenaRelease(ctx.window_arena);
+    }
+    result.node = root;
+    result.lazy = ctx.lazy_state;
+    for(MD_Message *error = result.errors.first; error != 0; error = error->next)
+    {
+        if(MD_NodeIsNil(error->node->parent))
+        {
+            error->node->parent = root;
+        }
+    }
+    MD_ReleaseScratch(scratch);
+    return result;
+}
+
+MD_FUNCTION MD_b32
+MD_ParseFilterTags(void *user_data, MD_Node *node)
+{
+    MD_String8List *tags = (MD_String8List *)user_data;
+    MD_b32 result = 0;
+    for(MD_String8Node *tag = tags->first; tag != 0 && !result; tag = tag->next)
+    {
+        result = MD_NodeHasTag(node, tag->string, 0);
+    }
+    return result;
+}
+
+// Parses the body of a skipped set, once. With `keep_errors` the messages go
+// on the parse's shared state, for the helpers that have nowhere to return
+// them; otherwise they are returned.
+static MD_ParseResult
+MD_ParseLazyChildrenFromNode(MD_Node *node, MD_b32 keep_errors)
+{
+    MD_ParseResult result = MD_ParseResultZero();
+    result.node = node;
+    MD_Node *first = MD_AtomicLoadAcquireNode(&node->first_child);
+    if(first->kind == MD_NodeKind_Unparsed)
+    {
+        // NOTE: sets in different subtrees of one tree can be parsed at once
+        // by the threads of MD_ParallelVisit, and all of them allocate on the
+        // same arena and intern into the same symbol table, so the tree's
+        // state holds a lock. Two threads can also reach the same set, so
+        // whoever gets the lock second has to look again.
+        MD_ParseLazyState *state = ((MD_ParseLazySet *)first)->state;
+        MD_SpinLockAcquire(&state->lock);
+        
+        first = MD_AtomicLoadAcquireNode(&node->first_child);
+        
+        //- children that MD_ReparseWholeString kept: move them one level
+        if(first->kind == MD_NodeKind_Unparsed && !MD_NodeIsNil(first->first_child))
+        {
+            MD_ParseLazySet *lazy = (MD_ParseLazySet *)first;
+            for(MD_EachNode(child, first->first_child))
+            {
+                MD_LazyMoveNode(state, child, lazy->string_shift, lazy->offset_shift, lazy->contents);
+            }
+            node->last_child = first->last_child;
+            MD_AtomicStoreReleaseNode(&node->first_child, first->first_child);
+        }
+        
+        //- a skipped set body: parse it
+        else if(first->kind == MD_NodeKind_Unparsed)
+        {
+            MD_Arena *arena = state->arena;
+            MD_ArenaTemp scratch = MD_GetScratch(&arena, 1);
+            
+            // NOTE: readers outside the lock still see the placeholder, so the
+            // children are built under a copy of the node, and only handed to
+            // the node once they are complete.
+            MD_Node side = *node;
+            side.next = side.prev = side.parent = MD_NilNode();
+            side.first_child = side.last_child = MD_NilNode();
+            side.child_count = 0;
+            
+            // NOTE: token strings come from the body, and node offsets from the
+            // whole string, like MD_ReparseWholeString's window.
+            MD_ParseCtx ctx = MD_ZERO_STRUCT;
+            ctx.arena = arena;
+            ctx.string = state->contents;
+            ctx.tokens = MD_TokenizeString(scratch.arena, first->raw_string);
+            ctx.symbols = state->symbols;
+            ctx.flags = state->flags;
+            ctx.lazy_state = state;
+            MD_ParseResult parse = MD_ParseNodeSetFromCtx(&ctx, &side, MD_ParseSetRule_EndOnDelimiter);
+            for(MD_EachNode(child, side.first_child))
+            {
+                child->parent = node;
+            }
+            MD_Node *root = MD_RootFromNode(node);
+            for(MD_Message *error = parse.errors.first; error != 0; error = error->next)
+            {
+                if(MD_NodeIsNil(error->node->parent))
+                {
+                    error->node->parent = root;
+                }
+            }
+            if(keep_errors)
+            {
+                MD_MessageListConcat(&state->errors, &parse.errors);
+            }
+            else
+            {
+                result.errors = parse.errors;
+            }
+            result.string_advance = parse.string_advance;
+            MD_ReleaseScratch(scratch);
+            
+            //- publish: first_child goes last, so a reader that sees it past
+            // the placeholder also sees the rest
+            node->last_child = side.last_child;
+            node->child_count = side.child_count;
+            MD_AtomicStoreReleaseNode(&node->first_child, side.first_child);
+        }
+        
+        MD_SpinLockRelease(&state->lock);
+    }
+    return result;
+}
+
+MD_FUNCTION MD_ParseResult
+MD_ParseLazyChildren(MD_Node *node)
+{
+    return MD_ParseLazyChildrenFromNode(node, 0);
+}
+
+MD_FUNCTION MD_ParseResult
+MD_ParseWholeFile(MD_Arena *arena, MD_String8 filename)
+{
+    return MD_ParseWholeFileEx(arena, filename, 0);
+}
+
+MD_FUNCTION MD_ParseResult
+MD_ParseWholeFileEx(MD_Arena *arena, MD_String8 filename, MD_ParseOptions *options)
+{
+    MD_String8 file_contents = MD_LoadEntireFile(arena, filename);
+    MD_ParseResult parse = MD_ParseWholeStringEx(arena, filename, file_contents, options);
+    if(file_contents.str == 0)
+    {
+        // NOTE(rjf): @error File failing to load
+        MD_String8 error_str = MD_S8Fmt(arena, "Could not read file \"%.*s\"", MD_S8VArg(filename));
+        MD_Message *error = MD_MakeNodeError(arena, parse.node, MD_MessageKind_FatalError,
+                                             error_str);
+        MD_MessageListPush(&parse.errors, error);
+    }
+    return parse;
+}
+
+//- Parallel parsing
+//
+// Under MD_ParseSetRule_Global, where the next top-level node starts depends
+// only on where the previous one started, so like the lexer the top-level
+// loop carries one piece of state between nodes: a token index. (The After*
+// flags a node gets from its predecessor's separator are applied while
+// stitching.) Each chunk guesses a start point: the first regular token on
+// a line that starts in column zero, outside of any brackets. (Between
+// top-level nodes the parser skips to the next regular token.) A
+// parallel pre-scan over the tokens finds the bracket depth at every chunk
+// start; strings and comments are already single tokens. The chunk then
+// parses top-level nodes from there on its own arena, and records where each
+// one started. The stitch pass follows the true sequence of node starts. It
+// parses serially from the end of the last accepted node until it lands on a
+// start that the next chunk recorded, and takes the rest of that chunk from
+// there.
+
+// Below this many bytes per thread, MD_ParseWholeStringParallel parses serially.
+#if !defined(MD_PARALLEL_PARSE_MIN_CHUNK_SIZE)
+# define MD_PARALLEL_PARSE_MIN_CHUNK_SIZE (256llu << 10)
+#endif
+
+typedef struct MD_ParseEntry MD_ParseEntry;
+struct MD_ParseEntry
+{
+    MD_ParseEntry *next;
+    MD_u64 first_idx;
+    MD_u64 opl_idx;
+    MD_Node *node;
+    MD_MessageList errors;
+    MD_NodeFlags trailing_separator_flags;
+};
+
+typedef struct MD_ParseChunkTask MD_ParseChunkTask;
+struct MD_ParseChunkTask
+{
+    MD_ParseCtx ctx;
+    MD_Arena *entry_arena;
+    MD_u64 first_idx;
+    MD_u64 opl_idx;
+    
+    // Bracket depth pre-scan: the depth at the end of the chunk when entered
+    // at depth 0 (`final_depth`), the net change (`depth_delta`), and the
+    // depth on entry, once known.
+    MD_i64 final_depth;
+    MD_i64 depth_delta;
+    MD_i64 start_depth;
+    
+    MD_ParseEntry *first_entry;
+    MD_ParseEntry *last_entry;
+};
+
+static MD_i64
+MD_ParseDepthDeltaFromToken(MD_TokenArray *tokens, MD_u64 idx)
+{
+    MD_i64 result = 0;
+    if(tokens->kinds[idx] == MD_TokenKind_Reserved)
+    {
+        MD_u8 c = tokens->string.str[tokens->offsets[idx]];
+        if(c == '{' || c == '(' || c == '[')
+        {
+            result = 1;
+        }
+        else if(c == '}' || c == ')' || c == ']')
+        {
+            result = -1;
+        }
+    }
+    return result;
+}
+
+static void
+MD_ParseChunkTaskScanDepth(void *params)
+{
+    MD_ParseChunkTask *task = (MD_ParseChunkTask*)params;
+    MD_TokenArray *tokens = &task->ctx.tokens;
+    MD_i64 depth = 0;
+    MD_i64 delta = 0;
+    for(MD_u64 idx = task->first_idx; idx < task->opl_idx; idx += 1)
+    {
+        MD_i64 token_delta = MD_ParseDepthDeltaFromToken(tokens, idx);
+        depth = MD_Max(0, depth + token_delta);
+        delta += token_delta;
+    }
+    task->final_depth = depth;
+    task->depth_delta = delta;
+}
+
+// Parses one top-level node, as one iteration of the top-level set loop
+// would, without hooking it into a parent or applying After* flags.
+static MD_ParseEntry *
+MD_ParseEntryFromCtx(MD_Arena *arena, MD_ParseCtx *ctx)
+{
+    MD_ParseEntry *entry = MD_PushArrayZero(arena, MD_ParseEntry, 1);
+    entry->first_idx = ctx->at;
+    MD_ParseResult child_parse = MD_ParseOneNodeFromCtx(ctx);
+    entry->node = child_parse.node;
+    entry->errors = child_parse.errors;
+    entry->trailing_separator_flags = MD_ParseTrailingSeparatorFromCtx(ctx);
+    entry->opl_idx = ctx->at;
+    return entry;
+}
+
+static void
+MD_ParseChunkTaskRun(void *params)
+{
+    MD_ParseChunkTask *task = (MD_ParseChunkTask*)params;
+    MD_TokenArray *tokens = &task->ctx.tokens;
+    
+    //- guess a start point, unless this chunk starts the string
+    MD_u64 start_idx = task->first_idx;
+    if(start_idx != 0)
+    {
+        start_idx = task->opl_idx;
+        MD_i64 depth = task->start_depth;
+        for(MD_u64 idx = task->first_idx; idx < task->opl_idx; idx += 1)
+        {
+            if(depth == 0 && tokens->kinds[idx] == MD_TokenKind_Newline && idx + 1 < tokens->count &&
+               (tokens->kinds[idx + 1] & (MD_TokenKind_Whitespace|MD_TokenKind_Newline)) == 0)
+            {
+                start_idx = MD_TokenIndexAdvanceFromSkips(tokens, idx + 1, MD_TokenGroup_Irregular);
+                break;
+            }
+            depth = MD_Max(0, depth + MD_ParseDepthDeltaFromToken(tokens, idx));
+        }
+    }
+    
+    //- parse every top-level node that starts inside the chunk
+    task->ctx.at = start_idx;
+    for(;task->ctx.at < task->opl_idx;)
+    {
+        MD_ParseEntry *entry = MD_ParseEntryFromCtx(task->entry_arena, &task->ctx);
+        MD_QueuePush(task->first_entry, task->last_entry, entry);
+    }
+}
+
+MD_FUNCTION MD_ParseResult
+MD_ParseWholeStringParallel(MD_Arena **thread_arenas, MD_u64 thread_count, MD_String8 filename,
+                            MD_String8 contents)
+{
+    MD_ParseResult result = MD_ParseResultZero();
+    MD_Arena *arena = thread_arenas[0];
+    MD_u64 chunk_count = MD_Min(thread_count, contents.size / MD_PARALLEL_PARSE_MIN_CHUNK_SIZE);
+    if(chunk_count <= 1)
+    {
+        result = MD_ParseWholeString(arena, filename, contents);
+    }
+    else
+    {
+        MD_ArenaTemp scratch = MD_GetScratch(&arena, 1);
+        MD_Node *root = MD_MakeNode(arena, MD_NodeKind_File, filename, contents, 0);
+        MD_ParseCtx ctx = MD_ZERO_STRUCT;
+        ctx.arena = arena;
+        ctx.string = contents;
+        ctx.tokens = MD_TokenizeStringParallel(scratch.arena, contents, thread_count);
+        MD_ParseChunkTask *tasks = MD_PushArrayZero(scratch.arena, MD_ParseChunkTask, chunk_count);
+        MD_ThreadJob *jobs = MD_PushArrayZero(scratch.arena, MD_ThreadJob, chunk_count);
+        
+        //- split the tokens into chunks of roughly equal byte size
+        {
+            MD_u64 first_idx = 0;
+            for(MD_u64 chunk_idx = 0; chunk_idx < chunk_count; chunk_idx += 1)
+            {
+                MD_u64 opl_idx = ctx.tokens.count;
+                if(chunk_idx + 1 < chunk_count)
+                {
+                    MD_u64 opl_offset = contents.size / chunk_count * (chunk_idx + 1);
+                    for(opl_idx = first_idx;
+                        opl_idx < ctx.tokens.count && ctx.tokens.offsets[opl_idx] < opl_offset;
+                        opl_idx += 1);
+                }
+                tasks[chunk_idx].ctx = ctx;
+                tasks[chunk_idx].ctx.arena = thread_arenas[chunk_idx];
+                tasks[chunk_idx].entry_arena = (chunk_idx == 0 ? scratch.arena : MD_ArenaAlloc());
+                tasks[chunk_idx].first_idx = first_idx;
+                tasks[chunk_idx].opl_idx = opl_idx;
+                first_idx = opl_idx;
+            }
+        }
+        
+        //- pre-scan bracket depths, then parse every chunk speculatively;
+        // this thread takes the first chunk of each pass
+        for(MD_u64 chunk_idx = 1; chunk_idx < chunk_count; chunk_idx += 1)
+        {
+            MD_ThreadJobLaunch(&jobs[chunk_idx], MD_ParseChunkTaskScanDepth, &tasks[chunk_idx]);
+        }
+        MD_ParseChunkTaskScanDepth(&tasks[0]);
+        for(MD_u64 chunk_idx = 1; chunk_idx < chunk_count; chunk_idx += 1)
+        {
+            MD_ThreadJobJoin(&jobs[chunk_idx]);
+            MD_ParseChunkTask *prev = &tasks[chunk_idx - 1];
+            tasks[chunk_idx].start_depth = MD_Max(prev->final_depth, prev->start_depth + prev->depth_delta);
+        }
+        for(MD_u64 chunk_idx = 1; chunk_idx < chunk_count; chunk_idx += 1)
+        {
+            MD_ThreadJobLaunch(&jobs[chunk_idx], MD_ParseChunkTaskRun, &tasks[chunk_idx]);
+        }
+        MD_ParseChunkTaskRun(&tasks[0]);
+        for(MD_u64 chunk_idx = 1; chunk_idx < chunk_count; chunk_idx += 1)
+        {
+            MD_ThreadJobJoin(&jobs[chunk_idx]);
+        }
+        
+        //- stitch: follow the true node starts through the chunks
+        {
+            MD_NodeFlags next_child_flags = 0;
+            ctx.at = 0;
+            for(MD_u64 chunk_idx = 0; chunk_idx < chunk_count; chunk_idx += 1)
+            {
+                MD_ParseChunkTask *task = &tasks[chunk_idx];
+                MD_ParseEntry *entry = task->first_entry;
+                for(;ctx.at < task->opl_idx;)
+                {
+                    for(; entry != 0 && entry->first_idx < ctx.at; entry = entry->next);
+                    MD_ParseEntry *accepted = entry;
+                    if(entry != 0 && entry->first_idx == ctx.at)
+                    {
+                        entry = entry->next;
+                    }
+                    else
+                    {
+                        accepted = MD_ParseEntryFromCtx(scratch.arena, &ctx);
+                    }
+                    
+                    //- fill node info as the top-level set loop would
+                    MD_MessageListConcat(&result.errors, &accepted->errors);
+                    if(!MD_NodeIsNil(accepted->node))
+                    {
+                        MD_PushChild(root, accepted->node);
+                        accepted->node->flags |= next_child_flags | accepted->trailing_separator_flags;
+                    }
+                    next_child_flags = MD_NodeFlag_AfterFromBefore(accepted->trailing_separator_flags);
+                    ctx.at = accepted->opl_idx;
+                }
+            }
+        }
+        
+        //- fill result info
+        result.node = root;
+        result.string_advance = MD_ParseCtxByteAdvance(&ctx, 0);
+        for(MD_Message *error = result.errors.first; error != 0; error = error->next)
+        {
+            if(MD_NodeIsNil(error->node->parent))
+            {
+                error->node->parent = root;
+            }
+        }
+        for(MD_u64 chunk_idx = 1; chunk_idx < chunk_count; chunk_idx += 1)
+        {
+            MD_ArenaRelease(tasks[chunk_idx].entry_arena);
+        }
+        MD_ReleaseScratch(scratch);
+    }
+    return result;
+}
+
+//- Multi-file parsing
+//
+// MD_ParseFiles hands out whole files. They are sorted largest first and
+// dealt onto one MD_WorkDeque per thread, and each thread parses into its
+// own arena.
+
+typedef struct MD_ParseFilesTask MD_ParseFilesTask;
+struct MD_ParseFilesTask
+{
+    MD_Arena *arena;
+    MD_u64 thread_idx;
+    MD_u64 thread_count;
+    MD_WorkDeque *deques;
+    MD_String8 *paths;
+    MD_ParseResult *parses;
+};
+
+static void
+MD_ParseFilesTaskRun(void *params)
+{
+    MD_ParseFilesTask *task = (MD_ParseFilesTask*)params;
+    for(;;)
+    {
+        MD_u32 file_idx = 0;
+        if(!MD_WorkDequesTake(task->deques, task->thread_idx, task->thread_count, &file_idx))
+        {
+            break;
+        }
+        task->parses[file_idx] = MD_ParseWholeFile(task->arena, task->paths[file_idx]);
+    }
+}
+
+MD_FUNCTION MD_ParseResult
+MD_ParseFiles(MD_Arena **thread_arenas, MD_u64 thread_count, MD_String8List paths)
+{
+    MD_ParseResult result = MD_ParseResultZero();
+    MD_Arena *arena = thread_arenas[0];
+    MD_ArenaTemp scratch = MD_GetScratch(thread_arenas, thread_count);
+    MD_u64 file_count = paths.node_count;
+#if !defined(MD_IMPL_AtomicCompareExchangeU64)
+    thread_count = 1;
+#endif
+    thread_count = MD_ClampBot(1, MD_Min(thread_count, file_count));
+    
+    //- gather paths and sizes
+    MD_String8 *path_array = MD_PushArrayZero(scratch.arena, MD_String8, file_count);
+    MD_u64 *file_sizes = MD_PushArrayZero(scratch.arena, MD_u64, file_count);
+    {
+        MD_u64 file_idx = 0;
+        for(MD_String8Node *node = paths.first; node != 0; node = node->next, file_idx += 1)
+        {
+            path_array[file_idx] = node->string;
+            file_sizes[file_idx] = MD_FileInfoFromPath(scratch.arena, node->string).file_size;
+        }
+    }
+    
+    //- sort file indices by size, largest first (a stable bottom-up merge
+    // sort, so equal sizes keep the order they were given in)
+    MD_u32 *order = MD_PushArrayZero(scratch.arena, MD_u32, file_count);
+    {
+        MD_u32 *swap = MD_PushArrayZero(scratch.arena, MD_u32, file_count);
+        for(MD_u64 file_idx = 0; file_idx < file_count; file_idx += 1)
+        {
+            order[file_idx] = (MD_u32)file_idx;
+        }
+        for(MD_u64 width = 1; width < file_count; width *= 2)
+        {
+            for(MD_u64 first = 0; first < file_count; first += 2*width)
+            {
+                MD_u64 mid = MD_Min(first + width, file_count);
+                MD_u64 opl = MD_Min(first + 2*width, file_count);
+                MD_u64 left = first;
+                MD_u64 right = mid;
+                for(MD_u64 out = first; out < opl; out += 1)
+                {
+                    if(right >= opl || (left < mid && file_sizes[order[left]] >= file_sizes[order[right]]))
+                    {
+                        swap[out] = order[left];
+                        left += 1;
+                    }
+                    else
+                    {
+                        swap[out] = order[right];
+                        right += 1;
+                    }
+                }
+            }
+            MD_u32 *temp = order;
+            order = swap;
+            swap = temp;
+        }
+    }
+    
+    //- deal the sorted files onto the deques
+    MD_WorkDeque *deques = MD_WorkDequesFromOrder(scratch.arena, order, file_count, thread_count);
+    
+    //- parse; this thread takes the first deque
+    MD_ParseResult *parses = MD_PushArrayZero(scratch.arena, MD_ParseResult, file_count);
+    MD_ParseFilesTask *tasks = MD_PushArrayZero(scratch.arena, MD_ParseFilesTask, thread_count);
+    MD_ThreadJob *jobs = MD_PushArrayZero(scratch.arena, MD_ThreadJob, thread_count);
+    for(MD_u64 thread_idx = 0; thread_idx < thread_count; thread_idx += 1)
+    {
+        tasks[thread_idx].arena = thread_arenas[thread_idx];
+        tasks[thread_idx].thread_idx = thread_idx;
+        tasks[thread_idx].thread_count = thread_count;
+        tasks[thread_idx].deques = deques;
+        tasks[thread_idx].paths = path_array;
+        tasks[thread_idx].parses = parses;
+    }
+    for(MD_u64 thread_idx = 1; thread_idx < thread_count; thread_idx += 1)
+    {
+        MD_ThreadJobLaunch(&jobs[thread_idx], MD_ParseFilesTaskRun, &tasks[thread_idx]);
+    }
+    MD_ParseFilesTaskRun(&tasks[0]);
+    for(MD_u64 thread_idx = 1; thread_idx < thread_count; thread_idx += 1)
+    {
+        MD_ThreadJobJoin(&jobs[thread_idx]);
+    }
+    
+    //- merge results in the order the paths were given
+    result.node = MD_MakeList(arena);
+    for(MD_u64 file_idx = 0; file_idx < file_count; file_idx += 1)
+    {
+        MD_PushNewReference(arena, result.node, parses[file_idx].node);
+        MD_MessageListConcat(&result.errors, &parses[file_idx].errors);
+    }
+    
+    MD_ReleaseScratch(scratch);
+    return result;
+}
+
+//- Streaming
+//
+// The window is a buffer that read input is appended to; the bytes before
+// window_start have been parsed, and are only dropped when the buffer fills
+// up and more than half of it is parsed (otherwise the buffer doubles). The
+// unparsed bytes are lexed once into `tokens`, and each node is parsed from
+// token_at on. The last token is lexed again when more input arrives, since
+// the end of the window may have cut it short.
+
+static MD_String8
+MD_S8Rebase(MD_String8 string, MD_u8 *old_base, MD_u64 old_size, MD_u8 *new_base)
+{
+    if(old_base <= string.str && string.str + string.size <= old_base + old_size)
+    {
+        string.str = new_base + (string.str - old_base);
+    }
+    return string;
+}
+
+// Moves a freshly parsed subtree off the stream window: strings are pointed
+// into `copy`, a copy of the window's first `size` bytes, and offsets become
+// stream offsets.
+//
+// NOTE: the subtree is walked through its own links (tags, then children)
+// rather than by recursion, since a node can be as deep as the stream is long.
+static void
+MD_ParseStreamRebaseNode(MD_Node *root, MD_u8 *window, MD_u64 size, MD_u8 *copy, MD_u64 window_offset)
+{
+    for(MD_Node *node = root; !MD_NodeIsNil(node);)
+    {
+        node->string = MD_S8Rebase(node->string, window, size, copy);
+        node->raw_string = MD_S8Rebase(node->raw_string, window, size, copy);
+        node->prev_comment = MD_S8Rebase(node->prev_comment, window, size, copy);
+        node->next_comment = MD_S8Rebase(node->next_comment, window, size, copy);
+        node->offset += window_offset;
+        
+        //- step to the next node in pre-order
+        if(!MD_NodeIsNil(node->first_tag))
+        {
+            node = node->first_tag;
+        }
+        else if(!MD_NodeIsNil(node->first_child))
+        {
+            node = node->first_child;
+        }
+        else
+        {
+            for(;;)
+            {
+                MD_Node *parent = node->parent;
+                if(node == root)
+                {
+                    node = MD_NilNode();
+                    break;
+                }
+                else if(!MD_NodeIsNil(node->next))
+                {
+                    node = node->next;
+                    break;
+                }
+                else if(node == parent->last_tag && !MD_NodeIsNil(parent->first_child))
+                {
+                    node = parent->first_child;
+                    break;
+                }
+                node = parent;
+            }
+        }
+    }
+}
+
+static void
+MD_ParseStreamDiscard(MD_ParseStream *stream, MD_u64 size)
+{
+    MD_u8 *window = stream->window + stream->window_start;
+    for(MD_u64 i = 0; i < size; i += 1)
+    {
+        if(window[i] == '\n')
+        {
+            stream->window_line += 1;
+            stream->window_column = 1;
+        }
+        else
+        {
+            stream->window_column += 1;
+        }
+    }
+    stream->window_start += size;
+    stream->window_offset += size;
+}
+
+// Lexes the unparsed bytes of the window that have no tokens yet, and keeps
+// the tokens from token_at on.
+static void
+MD_ParseStreamLex(MD_ParseStream *stream)
+{
+    MD_ArenaTemp scratch = MD_GetScratch(&stream->token_arena, 1);
+    MD_String8 window = MD_S8(stream->window, stream->window_size);
+    MD_TokenArray *tokens = &stream->tokens;
+    MD_u64 keep_first = stream->token_at;
+    MD_u64 keep_opl = MD_Max(keep_first, (tokens->count > 0 ? tokens->count - 1 : 0));
+    MD_u64 lex_first = (tokens->count > 0 ? tokens->offsets[keep_opl] : stream->window_start);
+    MD_TokenArray lexed = MD_TokenArrayFromRange(scratch.arena, window, lex_first, window.size);
+    MD_u64 keep_count = keep_opl - keep_first;
+    MD_TokenArray joined = MD_TokenArrayAlloc(scratch.arena, window, keep_count + lexed.count);
+    MD_TokenArrayCopyRange(&joined, 0, tokens, keep_first, keep_opl);
+    MD_TokenArrayCopyRange(&joined, keep_count, &lexed, 0, lexed.count);
+    joined.offsets[joined.count] = lexed.offsets[lexed.count];
+    MD_ArenaClear(stream->token_arena);
+    *tokens = MD_TokenArrayAlloc(stream->token_arena, window, joined.count);
+    MD_TokenArrayCopyRange(tokens, 0, &joined, 0, joined.count);
+    tokens->offsets[tokens->count] = joined.offsets[joined.count];
+    stream->token_at = 0;
+    MD_ReleaseScratch(scratch);
+}
+
+// Reads once into the free part of the window. When it is full, the unparsed
+// bytes and their tokens are moved to the front first, into a buffer twice as
+// big unless more than half of it was parsed.
+static void
+MD_ParseStreamRead(MD_ParseStream *stream)
+{
+    if(stream->window_size == stream->window_cap)
+    {
+        MD_u64 unparsed_size = stream->window_size - stream->window_start;
+        if(2*stream->window_start >= stream->window_cap)
+        {
+            MD_MemoryCopy(stream->window, stream->window + stream->window_start, unparsed_size);
+        }
+        else
+        {
+            MD_ArenaTemp scratch = MD_GetScratch(&stream->window_arena, 1);
+            MD_String8 contents = MD_S8Copy(scratch.arena, MD_S8(stream->window + stream->window_start,
+                                                                 unparsed_size));
+            MD_ArenaClear(stream->window_arena);
+            stream->window_cap *= 2;
+            stream->window = MD_PushArray(stream->window_arena, MD_u8, stream->window_cap);
+            MD_MemoryCopy(stream->window, contents.str, contents.size);
+            MD_ReleaseScratch(scratch);
+        }
+        if(stream->tokens.count > 0)
+        {
+            for(MD_u64 idx = stream->token_at; idx <= stream->tokens.count; idx += 1)
+            {
+                stream->tokens.offsets[idx] -= stream->window_start;
+            }
+            stream->tokens.string = MD_S8(stream->window, unparsed_size);
+        }
+        stream->window_start = 0;
+        stream->window_size = unparsed_size;
+    }
+    MD_u64 read_size = stream->read(stream->user_data, stream->window + stream->window_size,
+                                    stream->window_cap - stream->window_size);
+    stream->window_size += read_size;
+    if(read_size == 0)
+    {
+        stream->eof = 1;
+    }
+}
+
+MD_FUNCTION MD_ParseStream
+MD_ParseStreamBegin(MD_Arena *arena, MD_String8 filename, MD_ParseStreamReadFunc *read, void *user_data,
+                    MD_u64 window_size)
+{
+    MD_ParseStream stream = MD_ZERO_STRUCT;
+    stream.arena = arena;
+    stream.root = MD_MakeNode(arena, MD_NodeKind_File, filename, MD_S8Lit(""), 0);
+    stream.read = read;
+    stream.user_data = user_data;
+    stream.window_arena = MD_ArenaAlloc();
+    stream.window_cap = MD_Max(window_size, 1);
+    stream.window = MD_PushArray(stream.window_arena, MD_u8, stream.window_cap);
+    stream.token_arena = MD_ArenaAlloc();
+    stream.window_line = 1;
+    stream.window_column = 1;
+    return stream;
+}
+
+MD_FUNCTION MD_ParseResult
+MD_ParseStreamNext(MD_ParseStream *stream)
+{
+    MD_ParseResult result = MD_ParseResultZero();
+    MD_Arena *arena = stream->arena;
+    MD_ParseStreamDiscard(stream, stream->pending_discard);
+    stream->pending_discard = 0;
+    
+    for(;;)
+    {
+        if(stream->window_start == stream->window_size && !stream->eof)
+        {
+            MD_ParseStreamRead(stream);
+        }
+        if(stream->window_start == stream->window_size && stream->eof)
+        {
+            break;
+        }
+        
+        //- parse one top-level node from the tokens of the window, reading
+        // more input until the parse can no longer change: either the stream
+        // has ended, or the next regular token after the node is followed by
+        // another token, and so cannot be cut short.
+        MD_ArenaTemp scratch = MD_GetScratch(&arena, 1);
+        MD_ArenaTemp attempt = MD_ArenaBeginTemp(arena);
+        MD_ParseCtx ctx = MD_ZERO_STRUCT;
+        MD_ParseResult child_parse = MD_ParseResultZero();
+        MD_NodeFlags trailing_separator_flags = 0;
+        for(;;)
+        {
+            MD_ArenaEndTemp(attempt);
+            MD_ArenaEndTemp(scratch);
+            MD_u64 lexed_opl = (stream->tokens.count > 0 ? stream->tokens.offsets[stream->tokens.count] :
+                                stream->window_start);
+            if(lexed_opl < stream->window_size)
+            {
+                MD_ParseStreamLex(stream);
+            }
+            ctx.arena = arena;
+            ctx.string = MD_S8Range(stream->window + stream->window_start, stream->window + stream->window_size);
+            ctx.tokens = stream->tokens;
+            ctx.at = stream->token_at;
+            child_parse = MD_ParseOneNodeFromCtx(&ctx);
+            trailing_separator_flags = MD_ParseTrailingSeparatorFromCtx(&ctx);
+            
+            MD_u64 lookahead = MD_TokenIndexAdvanceFromSkips(&ctx.tokens, ctx.at, MD_TokenGroup_Irregular);
+            if(stream->eof || lookahead + 1 < ctx.tokens.count)
+            {
+                break;
+            }
+            
+            // NOTE: reads can be short, so read until the unparsed bytes at
+            // least double; the node is then parsed a bounded number of times.
+            MD_u64 unparsed_target = 2*(stream->window_size - stream->window_start);
+            for(;!stream->eof && stream->window_size - stream->window_start < unparsed_target;)
+            {
+                MD_ParseStreamRead(stream);
+            }
+        }
+        
+        //- move the node off the window
+        MD_u8 *window = stream->window + stream->window_start;
+        MD_u64 consumed = ctx.tokens.offsets[ctx.at] - stream->window_start;
+        stream->token_at = ctx.at;
+        MD_u8 *copy = MD_PushArray(arena, MD_u8, consumed);
+        MD_MemoryCopy(copy, window, consumed);
+        MD_Map rebased = MD_MapMakeBucketCount(scratch.arena, 2*child_parse.errors.node_count + 1);
+        if(!MD_NodeIsNil(child_parse.node))
+        {
+            MD_ParseStreamRebaseNode(child_parse.node, window, consumed, copy, stream->window_offset);
+            MD_MapInsert(scratch.arena, &rebased, MD_MapKeyPtr(child_parse.node), 0);
+        }
+        for(MD_Message *error = child_parse.errors.first; error != 0; error = error->next)
+        {
+            if(error->node->kind == MD_NodeKind_ErrorMarker)
+            {
+                error->node->raw_string = MD_S8(copy, consumed);
+                error->node->offset += stream->window_offset;
+            }
+            else
+            {
+                // NOTE: errors can point into subtrees the parser dropped
+                // (e.g. a malformed tag), which the rebase above did not reach.
+                MD_Node *top = error->node;
+                for(; !MD_NodeIsNil(top->parent); top = top->parent);
+                if(MD_MapLookup(&rebased, MD_MapKeyPtr(top)) == 0)
+                {
+                    MD_ParseStreamRebaseNode(top, window, consumed, copy, stream->window_offset);
+                    MD_MapInsert(scratch.arena, &rebased, MD_MapKeyPtr(top), 0);
+                }
+            }
+            if(MD_NodeIsNil(error->node->parent))
+            {
+                error->node->parent = stream->root;
+            }
+        }
+        MD_ReleaseScratch(scratch);
+        
+        //- fill node info as the top-level set loop would
+        MD_MessageListConcat(&result.errors, &child_parse.errors);
+        result.string_advance += consumed;
+        stream->pending_discard = consumed;
+        if(!MD_NodeIsNil(child_parse.node))
+        {
+            child_parse.node->parent = stream->root;
+            child_parse.node->flags |= stream->next_child_flags | trailing_separator_flags;
+            result.node = child_parse.node;
+        }
+        stream->next_child_flags = MD_NodeFlag_AfterFromBefore(trailing_separator_flags);
+        if(!MD_NodeIsNil(result.node))
+        {
+            break;
+        }
+        MD_ParseStreamDiscard(stream, stream->pending_discard);
+        stream->pending_discard = 0;
+    }
+    
+    return result;
+}
+
+MD_FUNCTION void
+MD_ParseStreamEnd(MD_ParseStream *stream)
+{
+    MD_ArenaRelease(stream->window_arena);
+    MD_ArenaRelease(stream->token_arena);
+    MD_MemoryZeroStruct(stream);
+}
+
+//- Incremental reparsing
+//
+// Like MD_ParseWholeStringParallel, this relies on the top-level loop carrying
+// little state from one node to the next. Once the loop has skipped the
+// comments before a node, the state is the index of the node's first regular
+// token (its first tag's '@', or its own first token), the comment it picked
+// up, and the After* flags. An edit can change how the node before the one it
+// lands in ends, so the reparse starts at the first regular token of the node
+// before that one. It then parses top-level nodes off the new string until one
+// reaches the same state as an old node that lies past the edit, with offsets
+// shifted by the size change. From there the old parse would repeat itself,
+// so the remaining old nodes are kept. Only the new string from the restart
+// point to a little past the first such old node is tokenized. If the tokens
+// run out before the reparse can trust where its last node ended, the span is
+// doubled and the reparse is tried again. Kept nodes are moved onto the new
+// string with MD_LazyMoveNode, which only walks their tags, so the cost of the
+// children they hold is paid when they are read, if ever.
+
+// Bytes past the first possible resync point to tokenize on the first try.
+#if !defined(MD_REPARSE_MIN_SPAN)
+# define MD_REPARSE_MIN_SPAN 4096
+#endif
+
+typedef struct MD_ReparseEdit MD_ReparseEdit;
+struct MD_ReparseEdit
+{
+    MD_String8 old_contents;
+    MD_String8 new_contents;
+    MD_u64 edit_max;
+    MD_i64 delta;
+};
+
+static MD_u64
+MD_ReparseFirstOffsetFromNode(MD_Node *node)
+{
+    MD_u64 result = node->offset;
+    if(!MD_NodeIsNil(node->first_tag))
+    {
+        // tag names directly follow their '@'
+        result = node->first_tag->offset - 1;
+    }
+    return result;
+}
+
+// A node without tags right after an '@' might have been the bad "name" of a
+// failed tag, in which case the '@' started it, or might not. An error at the
+// node's first offset might belong to it or to the node before it (an empty
+// implicit set ends there, for example). Such nodes are not used as restart or
+// resync points, so errors can be split between kept and reparsed nodes by
+// offset alone.
+static MD_b32
+MD_ReparseNodeIsResumable(MD_String8 contents, MD_MessageList errors, MD_Node *node)
+{
+    MD_b32 result = (!MD_NodeIsNil(node->first_tag) || node->offset == 0 || contents.str[node->offset - 1] != '@');
+    MD_u64 first_offset = MD_ReparseFirstOffsetFromNode(node);
+    for(MD_Message *error = errors.first; result && error != 0; error = error->next)
+    {
+        result = (error->node->offset != first_offset);
+    }
+    return result;
+}
+
+static MD_u64
+MD_ReparseOffsetFromOldOffset(MD_ReparseEdit *edit, MD_u64 offset)
+{
+    MD_u64 result = offset;
+    if(offset >= edit->edit_max)
+    {
+        result = (MD_u64)((MD_i64)offset + edit->delta);
+    }
+    return result;
+}
+
+static MD_String8
+MD_ReparseStringFromOldString(MD_ReparseEdit *edit, MD_String8 string)
+{
+    MD_u8 *old_base = edit->old_contents.str;
+    if(old_base <= string.str && string.str + string.size <= old_base + edit->old_contents.size)
+    {
+        string.str = edit->new_contents.str + MD_ReparseOffsetFromOldOffset(edit, string.str - old_base);
+    }
+    return string;
+}
+
+// Moves a kept subtree onto the new string. The walk follows parent links
+// instead of recursing, so that it handles trees of any depth.
+static void
+MD_ReparseMoveNode(MD_ReparseEdit *edit, MD_Node *top)
+{
+    for(MD_Node *node = top; node != 0;)
+    {
+        node->string = MD_ReparseStringFromOldString(edit, node->string);
+        node->raw_string = MD_ReparseStringFromOldString(edit, node->raw_string);
+        node->prev_comment = MD_ReparseStringFromOldString(edit, node->prev_comment);
+        node->next_comment = MD_ReparseStringFromOldString(edit, node->next_comment);
+        node->offset = MD_ReparseOffsetFromOldOffset(edit, node->offset);
+        if(node->kind == MD_NodeKind_ErrorMarker)
+        {
+            node->raw_string = edit->new_contents;
+        }
+        
+        //- step to the next node: tags, then children, then siblings
+        MD_Node *next = 0;
+        if(!MD_NodeIsNil(node->first_tag))
+        {
+            next = node->first_tag;
+        }
+        else if(!MD_NodeIsNil(node->first_child))
+        {
+            next = node->first_child;
+        }
+        for(MD_Node *up = node; next == 0 && up != top; up = up->parent)
+        {
+            if(!MD_NodeIsNil(up->next))
+            {
+                next = up->next;
+            }
+            else if(up->kind == MD_NodeKind_Tag && !MD_NodeIsNil(up->parent->first_child))
+            {
+                next = up->parent->first_child;
+            }
+        }
+        node = next;
+    }
+}
+
+MD_FUNCTION MD_ParseResult
+MD_ReparseWholeString(MD_Arena *arena, MD_ParseResult previous, MD_String8 old_contents,
+                      MD_String8 new_contents, MD_u64 edit_min, MD_u64 edit_max)
+{
+    MD_ParseResult result = MD_ParseResultZero();
+    MD_Node *root = previous.node;
+    MD_ReparseEdit edit = MD_ZERO_STRUCT;
+    edit.old_contents = old_contents;
+    edit.new_contents = new_contents;
+    edit.edit_max = edit_max;
+    edit.delta = (MD_i64)new_contents.size - (MD_i64)old_contents.size;
+    
+    //- fall back to a full parse if the edit does not describe the two strings
+    if(root->kind != MD_NodeKind_File || edit_min > edit_max || edit_max > old_contents.size ||
+       (MD_i64)(edit_max - edit_min) + edit.delta < 0)
+    {
+        result = MD_ParseWholeString(arena, root->string, new_contents);
+    }
+    else
+    {
+        MD_NodeFlags after_flags = MD_NodeFlag_IsAfterComma|MD_NodeFlag_IsAfterSemicolon;
+        
+        //- find the restart point: the node before the last one that starts
+        // before the edit, or the start of the string
+        MD_Node *restart_node = MD_NilNode();
+        for(MD_Node *child = root->first_child;
+            !MD_NodeIsNil(child) && MD_ReparseFirstOffsetFromNode(child) < edit_min;
+            child = child->next)
+        {
+            restart_node = child->prev;
+        }
+        for(;!MD_NodeIsNil(restart_node) && !MD_ReparseNodeIsResumable(old_contents, previous.errors, restart_node);
+            restart_node = restart_node->prev);
+        MD_Node *last_kept = MD_NilNode();
+        MD_Node *first_discarded = root->first_child;
+        MD_u64 restart_offset = 0;
+        MD_NodeFlags restart_flags = 0;
+        if(!MD_NodeIsNil(restart_node))
+        {
+            last_kept = restart_node->prev;
+            first_discarded = restart_node;
+            restart_offset = MD_ReparseFirstOffsetFromNode(restart_node);
+            restart_flags = restart_node->flags & after_flags;
+        }
+        
+        //- find the first old node that starts after the edit
+        MD_Node *first_candidate = first_discarded;
+        for(;!MD_NodeIsNil(first_candidate) && MD_ReparseFirstOffsetFromNode(first_candidate) < edit_max;
+            first_candidate = first_candidate->next);
+        MD_u64 span = MD_REPARSE_MIN_SPAN;
+        if(!MD_NodeIsNil(first_candidate))
+        {
+            span += MD_ReparseOffsetFromOldOffset(&edit, MD_ReparseFirstOffsetFromNode(first_candidate)) - restart_offset;
+        }
+        else
+        {
+            span += new_contents.size - restart_offset;
+        }
+        
+        //- parse top-level nodes from the restart point until they line up with
+        // an old node again, or until the end of the string
+        MD_ArenaTemp scratch = MD_GetScratch(&arena, 1);
+        MD_Node *resync_node = MD_NilNode();
+        MD_ParseEntry *first_entry = 0;
+        MD_ParseEntry *last_entry = 0;
+        MD_ParseCtx ctx = MD_ZERO_STRUCT;
+        ctx.arena = arena;
+        ctx.string = new_contents;
+        for(;;)
+        {
+            MD_ArenaTemp attempt = MD_ArenaBeginTemp(arena);
+            MD_ArenaTemp attempt_scratch = MD_ArenaBeginTemp(scratch.arena);
+            MD_u64 window_opl = MD_Min(new_contents.size, restart_offset + span);
+            MD_b32 window_is_last = (window_opl == new_contents.size);
+            MD_String8 window = MD_S8Range(new_contents.str + restart_offset, new_contents.str + window_opl);
+            
+            // NOTE: the parser takes offsets relative to ctx.string, and token
+            // strings relative to the token array, so nodes come out with
+            // offsets into the whole new string.
+            ctx.tokens = MD_TokenizeString(scratch.arena, window);
+            ctx.at = 0;
+            first_entry = last_entry = 0;
+            MD_NodeFlags next_child_flags = restart_flags;
+            MD_Node *candidate = first_candidate;
+            MD_b32 done = 0;
+            for(;;)
+            {
+                if(ctx.at >= ctx.tokens.count && window_is_last)
+                {
+                    done = 1;
+                    break;
+                }
+                MD_ParseCtx comment_ctx = ctx;
+                MD_String8 prev_comment = MD_ParsePrevCommentFromCtx(&comment_ctx);
+                if(comment_ctx.at + 1 >= ctx.tokens.count && !window_is_last)
+                {
+                    break;
+                }
+                
+                //- stop where an old node past the edit was reached in the same state
+                MD_u64 first_offset = restart_offset + ctx.tokens.offsets[comment_ctx.at];
+                for(;!MD_NodeIsNil(candidate) &&
+                    MD_ReparseOffsetFromOldOffset(&edit, MD_ReparseFirstOffsetFromNode(candidate)) < first_offset;
+                    candidate = candidate->next);
+                if(!MD_NodeIsNil(candidate) &&
+                   MD_ReparseOffsetFromOldOffset(&edit, MD_ReparseFirstOffsetFromNode(candidate)) == first_offset &&
+                   (candidate->flags & after_flags) == next_child_flags &&
+                   MD_ReparseNodeIsResumable(old_contents, previous.errors, candidate))
+                {
+                    // the comments must be the same ones, outside of the edit
+                    MD_String8 old_comment = candidate->prev_comment;
+                    MD_b32 comment_match = (old_comment.size == prev_comment.size);
+                    if(comment_match && old_comment.size != 0)
+                    {
+                        MD_u64 old_comment_offset = (MD_u64)(old_comment.str - old_contents.str);
+                        comment_match = ((old_comment_offset + old_comment.size <= edit_min ||
+                                          old_comment_offset >= edit_max) &&
+                                         MD_ReparseOffsetFromOldOffset(&edit, old_comment_offset) ==
+                                         (MD_u64)(prev_comment.str - new_contents.str));
+                    }
+                    if(comment_match)
+                    {
+                        resync_node = candidate;
+                        done = 1;
+                        break;
+                    }
+                }
+                
+                MD_ParseEntry *entry = MD_ParseEntryFromCtx(scratch.arena, &ctx);
+                if(!MD_NodeIsNil(entry->node))
                 {
-                    case '\'': token.node_flags |= MD_NodeFlag_StringSingleQuote; break;
-                    case '"':  token.node_flags |= MD_NodeFlag_StringDoubleQuote; break;
-                    case '`':  token.node_flags |= MD_NodeFlag_StringTick; break;
-                    default: break;
+                    entry->node->flags |= next_child_flags | entry->trailing_separator_flags;
+                    
+                    // the restart point skipped the node's comments; they come
+                    // from before the edit, so they can be kept
+                    if(first_entry == 0 && !MD_NodeIsNil(restart_node))
+                    {
+                        entry->node->prev_comment = MD_ReparseStringFromOldString(&edit, restart_node->prev_comment);
+                    }
                 }
-                if(is_triplet)
+                next_child_flags = MD_NodeFlag_AfterFromBefore(entry->trailing_separator_flags);
+                MD_QueuePush(first_entry, last_entry, entry);
+            }
+            if(done)
+            {
+                break;
+            }
+            MD_ArenaEndTemp(attempt_scratch);
+            MD_ArenaEndTemp(attempt);
+            span *= 2;
+        }
+        
+        //- keep old messages from before the restart point and after the resync
+        // point, in order, and move any nodes they point at that are not in
+        // the tree onto the new string
+        MD_MessageList errors_before = MD_ZERO_STRUCT;
+        MD_MessageList errors_after = MD_ZERO_STRUCT;
+        {
+            MD_b32 have_resync = !MD_NodeIsNil(resync_node);
+            MD_u64 resync_offset = (have_resync ? MD_ReparseFirstOffsetFromNode(resync_node) : 0);
+            MD_Map moved = MD_MapMake(scratch.arena);
+            for(MD_Message *error = previous.errors.first, *next = 0; error != 0; error = next)
+            {
+                next = error->next;
+                MD_u64 offset = error->node->offset;
+                MD_MessageList *list = (offset < restart_offset ? &errors_before :
+                                        have_resync && offset >= resync_offset ? &errors_after : 0);
+                if(list != 0)
                 {
-                    token.node_flags |= MD_NodeFlag_StringTriplet;
+                    error->next = 0;
+                    MD_MessageListPush(list, error);
+                    MD_Node *top = error->node;
+                    for(;!MD_NodeIsNil(top->parent) && top->parent != root; top = top->parent);
+                    MD_b32 in_tree = (top == root || (top->parent == root &&
+                                                      (!MD_NodeIsNil(top->prev) || root->first_child == top)));
+                    if(!in_tree && MD_MapLookup(&moved, MD_MapKeyPtr(top)) == 0)
+                    {
+                        MD_ReparseMoveNode(&edit, top);
+                        MD_MapInsert(scratch.arena, &moved, MD_MapKeyPtr(top), 0);
+                    }
                 }
-                
-            }break;
+            }
+        }
+        
+        //- move the kept top-level nodes onto the new string; their children
+        // are moved when they are first read
+        MD_ParseLazyState *state = previous.lazy;
+        if(state == 0)
+        {
+            state = MD_PushArrayZero(arena, MD_ParseLazyState, 1);
+        }
+        state->arena = arena;
+        state->contents = new_contents;
+        MD_u64 string_shift = (MD_u64)(void *)new_contents.str - (MD_u64)(void *)old_contents.str;
+        for(MD_Node *child = root->first_child; !MD_NodeIsNil(child) && child != first_discarded; child = child->next)
+        {
+            MD_LazyMoveNode(state, child, string_shift, 0, new_contents);
+        }
+        if(!MD_NodeIsNil(resync_node))
+        {
+            // NOTE: the resync node's comment may come from before the edit
+            MD_String8 resync_comment = MD_ReparseStringFromOldString(&edit, resync_node->prev_comment);
+            for(MD_Node *child = resync_node; !MD_NodeIsNil(child); child = child->next)
+            {
+                MD_LazyMoveNode(state, child, string_shift + (MD_u64)edit.delta, edit.delta, new_contents);
+            }
+            resync_node->prev_comment = resync_comment;
+        }
+        
+        //- messages are read without the helpers, so the nodes that kept ones
+        // point at are moved right away, along with the path down to them
+        MD_MessageList *kept_lists[2] = {&errors_before, &errors_after};
+        for(int list_idx = 0; list_idx < 2; list_idx += 1)
+        {
+            for(MD_Message *error = kept_lists[list_idx]->first; error != 0; error = error->next)
+            {
+                MD_u64 depth = 0;
+                for(MD_Node *up = error->node->parent; !MD_NodeIsNil(up) && up != root; up = up->parent)
+                {
+                    depth += 1;
+                }
+                MD_ArenaTemp path_temp = MD_ArenaBeginTemp(scratch.arena);
+                MD_Node **path = MD_PushArray(scratch.arena, MD_Node *, depth);
+                MD_u64 path_idx = depth;
+                for(MD_Node *up = error->node->parent; !MD_NodeIsNil(up) && up != root; up = up->parent)
+                {
+                    path_idx -= 1;
+                    path[path_idx] = up;
+                }
+                for(path_idx = 0; path_idx < depth; path_idx += 1)
+                {
+                    MD_FirstChildFromNode(path[path_idx]);
+                }
+                MD_ArenaEndTemp(path_temp);
+            }
+        }
+        
+        //- relink: kept nodes, reparsed nodes, then the old nodes from the resync point
+        MD_Node *old_last_child = root->last_child;
+        if(MD_NodeIsNil(last_kept))
+        {
+            root->first_child = root->last_child = MD_NilNode();
+        }
+        else
+        {
+            last_kept->next = MD_NilNode();
+            root->last_child = last_kept;
+        }
+        for(MD_ParseEntry *entry = first_entry; entry != 0; entry = entry->next)
+        {
+            MD_PushChild(root, entry->node);
+        }
+        if(!MD_NodeIsNil(resync_node))
+        {
+            resync_node->prev = root->last_child;
+            if(MD_NodeIsNil(root->last_child))
+            {
+                root->first_child = resync_node;
+            }
+            else
+            {
+                root->last_child->next = resync_node;
+            }
+            root->last_child = old_last_child;
+        }
+        root->child_count = 0;
+        for(MD_EachNode(child, root->first_child))
+        {
+            root->child_count += 1;
+        }
+        
+        //- fill result info
+        root->raw_string = new_contents;
+        result.node = root;
+        result.lazy = state;
+        MD_MessageListConcat(&result.errors, &errors_before);
+        for(MD_ParseEntry *entry = first_entry; entry != 0; entry = entry->next)
+        {
+            for(MD_Message *error = entry->errors.first; error != 0; error = error->next)
+            {
+                if(MD_NodeIsNil(error->node->parent))
+                {
+                    error->node->parent = root;
+                }
+            }
+            MD_MessageListConcat(&result.errors, &entry->errors);
+        }
+        MD_MessageListConcat(&result.errors, &errors_after);
+        result.string_advance = (MD_NodeIsNil(resync_node) ?
+                                 restart_offset + ctx.tokens.offsets[ctx.at] :
+                                 MD_ReparseOffsetFromOldOffset(&edit, previous.string_advance));
+        MD_ReleaseScratch(scratch);
+    }
+    return result;
+}
+
+//~ Messages (Errors/Warnings)
+
+MD_FUNCTION MD_Node*
+MD_MakeErrorMarkerNode(MD_Arena *arena, MD_String8 parse_contents, MD_u64 offset)
+{
+    MD_Node *result = MD_MakeNode(arena, MD_NodeKind_ErrorMarker, MD_S8Lit(""), parse_contents,
+                                  offset);
+    return(result);
+}
+
+MD_FUNCTION MD_Message*
+MD_MakeNodeError(MD_Arena *arena, MD_Node *node, MD_MessageKind kind, MD_String8 str)
+{
+    MD_Message *error = MD_PushArrayZero(arena, MD_Message, 1);
+    error->node = node;
+    error->kind = kind;
+    error->string = str;
+    return error;
+}
+
+MD_FUNCTION MD_Message *
+MD_MakeTokenError(MD_Arena *arena, MD_String8 parse_contents, MD_Token token,
+                  MD_MessageKind kind, MD_String8 str)
+{
+    MD_u64 offset = token.raw_string.str - parse_contents.str;
+    MD_Node *err_node = MD_MakeErrorMarkerNode(arena, parse_contents, offset);
+    return MD_MakeNodeError(arena, err_node, kind, str);
+}
+
+MD_FUNCTION void
+MD_MessageListPush(MD_MessageList *list, MD_Message *message)
+{
+    MD_QueuePush(list->first, list->last, message);
+    if(message->kind > list->max_message_kind)
+    {
+        list->max_message_kind = message->kind;
+    }
+    list->node_count += 1;
+}
+
+MD_FUNCTION void
+MD_MessageListConcat(MD_MessageList *list, MD_MessageList *to_push)
+{
+    if(to_push->node_count != 0)
+    {
+        if(list->last != 0)
+        {
+            list->last->next = to_push->first;
+            list->last = to_push->last;
+            list->node_count += to_push->node_count;
+            if(to_push->max_message_kind > list->max_message_kind)
+            {
+                list->max_message_kind = to_push->max_message_kind;
+            }
+        }
+        else
+        {
+            *list = *to_push;
+        }
+        MD_MemoryZeroStruct(to_push);
+    }
+}
+
+//~ Location Conversions
+
+MD_FUNCTION MD_CodeLoc
+MD_CodeLocFromFileOffset(MD_String8 filename, MD_u8 *base, MD_u64 offset)
+{
+    MD_CodeLoc loc;
+    loc.filename = filename;
+    loc.line = 1;
+    loc.column = 1;
+    if(base != 0)
+    {
+        MD_u8 *at = base + offset;
+        for(MD_u64 i = 0; base+i < at && base[i]; i += 1)
+        {
+            if(base[i] == '\n')
+            {
+                loc.line += 1;
+                loc.column = 1;
+            }
+            else
+            {
+                loc.column += 1;
+            }
+        }
+    }
+    return loc;
+}
+
+MD_FUNCTION MD_CodeLoc
+MD_CodeLocFromNode(MD_Node *node)
+{
+    MD_Node *file_root = MD_NilNode();
+    for(MD_Node *parent = node->parent; !MD_NodeIsNil(parent); parent = parent->parent)
+    {
+        if(parent->kind == MD_NodeKind_File)
+        {
+            file_root = parent;
+            break;
+        }
+    }
+    MD_Node *first_tag = file_root->first_tag;
+    MD_CodeLoc loc = {0};
+    if(MD_NodeIsNil(first_tag))
+    {
+        loc = MD_CodeLocFromFileOffset(file_root->string, file_root->raw_string.str, node->offset);
+    }
+    else
+    {
+        loc = MD_CodeLocFromFileOffset(file_root->string, first_tag->raw_string.str, node->offset);
+    }
+    return loc;
+}
+
+MD_FUNCTION MD_CodeLoc
+MD_CodeLocFromStreamOffset(MD_ParseStream *stream, MD_u64 offset)
+{
+    MD_CodeLoc loc;
+    loc.filename = stream->root->string;
+    loc.line = stream->window_line;
+    loc.column = stream->window_column;
+    if(offset > stream->window_offset)
+    {
+        MD_u64 size = MD_Min(offset - stream->window_offset, stream->window_size - stream->window_start);
+        MD_u8 *window = stream->window + stream->window_start;
+        for(MD_u64 i = 0; i < size; i += 1)
+        {
+            if(window[i] == '\n')
+            {
+                loc.line += 1;
+                loc.column = 1;
+            }
+            else
+            {
+                loc.column += 1;
+            }
+        }
+    }
+    return loc;
+}
+
+//~ Tree/List Building
+
+MD_FUNCTION MD_b32
+MD_NodeIsNil(MD_Node *node)
+{
+    return(node == 0 || node == &_md_nil_node || node->kind == MD_NodeKind_Nil);
+}
+
+MD_FUNCTION MD_Node *
+MD_NilNode(void) { return &_md_nil_node; }
+
+MD_FUNCTION MD_Node *
+MD_MakeNode(MD_Arena *arena, MD_NodeKind kind, MD_String8 string, MD_String8 raw_string,
+            MD_u64 offset)
+{
+    MD_Node *node = MD_PushArrayZero(arena, MD_Node, 1);
+    node->kind = kind;
+    node->string = string;
+    node->raw_string = raw_string;
+    node->next = node->prev = node->parent =
+        node->first_child = node->last_child =
+        node->first_tag = node->last_tag = node->ref_target = MD_NilNode();
+    node->offset = offset;
+    return node;
+}
+
+MD_FUNCTION void
+MD_PushChild(MD_Node *parent, MD_Node *new_child)
+{
+    if (!MD_NodeIsNil(new_child))
+    {
+        MD_NodeDblPushBack(parent->first_child, parent->last_child, new_child);
+        new_child->parent = parent;
+        parent->child_count += 1;
+    }
+}
+
+MD_FUNCTION void
+MD_PushTag(MD_Node *node, MD_Node *tag)
+{
+    if (!MD_NodeIsNil(tag))
+    {
+        MD_NodeDblPushBack(node->first_tag, node->last_tag, tag);
+        tag->parent = node;
+        node->tag_count += 1;
+    }
+}
+
+MD_FUNCTION MD_Node*
+MD_MakeList(MD_Arena *arena)
+{
+    MD_String8 empty = {0};
+    MD_Node *result = MD_MakeNode(arena, MD_NodeKind_List, empty, empty, 0);
+    return(result);
+}
+
+MD_FUNCTION void
+MD_ListConcatInPlace(MD_Node *list, MD_Node *to_push)
+{
+    if (!MD_NodeIsNil(to_push->first_child))
+    {
+        if (!MD_NodeIsNil(list->first_child))
+        {
+            list->last_child->next = to_push->first_child;
+            list->last_child = to_push->last_child;
+        }
+        else
+        {
+            list->first_child = to_push->first_child;
+            list->last_child = to_push->last_child;
+        }
+        list->child_count += to_push->child_count;
+        to_push->first_child = to_push->last_child = MD_NilNode();
+        to_push->child_count = 0;
+    }
+}
+
+MD_FUNCTION MD_Node*
+MD_PushNewReference(MD_Arena *arena, MD_Node *list, MD_Node *target)
+{
+    MD_Node *n = MD_MakeNode(arena, MD_NodeKind_Reference, target->string, target->raw_string,
+                             target->offset);
+    n->ref_target = target;
+    MD_PushChild(list, n);
+    return(n);
+}
+
+//~ Child Indices
+
+MD_FUNCTION MD_ChildIndex *
+MD_ChildIndexFromNode(MD_ChildIndexTable *table, MD_Node *node)
+{
+    MD_ChildIndex *result = 0;
+    MD_MapSlot *slot = MD_MapLookup(&table->map, MD_MapKeyPtr(node));
+    if(slot != 0)
+    {
+        result = (MD_ChildIndex *)slot->val;
+    }
+    return result;
+}
+
+// NOTE: a pushed child or tag changes the node's count, or its last node when
+// a list was rebuilt to the same length, so either check catches a stale array.
+static MD_ChildIndex *
+MD_CurrentChildArrayFromNode(MD_ChildIndexTable *table, MD_Node *node)
+{
+    MD_ChildIndex *index = MD_ChildIndexFromNode(table, node);
+    if(index != 0 && (index->child_count != node->child_count ||
+                      (index->child_count != 0 && index->children[index->child_count - 1] != node->last_child)))
+    {
+        index = 0;
+    }
+    return index;
+}
+
+static MD_ChildIndex *
+MD_CurrentTagArrayFromNode(MD_ChildIndexTable *table, MD_Node *node)
+{
+    MD_ChildIndex *index = MD_ChildIndexFromNode(table, node);
+    if(index != 0 && (index->tag_count != node->tag_count ||
+                      (index->tag_count != 0 && index->tags[index->tag_count - 1] != node->last_tag)))
+    {
+        index = 0;
+    }
+    return index;
+}
+
+MD_FUNCTION MD_ChildIndex *
+MD_BuildChildArray(MD_Arena *arena, MD_ChildIndexTable *table, MD_Node *node)
+{
+    MD_ChildIndex *index = 0;
+    if(!MD_NodeIsNil(node))
+    {
+        MD_Node *first_child = MD_FirstChildFromNode(node);
+        index = MD_PushArrayZero(arena, MD_ChildIndex, 1);
+        index->child_count = node->child_count;
+        index->tag_count = node->tag_count;
+        index->children = MD_PushArray(arena, MD_Node *, index->child_count);
+        index->tags = MD_PushArray(arena, MD_Node *, index->tag_count);
+        MD_u64 child_idx = 0;
+        for(MD_EachNode(child, first_child))
+        {
+            index->children[child_idx] = child;
+            child_idx += 1;
+        }
+        MD_u64 tag_idx = 0;
+        for(MD_EachNode(tag, node->first_tag))
+        {
+            index->tags[tag_idx] = tag;
+            tag_idx += 1;
+        }
+        
+        //- replace the node's old index, if it has one
+        if(table->map.bucket_count == 0)
+        {
+            table->map = MD_MapMake(arena);
+        }
+        MD_MapKey key = MD_MapKeyPtr(node);
+        MD_MapSlot *slot = MD_MapLookup(&table->map, key);
+        if(slot != 0)
+        {
+            slot->val = index;
+        }
+        else
+        {
+            MD_MapInsert(arena, &table->map, key, index);
+        }
+    }
+    return index;
+}
+
+MD_FUNCTION void
+MD_BuildChildArrays(MD_Arena *arena, MD_ChildIndexTable *table, MD_Node *root, MD_u64 min_child_count)
+{
+    MD_ArenaTemp scratch = MD_GetScratch(&arena, 1);
+    for(MD_NodeIter it = MD_NodeIterBegin(scratch.arena, root, MD_NodeIterFlags_Tree);
+        !MD_NodeIsNil(MD_NodeIterNext(&it));)
+    {
+        MD_Node *node = it.node;
+        if(MD_ChildCountFromNode(node) >= (MD_i64)min_child_count)
+        {
+            MD_BuildChildArray(arena, table, node);
+        }
+    }
+    MD_ReleaseScratch(scratch);
+}
+
+static MD_u64
+MD_ChildNameHash(MD_String8 string)
+{
+    MD_u64 result = 5381;
+    for(MD_u64 i = 0; i < string.size; i += 1)
+    {
+        result = ((result << 5) + result) + MD_CharToLower(string.str[i]);
+    }
+    return result;
+}
+
+MD_FUNCTION MD_ChildIndex *
+MD_BuildChildIndex(MD_Arena *arena, MD_ChildIndexTable *table, MD_Node *node)
+{
+    MD_ChildIndex *index = MD_BuildChildArray(arena, table, node);
+    if(index != 0)
+    {
+        MD_Map *names = MD_PushArrayZero(arena, MD_Map, 1);
+        *names = MD_MapMakeBucketCount(arena, index->child_count + index->child_count/2 + 1);
+        for(MD_u64 child_idx = 0; child_idx < index->child_count; child_idx += 1)
+        {
+            MD_Node *child = index->children[child_idx];
+            MD_MapKey key = MD_ZERO_STRUCT;
+            key.hash = MD_ChildNameHash(child->string);
+            key.size = child->string.size;
+            key.ptr = child->string.str;
+            MD_MapInsert(arena, names, key, child);
+        }
+        index->child_names = names;
+    }
+    return index;
+}
+
+MD_FUNCTION void
+MD_BuildChildIndices(MD_Arena *arena, MD_ChildIndexTable *table, MD_Node *root, MD_u64 min_child_count)
+{
+    MD_ArenaTemp scratch = MD_GetScratch(&arena, 1);
+    for(MD_NodeIter it = MD_NodeIterBegin(scratch.arena, root, MD_NodeIterFlags_Tree);
+        !MD_NodeIsNil(MD_NodeIterNext(&it));)
+    {
+        MD_Node *node = it.node;
+        if(MD_ChildCountFromNode(node) >= (MD_i64)min_child_count)
+        {
+            MD_BuildChildIndex(arena, table, node);
+        }
+    }
+    MD_ReleaseScratch(scratch);
+}
+
+MD_FUNCTION MD_Node *
+MD_IndexedChildFromIndex(MD_ChildIndexTable *table, MD_Node *node, int n)
+{
+    MD_Node *result = MD_NilNode();
+    MD_Node *first_child = MD_FirstChildFromNode(node);
+    MD_ChildIndex *index = MD_CurrentChildArrayFromNode(table, node);
+    if(index != 0)
+    {
+        if(0 <= n && (MD_u64)n < index->child_count)
+        {
+            result = index->children[n];
+        }
+    }
+    else
+    {
+        result = MD_NodeAtIndex(first_child, n);
+    }
+    return result;
+}
+
+MD_FUNCTION MD_Node *
+MD_IndexedTagFromIndex(MD_ChildIndexTable *table, MD_Node *node, int n)
+{
+    MD_Node *result = MD_NilNode();
+    MD_ChildIndex *index = MD_CurrentTagArrayFromNode(table, node);
+    if(index != 0)
+    {
+        if(0 <= n && (MD_u64)n < index->tag_count)
+        {
+            result = index->tags[n];
+        }
+    }
+    else
+    {
+        result = MD_NodeAtIndex(node->first_tag, n);
+    }
+    return result;
+}
+
+// NOTE: slots are kept in the order of the children, so the first one that
+// matches is the same child that walking the list would find.
+MD_FUNCTION MD_Node *
+MD_IndexedChildFromString(MD_ChildIndexTable *table, MD_Node *node, MD_String8 child_string, MD_MatchFlags flags)
+{
+    MD_Node *result = MD_NilNode();
+    MD_Node *first_child = MD_FirstChildFromNode(node);
+    MD_ChildIndex *index = MD_CurrentChildArrayFromNode(table, node);
+    if(index != 0 && index->child_names != 0 &&
+       (flags & (MD_StringMatchFlag_RightSideSloppy|MD_StringMatchFlag_SlashInsensitive)) == 0)
+    {
+        MD_Map *names = index->child_names;
+        MD_u64 hash = MD_ChildNameHash(child_string);
+        for(MD_MapSlot *slot = names->buckets[hash%names->bucket_count].first; slot != 0; slot = slot->next)
+        {
+            MD_Node *child = (MD_Node *)slot->val;
+            if(slot->key.hash == hash && MD_S8Match(child_string, child->string, flags))
+            {
+                result = child;
+                break;
+            }
+        }
+    }
+    else
+    {
+        result = MD_FirstNodeWithString(first_child, child_string, flags);
+    }
+    return result;
+}
+
+MD_FUNCTION MD_b32
+MD_IndexedNodeHasChild(MD_ChildIndexTable *table, MD_Node *node, MD_String8 string, MD_MatchFlags flags)
+{
+    return !MD_NodeIsNil(MD_IndexedChildFromString(table, node, string, flags));
+}
+
+//~ Tag Indices
+
+typedef struct MD_TagIndexRecord MD_TagIndexRecord;
+struct MD_TagIndexRecord
+{
+    MD_TagIndexRecord *next;
+    MD_TaggedNodes *tagged;
+    MD_Node *node;
+    MD_Node *tag;
+};
+
+MD_FUNCTION MD_TagIndex
+MD_TagIndexFromNode(MD_Arena *arena, MD_Node *root)
+{
+    MD_TagIndex result = MD_ZERO_STRUCT;
+    result.map = MD_MapMake(arena);
+    MD_ArenaTemp scratch = MD_GetScratch(&arena, 1);
+    
+    //- gather each node's tags, counting the nodes for each tag string
+    MD_TagIndexRecord *first_record = 0;
+    MD_TagIndexRecord *last_record = 0;
+    for(MD_NodeIter it = MD_NodeIterBegin(scratch.arena, root, MD_NodeIterFlags_Tree);
+        !MD_NodeIsNil(MD_NodeIterNext(&it));)
+    {
+        MD_Node *node = it.node;
+        for(MD_EachNode(tag, node->first_tag))
+        {
+            MD_MapKey key = MD_MapKeyStr(tag->string);
+            MD_MapSlot *slot = MD_MapLookup(&result.map, key);
+            MD_TaggedNodes *tagged = 0;
+            if(slot == 0)
+            {
+                tagged = MD_PushArrayZero(arena, MD_TaggedNodes, 1);
+                tagged->string = tag->string;
+                MD_QueuePush(result.first, result.last, tagged);
+                result.count += 1;
+                MD_MapInsert(arena, &result.map, key, tagged);
+            }
+            else
+            {
+                tagged = (MD_TaggedNodes *)slot->val;
+            }
             
-            // NOTE(allen): Identifiers, Numbers, Symbols
-            default:
+            // NOTE: like MD_NodeHasTag, a node with a tag repeated is found
+            // once, through the first of them.
+            if(MD_TagFromString(node, tag->string, 0) == tag)
             {
-                if (MD_CharIsAlpha(*at) || *at == '_')
-                {
-                    token.node_flags |= MD_NodeFlag_Identifier;
-                    token.kind = MD_TokenKind_Identifier;
-                    at += 1;
-                    MD_TokenizerScan(MD_CharIsAlpha(*at) || MD_CharIsDigit(*at) || *at == '_');
-                }
-                
-                else if (MD_CharIsDigit(*at))
-                {
-                    token.node_flags |= MD_NodeFlag_Numeric;
-                    token.kind = MD_TokenKind_Numeric;
-                    at += 1;
-                    
-                    for (; at < one_past_last;)
-                    {
-                        MD_b32 good = 0;
-                        if (*at == 'e' || *at == 'E')
-                        {
-                            good = 1;
-                            at += 1;
-                            if (at < one_past_last && (*at == '+' || *at == '-'))
-                            {
-                                at += 1;
-                            }
-                        }
-                        else if (MD_CharIsAlpha(*at) || MD_CharIsDigit(*at) || *at == '.' || *at == '_')
-                        {
-                            good = 1;
-                            at += 1;
-                        }
-                        if (!good)
-                        {
-                            break;
-                        }
-                    }
-                }
-                
-                else if (MD_CharIsUnreservedSymbol(*at))
-                {
-                    symbol_lex:
-                    
-                    token.node_flags |= MD_NodeFlag_Symbol;
-                    token.kind = MD_TokenKind_Symbol;
-                    at += 1;
-                    MD_TokenizerScan(MD_CharIsUnreservedSymbol(*at));
-                }
-                
-                else if (MD_CharIsReservedSymbol(*at))
-                {
-                    token.kind = MD_TokenKind_Reserved;
-                    at += 1;
-                }
-                
-                else
-                {
-                    token.kind = MD_TokenKind_BadCharacter;
-                    at += 1;
-                }
-            }break;
+                MD_TagIndexRecord *record = MD_PushArray(scratch.arena, MD_TagIndexRecord, 1);
+                record->next = 0;
+                record->tagged = tagged;
+                record->node = node;
+                record->tag = tag;
+                MD_QueuePush(first_record, last_record, record);
+                tagged->count += 1;
+            }
         }
-        
-        token.raw_string = MD_S8Range(first, at);
-        token.string = MD_S8Substring(token.raw_string, skip_n, token.raw_string.size - chop_n);
-        
-#undef MD_TokenizerScan
-        
     }
-    
-    return token;
+    
+    //- lay out the nodes of each tag string contiguously
+    for(MD_TaggedNodes *tagged = result.first; tagged != 0; tagged = tagged->next)
+    {
+        tagged->nodes = MD_PushArray(arena, MD_Node *, tagged->count);
+        tagged->tags = MD_PushArray(arena, MD_Node *, tagged->count);
+        tagged->count = 0;
+    }
+    for(MD_TagIndexRecord *record = first_record; record != 0; record = record->next)
+    {
+        MD_TaggedNodes *tagged = record->tagged;
+        tagged->nodes[tagged->count] = record->node;
+        tagged->tags[tagged->count] = record->tag;
+        tagged->count += 1;
+    }
+    
+    MD_ReleaseScratch(scratch);
+    return result;
+}
+
+MD_FUNCTION MD_TaggedNodes
+MD_TaggedNodesFromString(MD_TagIndex *index, MD_String8 tag_string)
+{
+    MD_TaggedNodes result = MD_ZERO_STRUCT;
+    MD_MapSlot *slot = MD_MapLookup(&index->map, MD_MapKeyStr(tag_string));
+    if(slot != 0)
+    {
+        result = *(MD_TaggedNodes *)slot->val;
+    }
+    return result;
+}
+
+//~ Introspection Helpers
+
+MD_FUNCTION MD_Node *
+MD_FirstNodeWithString(MD_Node *first, MD_String8 string, MD_MatchFlags flags)
+{
+    MD_Node *result = MD_NilNode();
+    for(MD_Node *node = first; !MD_NodeIsNil(node); node = node->next)
+    {
+        if(MD_S8Match(string, node->string, flags))
+        {
+            result = node;
+            break;
+        }
+    }
+    return result;
+}
+
+MD_FUNCTION MD_Node *
+MD_NodeAtIndex(MD_Node *first, int n)
+{
+    MD_Node *result = MD_NilNode();
+    if(n >= 0)
+    {
+        int idx = 0;
+        for(MD_Node *node = first; !MD_NodeIsNil(node); node = node->next, idx += 1)
+        {
+            if(idx == n)
+            {
+                result = node;
+                break;
+            }
+        }
+    }
+    return result;
+}
+
+MD_FUNCTION MD_Node *
+MD_FirstNodeWithFlags(MD_Node *first, MD_NodeFlags flags)
+{
+    MD_Node *result = MD_NilNode();
+    for(MD_Node *n = first; !MD_NodeIsNil(n); n = n->next)
+    {
+        if(n->flags & flags)
+        {
+            result = n;
+            break;
+        }
+    }
+    return result;
+}
+
+MD_FUNCTION int
+MD_IndexFromNode(MD_Node *node)
+{
+    int idx = 0;
+    for(MD_Node *last = node->prev; !MD_NodeIsNil(last); last = last->prev, idx += 1);
+    return idx;
+}
+
+MD_FUNCTION MD_Node *
+MD_RootFromNode(MD_Node *node)
+{
+    MD_Node *parent = node;
+    for(MD_Node *p = parent; !MD_NodeIsNil(p); p = p->parent)
+    {
+        parent = p;
+    }
+    return parent;
+}
+
+MD_FUNCTION MD_Node *
+MD_FirstChildFromNode(MD_Node *node)
+{
+    MD_ParseLazyChildrenFromNode(node, 1);
+    return node->first_child;
+}
+
+MD_FUNCTION MD_Node *
+MD_ChildFromString(MD_Node *node, MD_String8 child_string, MD_MatchFlags flags)
+{
+    return MD_FirstNodeWithString(MD_FirstChildFromNode(node), child_string, flags);
+}
+
+MD_FUNCTION MD_Node *
+MD_TagFromString(MD_Node *node, MD_String8 tag_string, MD_MatchFlags flags)
+{
+    return MD_FirstNodeWithString(node->first_tag, tag_string, flags);
+}
+
+MD_FUNCTION MD_Node *
+MD_ChildFromIndex(MD_Node *node, int n)
+{
+    return MD_NodeAtIndex(MD_FirstChildFromNode(node), n);
+}
+
+MD_FUNCTION MD_Node *
+MD_TagFromIndex(MD_Node *node, int n)
+{
+    return MD_NodeAtIndex(node->first_tag, n);
+}
+
+MD_FUNCTION MD_Node *
+MD_TagArgFromIndex(MD_Node *node, MD_String8 tag_string, MD_MatchFlags flags, int n)
+{
+    MD_Node *tag = MD_TagFromString(node, tag_string, flags);
+    return MD_ChildFromIndex(tag, n);
+}
+
+MD_FUNCTION MD_Node *
+MD_TagArgFromString(MD_Node *node, MD_String8 tag_string, MD_MatchFlags tag_str_flags, MD_String8 arg_string, MD_MatchFlags arg_str_flags)
+{
+    MD_Node *tag = MD_TagFromString(node, tag_string, tag_str_flags);
+    MD_Node *arg = MD_ChildFromString(tag, arg_string, arg_str_flags);
+    return arg;
+}
+
+MD_FUNCTION MD_b32
+MD_NodeHasChild(MD_Node *node, MD_String8 string, MD_MatchFlags flags)
+{
+    return !MD_NodeIsNil(MD_ChildFromString(node, string, flags));
+}
+
+MD_FUNCTION MD_b32
+MD_NodeHasTag(MD_Node *node, MD_String8 string, MD_MatchFlags flags)
+{
+    return !MD_NodeIsNil(MD_TagFromString(node, string, flags));
+}
+
+// NOTE: interned strings are compared by pointer, like MD_SymbolFromNode.
+MD_FUNCTION MD_Node *
+MD_FirstNodeWithSymbol(MD_SymbolTable *table, MD_Node *first, MD_u32 symbol)
+{
+    MD_Node *result = MD_NilNode();
+    MD_String8 string = MD_StringFromSymbol(table, symbol);
+    if(string.size != 0)
+    {
+        for(MD_Node *node = first; !MD_NodeIsNil(node); node = node->next)
+        {
+            if(node->string.str == string.str && node->string.size == string.size)
+            {
+                result = node;
+                break;
+            }
+        }
+    }
+    return result;
+}
+
+MD_FUNCTION MD_Node *
+MD_ChildFromSymbol(MD_SymbolTable *table, MD_Node *node, MD_u32 symbol)
+{
+    return MD_FirstNodeWithSymbol(table, MD_FirstChildFromNode(node), symbol);
+}
+
+MD_FUNCTION MD_Node *
+MD_TagFromSymbol(MD_SymbolTable *table, MD_Node *node, MD_u32 symbol)
+{
+    return MD_FirstNodeWithSymbol(table, node->first_tag, symbol);
+}
+
+MD_FUNCTION MD_b32
+MD_NodeHasChildSymbol(MD_SymbolTable *table, MD_Node *node, MD_u32 symbol)
+{
+    return !MD_NodeIsNil(MD_ChildFromSymbol(table, node, symbol));
+}
+
+MD_FUNCTION MD_b32
+MD_NodeHasTagSymbol(MD_SymbolTable *table, MD_Node *node, MD_u32 symbol)
+{
+    return !MD_NodeIsNil(MD_TagFromSymbol(table, node, symbol));
+}
+
+MD_FUNCTION MD_i64
+MD_ChildCountFromNode(MD_Node *node)
+{
+    MD_FirstChildFromNode(node);
+    return node->child_count;
+}
+
+MD_FUNCTION MD_i64
+MD_TagCountFromNode(MD_Node *node)
+{
+    return node->tag_count;
+}
+
+MD_FUNCTION MD_Node *
+MD_ResolveNodeFromReference(MD_Node *node)
+{
+    MD_u64 safety = 100;
+    for(; safety > 0 && node->kind == MD_NodeKind_Reference;
+        safety -= 1, node = node->ref_target);
+    MD_Node *result = node;
+    return(result);
+}
+
+MD_FUNCTION MD_Node*
+MD_NodeNextWithLimit(MD_Node *node, MD_Node *opl)
+{
+    node = node->next;
+    if (node == opl)
+    {
+        node = MD_NilNode();
+    }
+    return(node);
 }
 
-MD_FUNCTION MD_u64
-MD_LexAdvanceFromSkips(MD_String8 string, MD_TokenKind skip_kinds)
+MD_FUNCTION MD_String8
+MD_PrevCommentFromNode(MD_Node *node)
 {
-    MD_u64 result = string.size;
-    MD_u64 p = 0;
-    for (;;)
+    return(node->prev_comment);
+}
+
+MD_FUNCTION MD_String8
+MD_NextCommentFromNode(MD_Node *node)
+{
+    return(node->next_comment);
+}
+
+//~ Node Iterators
+
+// NOTE: the children of a tag are its arguments, except at the root, where
+// they are what the walk was asked for.
+static MD_Node *
+MD_NodeIterFirstChild(MD_NodeIter *it, MD_Node *node)
+{
+    MD_Node *result = MD_NilNode();
+    MD_NodeIterFlags flag = ((node->kind == MD_NodeKind_Tag && node != it->root) ?
+                             MD_NodeIterFlag_TagArguments : MD_NodeIterFlag_Children);
+    if(it->flags & flag)
     {
-        MD_Token token = MD_TokenFromString(MD_S8Skip(string, p));
-        if ((skip_kinds & token.kind) == 0)
+        result = MD_FirstChildFromNode(node);
+    }
+    return result;
+}
+
+// NOTE: a list is entered from `owner`. When its nodes name another parent
+// (the list is shared, and owner is not its first holder), owner is pushed so
+// that leaving the list can return to it.
+static void
+MD_NodeIterEnterList(MD_NodeIter *it, MD_Node *owner, MD_Node *first, int depth)
+{
+    if(first->parent != owner)
+    {
+        MD_NodeIterFrame *frame = it->free_frame;
+        if(frame != 0)
         {
-            result = p;
-            break;
+            it->free_frame = frame->next;
         }
-        p += token.raw_string.size;
+        else
+        {
+            frame = MD_PushArray(it->arena, MD_NodeIterFrame, 1);
+        }
+        frame->owner = owner;
+        frame->depth = depth;
+        frame->next = it->top;
+        it->top = frame;
     }
-    return(result);
 }
 
-MD_FUNCTION MD_ParseResult
-MD_ParseResultZero(void)
+static void
+MD_NodeIterLeaveList(MD_NodeIter *it, int depth)
 {
-    MD_ParseResult result = MD_ZERO_STRUCT;
-    result.node = MD_NilNode();
+    MD_NodeIterFrame *frame = it->top;
+    if(frame != 0 && frame->depth == depth)
+    {
+        it->top = frame->next;
+        frame->next = it->free_frame;
+        it->free_frame = frame;
+    }
+}
+
+MD_FUNCTION MD_NodeIter
+MD_NodeIterBegin(MD_Arena *arena, MD_Node *root, MD_NodeIterFlags flags)
+{
+    MD_NodeIter result = MD_ZERO_STRUCT;
+    result.arena = arena;
+    result.root = root;
+    result.flags = flags;
+    if(!(flags & (MD_NodeIterFlag_PreOrder|MD_NodeIterFlag_PostOrder)))
+    {
+        result.flags |= MD_NodeIterFlag_PreOrder;
+    }
     return result;
 }
 
-MD_FUNCTION MD_ParseResult
-MD_ParseNodeSet(MD_Arena *arena, MD_String8 string, MD_u64 offset, MD_Node *parent,
-                MD_ParseSetRule rule)
+MD_FUNCTION MD_Node *
+MD_NodeIterNext(MD_NodeIter *it)
 {
-    MD_ParseResult result = MD_ParseResultZero();
-    MD_u64 off = offset;
-    
-    //- rjf: fill data from set opener
-    MD_Token initial_token = MD_TokenFromString(MD_S8Skip(string, offset));
-    MD_u8 set_opener = 0;
-    MD_NodeFlags set_opener_flags = 0;
-    MD_b32 close_with_brace = 0;
-    MD_b32 close_with_paren = 0;
-    MD_b32 close_with_separator = 0;
-    MD_b32 parse_all = 0;
-    switch(rule)
+    MD_Node *node = it->node;
+    MD_b32 leaving = it->leaving;
+    MD_b32 skip = it->skip;
+    int depth = it->depth;
+    for(;;)
     {
-        default: break;
-        
-        case MD_ParseSetRule_EndOnDelimiter:
+        //- step to the next visit
+        if(node == 0)
+        {
+            node = it->root;
+        }
+        else if(MD_NodeIsNil(node))
+        {
+            break;
+        }
+        else if(!leaving)
         {
-            MD_u64 opener_check_off = off;
-            opener_check_off += MD_LexAdvanceFromSkips(MD_S8Skip(string, opener_check_off), MD_TokenGroup_Irregular);
-            initial_token = MD_TokenFromString(MD_S8Skip(string, opener_check_off));
-            if(initial_token.kind == MD_TokenKind_Reserved)
+            MD_Node *below = MD_NilNode();
+            if(!skip)
             {
-                MD_u8 c = initial_token.raw_string.str[0];
-                if(c == '{')
+                if(it->flags & MD_NodeIterFlag_Tags)
                 {
-                    set_opener = '{';
-                    set_opener_flags |= MD_NodeFlag_HasBraceLeft;
-                    opener_check_off += initial_token.raw_string.size;
-                    off = opener_check_off;
-                    close_with_brace = 1;
+                    below = node->first_tag;
                 }
-                else if(c == '(')
+                if(MD_NodeIsNil(below))
                 {
-                    set_opener = '(';
-                    set_opener_flags |= MD_NodeFlag_HasParenLeft;
-                    opener_check_off += initial_token.raw_string.size;
-                    off = opener_check_off;
-                    close_with_paren = 1;
-                }
-                else if(c == '[')
-                {
-                    set_opener = '[';
-                    set_opener_flags |= MD_NodeFlag_HasBracketLeft;
-                    opener_check_off += initial_token.raw_string.size;
-                    off = opener_check_off;
-                    close_with_paren = 1;
-                }
-                else
-                {
-                    close_with_separator = 1;
+                    below = MD_NodeIterFirstChild(it, node);
                 }
             }
+            if(!MD_NodeIsNil(below))
+            {
+                depth += 1;
+                MD_NodeIterEnterList(it, node, below, depth);
+                node = below;
+            }
             else
             {
-                close_with_separator = 1;
+                leaving = 1;
             }
-        }break;
+        }
+        else if(node == it->root)
+        {
+            node = MD_NilNode();
+        }
+        else
+        {
+            MD_Node *parent = node->parent;
+            if(it->top != 0 && it->top->depth == depth)
+            {
+                parent = it->top->owner;
+            }
+            MD_Node *first_child = MD_NilNode();
+            if(MD_NodeIsNil(node->next) && node == parent->last_tag)
+            {
+                first_child = MD_NodeIterFirstChild(it, parent);
+            }
+            if(!MD_NodeIsNil(node->next))
+            {
+                node = node->next;
+                leaving = 0;
+            }
+            else if(!MD_NodeIsNil(first_child))
+            {
+                MD_NodeIterLeaveList(it, depth);
+                MD_NodeIterEnterList(it, parent, first_child, depth);
+                node = first_child;
+                leaving = 0;
+            }
+            else
+            {
+                MD_NodeIterLeaveList(it, depth);
+                node = parent;
+                depth -= 1;
+            }
+        }
         
-        case MD_ParseSetRule_Global:
+        //- stop at visits of the kind asked for
+        MD_NodeIterFlags order = leaving ? MD_NodeIterFlag_PostOrder : MD_NodeIterFlag_PreOrder;
+        if(MD_NodeIsNil(node) || (it->flags & order))
         {
-            parse_all = 1;
-        }break;
+            break;
+        }
+        skip = 0;
     }
-    
-    //- rjf: fill parent data from opener
-    parent->flags |= set_opener_flags;
-    
-    //- rjf: parse children
-    MD_b32 got_closer = 0;
-    MD_u64 parsed_child_count = 0;
-    if(set_opener != 0 || close_with_separator || parse_all)
+    it->node = node;
+    it->leaving = leaving;
+    it->skip = 0;
+    it->depth = depth;
+    return node;
+}
+
+MD_FUNCTION void
+MD_NodeIterSkipSubtree(MD_NodeIter *it)
+{
+    it->skip = 1;
+}
+
+//- Parallel visits
+//
+// MD_ParallelVisit splits the tree into runs of sibling subtrees on the
+// calling thread, visiting the nodes above them as it goes, and hands the
+// runs out on MD_WorkDeques. Child counts stand in for subtree sizes: the run
+// or node with the most children is split next, and each thread starts on
+// neighboring runs with about the same total, which keeps a thread's nodes
+// close together in memory.
+
+#if !defined(MD_PARALLEL_VISIT_RUNS_PER_THREAD)
+# define MD_PARALLEL_VISIT_RUNS_PER_THREAD 16
+#endif
+
+typedef struct MD_ParallelVisitRun MD_ParallelVisitRun;
+struct MD_ParallelVisitRun
+{
+    MD_Node *first;
+    MD_u64 count;
+};
+
+typedef struct MD_ParallelVisitTask MD_ParallelVisitTask;
+struct MD_ParallelVisitTask
+{
+    MD_Arena *shared_arena;
+    MD_u64 thread_idx;
+    MD_u64 thread_count;
+    MD_WorkDeque *deques;
+    MD_ParallelVisitRun *runs;
+    MD_ParallelVisitFunc *callback;
+    void *user_data;
+};
+
+static MD_u64
+MD_ParallelVisitRunSize(MD_ParallelVisitRun *run)
+{
+    MD_u64 result = run->count;
+    if(run->count == 1)
     {
-        MD_NodeFlags next_child_flags = 0;
-        for(;off < string.size;)
+        result = (MD_u64)MD_ChildCountFromNode(run->first);
+    }
+    return result;
+}
+
+static void
+MD_ParallelVisitTaskRun(void *params)
+{
+    MD_ParallelVisitTask *task = (MD_ParallelVisitTask*)params;
+    MD_ArenaTemp scratch = MD_GetScratch(&task->shared_arena, 1);
+    for(;;)
+    {
+        MD_u32 run_idx = 0;
+        if(!MD_WorkDequesTake(task->deques, task->thread_idx, task->thread_count, &run_idx))
         {
-            
-            //- rjf: check for separator closers
-            if(close_with_separator)
+            break;
+        }
+        MD_ParallelVisitRun *run = &task->runs[run_idx];
+        MD_Node *subtree = run->first;
+        for(MD_u64 subtree_idx = 0; subtree_idx < run->count; subtree_idx += 1, subtree = subtree->next)
+        {
+            MD_ArenaTemp walk = MD_ArenaBeginTemp(scratch.arena);
+            MD_NodeIter it = MD_NodeIterBegin(scratch.arena, subtree, MD_NodeIterFlag_Children);
+            for(;!MD_NodeIsNil(MD_NodeIterNext(&it));)
             {
-                MD_u64 closer_check_off = off;
-                
-                //- rjf: check newlines
-                {
-                    MD_Token potential_closer = MD_TokenFromString(MD_S8Skip(string, closer_check_off));
-                    if(potential_closer.kind == MD_TokenKind_Newline)
-                    {
-                        closer_check_off += potential_closer.raw_string.size;
-                        // TODO(rjf): As far as I can tell, we can't actually do this,
-                        // because higher-level unscoped sets may depend on this newline
-                        // so they can be terminated.
-                        // off = closer_check_off;
-                        
-                        // NOTE(rjf): always terminate with a newline if we have >0 children
-                        if(parsed_child_count > 0)
-                        {
-                            // TODO(rjf): As far as I can tell, we can't actually do this,
-                            // because higher-level unscoped sets may depend on this newline
-                            // so they can be terminated.
-                            // off = closer_check_off;
-                            got_closer = 1;
-                            break;
-                        }
-                        
-                        // NOTE(rjf): terminate after double newline if we have 0 children
-                        MD_Token next_closer = MD_TokenFromString(MD_S8Skip(string, closer_check_off));
-                        if(next_closer.kind == MD_TokenKind_Newline)
-                        {
-                            closer_check_off += next_closer.raw_string.size;
-                            off = closer_check_off;
-                            got_closer = 1;
-                            break;
-                        }
-                    }
-                }
-                
-                //- rjf: check separators and possible braces from higher parents
-                {
-                    closer_check_off += MD_LexAdvanceFromSkips(MD_S8Skip(string, off), MD_TokenGroup_Irregular);
-                    MD_Token potential_closer = MD_TokenFromString(MD_S8Skip(string, closer_check_off));
-                    if(potential_closer.kind == MD_TokenKind_Reserved)
-                    {
-                        MD_u8 c = potential_closer.raw_string.str[0];
-                        if(c == ',' || c == ';')
-                        {
-                            off = closer_check_off;
-                            closer_check_off += potential_closer.raw_string.size;
-                            break;
-                        }
-                        else if(c == '}' || c == ']'|| c == ')')
-                        {
-                            goto end_parse;
-                        }
-                    }
-                }
-                
+                MD_ArenaTemp temp = MD_ArenaBeginTemp(scratch.arena);
+                task->callback(task->user_data, it.node, task->thread_idx, scratch.arena);
+                MD_ArenaEndTemp(temp);
             }
-            
-            //- rjf: check for non-separator closers
-            if(!close_with_separator && !parse_all)
+            MD_ArenaEndTemp(walk);
+        }
+    }
+    MD_ReleaseScratch(scratch);
+}
+
+MD_FUNCTION void
+MD_ParallelVisit(MD_Node *root, MD_ParallelVisitFunc *callback, void *user_data, MD_u64 thread_count)
+{
+    if(!MD_NodeIsNil(root))
+    {
+        MD_ArenaTemp scratch = MD_GetScratch(0, 0);
+#if !defined(MD_IMPL_AtomicCompareExchangeU64)
+        thread_count = 1;
+#endif
+        thread_count = MD_ClampBot(1, thread_count);
+        
+        //- split until there are enough runs to balance the threads
+        // NOTE: a node is split into one run of all of its children, and a
+        // run into pieces of neighboring siblings, so the runs never outnumber
+        // the target. Splitting a chain of single children makes no new runs,
+        // so the number of splits is bounded too.
+        MD_u64 target_count = (thread_count > 1 ? thread_count*MD_PARALLEL_VISIT_RUNS_PER_THREAD : 1);
+        MD_u64 run_count = 1;
+        MD_ParallelVisitRun *runs = MD_PushArrayZero(scratch.arena, MD_ParallelVisitRun, target_count);
+        runs[0].first = root;
+        runs[0].count = 1;
+        for(MD_u64 split_idx = 0; run_count < target_count && split_idx < 2*target_count; split_idx += 1)
+        {
+            MD_u64 best_idx = 0;
+            MD_u64 best_size = 0;
+            for(MD_u64 run_idx = 0; run_idx < run_count; run_idx += 1)
             {
-                MD_u64 closer_check_off = off;
-                closer_check_off += MD_LexAdvanceFromSkips(MD_S8Skip(string, off), MD_TokenGroup_Irregular);
-                MD_Token potential_closer = MD_TokenFromString(MD_S8Skip(string, closer_check_off));
-                if(potential_closer.kind == MD_TokenKind_Reserved)
+                MD_u64 size = MD_ParallelVisitRunSize(&runs[run_idx]);
+                if(size > best_size)
                 {
-                    MD_u8 c = potential_closer.raw_string.str[0];
-                    if(close_with_brace && c == '}')
-                    {
-                        closer_check_off += potential_closer.raw_string.size;
-                        off = closer_check_off;
-                        parent->flags |= MD_NodeFlag_HasBraceRight;
-                        got_closer = 1;
-                        break;
-                    }
-                    else if(close_with_paren && c == ']')
-                    {
-                        closer_check_off += potential_closer.raw_string.size;
-                        off = closer_check_off;
-                        parent->flags |= MD_NodeFlag_HasBracketRight;
-                        got_closer = 1;
-                        break;
-                    }
-                    else if(close_with_paren && c == ')')
-                    {
-                        closer_check_off += potential_closer.raw_string.size;
-                        off = closer_check_off;
-                        parent->flags |= MD_NodeFlag_HasParenRight;
-                        got_closer = 1;
-                        break;
-                    }
+                    best_idx = run_idx;
+                    best_size = size;
                 }
             }
+            if(best_size == 0)
+            {
+                break;
+            }
             
-            //- rjf: parse next child
-            MD_ParseResult child_parse = MD_ParseOneNode(arena, string, off);
-            MD_MessageListConcat(&result.errors, &child_parse.errors);
-            off += child_parse.string_advance;
+            MD_ParallelVisitRun *run = &runs[best_idx];
             
-            //- rjf: hook child into parent
-            if(!MD_NodeIsNil(child_parse.node))
-            {
-                // NOTE(rjf): @error No unnamed set children of implicitly-delimited sets
-                if(close_with_separator &&
-                   child_parse.node->string.size == 0 &&
-                   child_parse.node->flags & (MD_NodeFlag_HasParenLeft    |
-                                              MD_NodeFlag_HasParenRight   |
-                                              MD_NodeFlag_HasBracketLeft  |
-                                              MD_NodeFlag_HasBracketRight |
-                                              MD_NodeFlag_HasBraceLeft    |
-                                              MD_NodeFlag_HasBraceRight   ))
-                {
-                    MD_String8 error_str = MD_S8Lit("Unnamed set children of implicitly-delimited sets are not legal.");
-                    MD_Message *error = MD_MakeNodeError(arena, child_parse.node, MD_MessageKind_Warning,
-                                                         error_str);
-                    MD_MessageListPush(&result.errors, error);
-                }
-                
-                MD_PushChild(parent, child_parse.node);
-                parsed_child_count += 1;
+            //- visit a lone node here, and replace it with its children
+            if(run->count == 1)
+            {
+                MD_Node *node = run->first;
+                MD_ArenaTemp temp = MD_GetScratch(&scratch.arena, 1);
+                callback(user_data, node, 0, temp.arena);
+                MD_ReleaseScratch(temp);
+                run->first = MD_FirstChildFromNode(node);
+                run->count = (MD_u64)node->child_count;
             }
             
-            //- rjf: check trailing separator
-            MD_NodeFlags trailing_separator_flags = 0;
-            if(!close_with_separator)
+            //- cut a run into pieces, keeping them in document order
+            else
             {
-                off += MD_LexAdvanceFromSkips(MD_S8Skip(string, off), MD_TokenGroup_Irregular);
-                MD_Token trailing_separator = MD_TokenFromString(MD_S8Skip(string, off));
-                if (trailing_separator.kind == MD_TokenKind_Reserved)
+                MD_u64 piece_count = MD_Min(run->count, target_count - run_count + 1);
+                MD_MemoryCopy(runs + best_idx + piece_count, runs + best_idx + 1,
+                              sizeof(MD_ParallelVisitRun)*(run_count - best_idx - 1));
+                MD_Node *first = run->first;
+                MD_u64 count = run->count;
+                for(MD_u64 piece_idx = 0; piece_idx < piece_count; piece_idx += 1)
                 {
-                    MD_u8 c = trailing_separator.string.str[0];
-                    if(c == ',')
-                    {
-                        trailing_separator_flags |= MD_NodeFlag_IsBeforeComma;
-                        off += trailing_separator.raw_string.size;
-                    }
-                    else if(c == ';')
+                    MD_u64 piece_size = (count*(piece_idx + 1))/piece_count - (count*piece_idx)/piece_count;
+                    runs[best_idx + piece_idx].first = first;
+                    runs[best_idx + piece_idx].count = piece_size;
+                    for(MD_u64 idx = 0; idx < piece_size; idx += 1)
                     {
-                        trailing_separator_flags |= MD_NodeFlag_IsBeforeSemicolon;
-                        off += trailing_separator.raw_string.size;
+                        first = first->next;
                     }
                 }
+                run_count += piece_count - 1;
             }
-            
-            //- rjf: fill child flags
-            child_parse.node->flags |= next_child_flags | trailing_separator_flags;
-            
-            //- rjf: setup next_child_flags
-            next_child_flags = MD_NodeFlag_AfterFromBefore(trailing_separator_flags);
         }
+        
+        //- hand out neighboring runs; this thread takes the first
+        MD_u64 *sizes = MD_PushArray(scratch.arena, MD_u64, run_count);
+        for(MD_u64 run_idx = 0; run_idx < run_count; run_idx += 1)
+        {
+            sizes[run_idx] = 1 + MD_ParallelVisitRunSize(&runs[run_idx]);
+        }
+        thread_count = MD_Min(thread_count, run_count);
+        MD_WorkDeque *deques = MD_WorkDequesFromSizes(scratch.arena, sizes, run_count, thread_count);
+        MD_ParallelVisitTask *tasks = MD_PushArrayZero(scratch.arena, MD_ParallelVisitTask, thread_count);
+        MD_ThreadJob *jobs = MD_PushArrayZero(scratch.arena, MD_ThreadJob, thread_count);
+        for(MD_u64 thread_idx = 0; thread_idx < thread_count; thread_idx += 1)
+        {
+            tasks[thread_idx].shared_arena = scratch.arena;
+            tasks[thread_idx].thread_idx = thread_idx;
+            tasks[thread_idx].thread_count = thread_count;
+            tasks[thread_idx].deques = deques;
+            tasks[thread_idx].runs = runs;
+            tasks[thread_idx].callback = callback;
+            tasks[thread_idx].user_data = user_data;
+        }
+        for(MD_u64 thread_idx = 1; thread_idx < thread_count; thread_idx += 1)
+        {
+            MD_ThreadJobLaunch(&jobs[thread_idx], MD_ParallelVisitTaskRun, &tasks[thread_idx]);
+        }
+        MD_ParallelVisitTaskRun(&tasks[0]);
+        for(MD_u64 thread_idx = 1; thread_idx < thread_count; thread_idx += 1)
+        {
+            MD_ThreadJobJoin(&jobs[thread_idx]);
+        }
+        
+        MD_ReleaseScratch(scratch);
+    }
+}
+
+//~ Error/Warning Helpers
+
+MD_FUNCTION MD_String8
+MD_StringFromMessageKind(MD_MessageKind kind)
+{
+    MD_String8 result = MD_ZERO_STRUCT;
+    switch (kind)
+    {
+        default: break;
+        case MD_MessageKind_Note:       result = MD_S8Lit("note");        break;
+        case MD_MessageKind_Warning:    result = MD_S8Lit("warning");     break;
+        case MD_MessageKind_Error:      result = MD_S8Lit("error");       break;
+        case MD_MessageKind_FatalError: result = MD_S8Lit("fatal error"); break;
+    }
+    return(result);
+}
+
+MD_FUNCTION MD_String8
+MD_FormatMessage(MD_Arena *arena, MD_CodeLoc loc, MD_MessageKind kind, MD_String8 string)
+{
+    MD_String8 kind_string = MD_StringFromMessageKind(kind);
+    MD_String8 result = MD_S8Fmt(arena, "" MD_FmtCodeLoc " %.*s: %.*s\n",
+                                 MD_CodeLocVArg(loc), MD_S8VArg(kind_string), MD_S8VArg(string));
+    return(result);
+}
+
+#if !MD_DISABLE_PRINT_HELPERS
+
+MD_FUNCTION void
+MD_PrintMessage(FILE *file, MD_CodeLoc code_loc, MD_MessageKind kind, MD_String8 string)
+{
+    MD_ArenaTemp scratch = MD_GetScratch(0, 0);
+    MD_String8 message = MD_FormatMessage(scratch.arena, code_loc, kind, string);
+    fwrite(message.str, message.size, 1, file);
+    MD_ReleaseScratch(scratch);
+}
+
+MD_FUNCTION void
+MD_PrintMessageFmt(FILE *file, MD_CodeLoc code_loc, MD_MessageKind kind, char *fmt, ...)
+{
+    MD_ArenaTemp scratch = MD_GetScratch(0, 0);
+    va_list args;
+    va_start(args, fmt);
+    MD_String8 string = MD_S8FmtV(scratch.arena, fmt, args);
+    va_end(args);
+    MD_String8 message = MD_FormatMessage(scratch.arena, code_loc, kind, string);
+    fwrite(message.str, message.size, 1, file);
+    MD_ReleaseScratch(scratch);
+}
+
+#endif
+
+//~ Tree Comparison/Verification
+
+static MD_u64
+MD_HashCombine(MD_u64 h, MD_u64 x)
+{
+    h = (h ^ x) * 0xbf58476d1ce4e5b9;
+    h = h ^ (h >> 31);
+    return h;
+}
+
+// NOTE: strings are hashed with case and slashes folded, so that equal hashes
+// follow from a match with any of the string match flags but sloppiness.
+static MD_u64
+MD_HashNodeLocal(MD_Node *node, MD_MatchFlags flags)
+{
+    MD_u64 h = MD_HashCombine(0x9e3779b97f4a7c15, node->kind);
+    for(MD_u64 i = 0; i < node->string.size; i += 1)
+    {
+        h = MD_HashCombine(h, MD_CharToForwardSlash(MD_CharToLower(node->string.str[i])));
     }
-    end_parse:;
-    
-    //- rjf: push missing closer error, if we have one
-    if(set_opener != 0 && got_closer == 0)
+    h = MD_HashCombine(h, node->string.size);
+    if(flags & MD_NodeMatchFlag_NodeFlags)
     {
-        // NOTE(rjf): @error We didn't get a closer for the set
-        MD_String8 error_str = MD_S8Fmt(arena, "Unbalanced \"%c\"", set_opener);
-        MD_Message *error = MD_MakeTokenError(arena, string, initial_token,
-                                              MD_MessageKind_FatalError, error_str);
-        MD_MessageListPush(&result.errors, error);
+        h = MD_HashCombine(h, node->flags);
     }
-    
-    //- rjf: push empty implicit set error,
-    if(close_with_separator && parsed_child_count == 0)
+    return h;
+}
+
+MD_FUNCTION MD_u64
+MD_HashFromNode(MD_TreeHashes *hashes, MD_Node *node)
+{
+    MD_u64 result = 0;
+    MD_MapSlot *slot = MD_MapLookup(&hashes->map, MD_MapKeyPtr(node));
+    if(slot != 0)
     {
-        // NOTE(rjf): @error No empty implicitly-delimited sets
-        MD_Message *error = MD_MakeTokenError(arena, string, initial_token, MD_MessageKind_Error,
-                                              MD_S8Lit("Empty implicitly-delimited node list"));
-        MD_MessageListPush(&result.errors, error);
+        result = *(MD_u64 *)slot->val;
     }
-    
-    //- rjf: fill result info
-    result.node = parent;
-    result.string_advance = off - offset;
-    
     return result;
 }
 
-MD_FUNCTION MD_ParseResult
-MD_ParseOneNode(MD_Arena *arena, MD_String8 string, MD_u64 offset)
+// Hashes a node whose tags, tag arguments and children are already hashed,
+// covering what MD_NodeDeepMatch compares with the table's flags.
+static MD_u64
+MD_HashNode(MD_TreeHashes *hashes, MD_Node *node)
 {
-    MD_ParseResult result = MD_ParseResultZero();
-    MD_u64 off = offset;
-    
-    //- rjf: parse pre-comment
-    MD_String8 prev_comment = MD_ZERO_STRUCT;
+    MD_MatchFlags flags = hashes->flags;
+    MD_u64 h = MD_HashNodeLocal(node, flags);
+    if(node->kind != MD_NodeKind_Tag && (flags & MD_NodeMatchFlag_Tags))
     {
-        MD_Token comment_token = MD_ZERO_STRUCT;
-        for(;off < string.size;)
+        for(MD_EachNode(tag, node->first_tag))
         {
-            MD_Token token = MD_TokenFromString(MD_S8Skip(string, off));
-            if(token.kind == MD_TokenKind_Comment)
-            {
-                off += token.raw_string.size;
-                comment_token = token;
-            }
-            else if(token.kind == MD_TokenKind_Newline)
+            h = MD_HashCombine(h, MD_HashNodeLocal(tag, flags));
+            if(flags & MD_NodeMatchFlag_TagArguments)
             {
-                off += token.raw_string.size;
-                MD_Token next_token = MD_TokenFromString(MD_S8Skip(string, off));
-                if(next_token.kind == MD_TokenKind_Comment)
-                {
-                    // NOTE(mal): If more than one comment, use the last comment
-                    comment_token = next_token;
-                }
-                else if(next_token.kind == MD_TokenKind_Newline)
+                for(MD_EachNode(arg, tag->first_child))
                 {
-                    MD_MemoryZeroStruct(&comment_token);
+                    h = MD_HashCombine(h, MD_HashFromNode(hashes, arg));
                 }
+                h = MD_HashCombine(h, tag->child_count);
             }
-            else if((token.kind & MD_TokenGroup_Whitespace) != 0)
-            {
-                off += token.raw_string.size;
-            }
-            else
-            {
-                break;
-            }
-            prev_comment = comment_token.string;
         }
+        h = MD_HashCombine(h, node->tag_count);
+    }
+    for(MD_EachNode(child, node->first_child))
+    {
+        h = MD_HashCombine(h, MD_HashFromNode(hashes, child));
+    }
+    h = MD_HashCombine(h, node->child_count);
+    return(h != 0 ? h : 1);
+}
+
+MD_FUNCTION MD_TreeHashes
+MD_HashTree(MD_Arena *arena, MD_Node *root, MD_MatchFlags flags)
+{
+    MD_TreeHashes result = MD_ZERO_STRUCT;
+    result.flags = flags & (MD_NodeMatchFlag_Tags|MD_NodeMatchFlag_NodeFlags);
+    if(flags & MD_NodeMatchFlag_Tags)
+    {
+        result.flags |= flags & MD_NodeMatchFlag_TagArguments;
     }
     
-    //- rjf: parse tag list
-    MD_Node *first_tag = MD_NilNode();
-    MD_Node *last_tag = MD_NilNode();
+    // NOTE: a post-order walk: a node's tags with their arguments, then its
+    // children, then the node itself.
+    MD_NodeIterFlags iter_flags = MD_NodeIterFlags_Tree|MD_NodeIterFlag_PostOrder;
+    MD_ArenaTemp scratch = MD_GetScratch(&arena, 1);
+    MD_u64 count = 0;
+    for(MD_NodeIter it = MD_NodeIterBegin(scratch.arena, root, iter_flags); !MD_NodeIsNil(MD_NodeIterNext(&it));)
     {
-        for(;off < string.size;)
+        count += 1;
+    }
+    result.map = MD_MapMakeBucketCount(arena, count + count/2 + 1);
+    MD_u64 *values = MD_PushArray(arena, MD_u64, count);
+    MD_u64 value_count = 0;
+    for(MD_NodeIter it = MD_NodeIterBegin(scratch.arena, root, iter_flags); !MD_NodeIsNil(MD_NodeIterNext(&it));)
+    {
+        // NOTE: the nodes of a shared list are walked once for each node
+        // that holds it, but hashed only once.
+        MD_MapKey key = MD_MapKeyPtr(it.node);
+        if(MD_MapLookup(&result.map, key) == 0)
         {
-            //- rjf: parse @ symbol, signifying start of tag
-            off += MD_LexAdvanceFromSkips(MD_S8Skip(string, off), MD_TokenGroup_Irregular);
-            MD_Token next_token = MD_TokenFromString(MD_S8Skip(string, off));
-            if(next_token.kind != MD_TokenKind_Reserved ||
-               next_token.string.str[0] != '@')
-            {
-                break;
-            }
-            off += next_token.raw_string.size;
-            
-            //- rjf: parse string of tag node
-            MD_Token name = MD_TokenFromString(MD_S8Skip(string, off));
-            MD_u64 name_off = off;
-            if((name.kind & MD_TokenGroup_Label) == 0)
-            {
-                // NOTE(rjf): @error Improper token for tag string
-                MD_String8 error_str = MD_S8Fmt(arena, "\"%.*s\" is not a proper tag label",
-                                                MD_S8VArg(name.raw_string));
-                MD_Message *error = MD_MakeTokenError(arena, string, name, MD_MessageKind_Error, error_str);
-                MD_MessageListPush(&result.errors, error);
-                break;
-            }
-            off += name.raw_string.size;
-            
-            //- rjf: build tag
-            MD_Node *tag = MD_MakeNode(arena, MD_NodeKind_Tag, name.string, name.raw_string, name_off);
-            
-            //- rjf: parse tag arguments
-            MD_Token open_paren = MD_TokenFromString(MD_S8Skip(string, off));
-            MD_ParseResult args_parse = MD_ParseResultZero();
-            if(open_paren.kind == MD_TokenKind_Reserved &&
-               open_paren.string.str[0] == '(')
-            {
-                args_parse = MD_ParseNodeSet(arena, string, off, tag, MD_ParseSetRule_EndOnDelimiter);
-                MD_MessageListConcat(&result.errors, &args_parse.errors);
-            }
-            off += args_parse.string_advance;
-            
-            //- rjf: push tag to result
-            MD_NodeDblPushBack(first_tag, last_tag, tag);
+            values[value_count] = MD_HashNode(&result, it.node);
+            MD_MapInsert(arena, &result.map, key, &values[value_count]);
+            value_count += 1;
         }
     }
-    
-    //- rjf: parse node
-    MD_Node *parsed_node = MD_NilNode();
-    MD_ParseResult children_parse = MD_ParseResultZero();
-    retry:;
-    {
-        //- rjf: try to parse an unnamed set
-        off += MD_LexAdvanceFromSkips(MD_S8Skip(string, off), MD_TokenGroup_Irregular);
-        MD_Token unnamed_set_opener = MD_TokenFromString(MD_S8Skip(string, off));
-        if(unnamed_set_opener.kind == MD_TokenKind_Reserved)
-        {
-            MD_u8 c = unnamed_set_opener.string.str[0];
-            if (c == '(' || c == '{' || c == '[')
-            {
-                parsed_node = MD_MakeNode(arena, MD_NodeKind_Main, MD_S8Lit(""), MD_S8Lit(""),
-                                          unnamed_set_opener.raw_string.str - string.str);
-                children_parse = MD_ParseNodeSet(arena, string, off, parsed_node,
-                                                 MD_ParseSetRule_EndOnDelimiter);
-                off += children_parse.string_advance;
-                MD_MessageListConcat(&result.errors, &children_parse.errors);
-            }
-            else if (c == ')' || c == '}' || c == ']')
-            {
-                // NOTE(rjf): @error Unexpected set closing symbol
-                MD_String8 error_str = MD_S8Fmt(arena, "Unbalanced \"%c\"", c);
-                MD_Message *error = MD_MakeTokenError(arena, string, unnamed_set_opener,
-                                                      MD_MessageKind_FatalError, error_str);
-                MD_MessageListPush(&result.errors, error);
-                off += unnamed_set_opener.raw_string.size;
-            }
-            else
-            {
-                // NOTE(rjf): @error Unexpected reserved symbol
-                MD_String8 error_str = MD_S8Fmt(arena, "Unexpected reserved symbol \"%c\"", c);
-                MD_Message *error = MD_MakeTokenError(arena, string, unnamed_set_opener,
-                                                      MD_MessageKind_Error, error_str);
-                MD_MessageListPush(&result.errors, error);
-                off += unnamed_set_opener.raw_string.size;
-            }
-            goto end_parse;
-            
-        }
-        
-        //- rjf: try to parse regular node, with/without children
-        off += MD_LexAdvanceFromSkips(MD_S8Skip(string, off), MD_TokenGroup_Irregular);
-        MD_Token label_name = MD_TokenFromString(MD_S8Skip(string, off));
-        if((label_name.kind & MD_TokenGroup_Label) != 0)
-        {
-            off += label_name.raw_string.size;
-            parsed_node = MD_MakeNode(arena, MD_NodeKind_Main, label_name.string, label_name.raw_string,
-                                      label_name.raw_string.str - string.str);
-            parsed_node->flags |= label_name.node_flags;
-            
-            //- rjf: try to parse children for this node
-            MD_u64 colon_check_off = off;
-            colon_check_off += MD_LexAdvanceFromSkips(MD_S8Skip(string, colon_check_off), MD_TokenGroup_Irregular);
-            MD_Token colon = MD_TokenFromString(MD_S8Skip(string, colon_check_off));
-            if(colon.kind == MD_TokenKind_Reserved &&
-               colon.string.str[0] == ':')
-            {
-                colon_check_off += colon.raw_string.size;
-                off = colon_check_off;
-                
-                children_parse = MD_ParseNodeSet(arena, string, off, parsed_node,
-                                                 MD_ParseSetRule_EndOnDelimiter);
-                off += children_parse.string_advance;
-                MD_MessageListConcat(&result.errors, &children_parse.errors);
-            }
-            goto end_parse;
+    MD_ReleaseScratch(scratch);
+    return result;
+}
+
+MD_FUNCTION MD_b32
+MD_NodeMatch(MD_Node *a, MD_Node *b, MD_MatchFlags flags)
+{
+    MD_b32 result = 0;
+    if(a->kind == b->kind && MD_S8Match(a->string, b->string, flags))
+    {
+        result = 1;
+        if(result && flags & MD_NodeMatchFlag_NodeFlags)
+        {
+            result = result && a->flags == b->flags;
         }
-        
-        //- rjf: collect bad token
-        MD_Token bad_token = MD_TokenFromString(MD_S8Skip(string, off));
-        if(bad_token.kind & MD_TokenGroup_Error)
+        if(result && a->kind != MD_NodeKind_Tag && (flags & MD_NodeMatchFlag_Tags))
         {
-            off += bad_token.raw_string.size;
-            
-            switch (bad_token.kind)
+            for(MD_Node *a_tag = a->first_tag, *b_tag = b->first_tag;
+                !MD_NodeIsNil(a_tag) || !MD_NodeIsNil(b_tag);
+                a_tag = a_tag->next, b_tag = b_tag->next)
             {
-                case MD_TokenKind_BadCharacter:
+                if(MD_NodeMatch(a_tag, b_tag, flags))
                 {
-                    MD_String8List bytes = {0};
-                    for(int i_byte = 0; i_byte < bad_token.raw_string.size; ++i_byte)
+                    if(flags & MD_NodeMatchFlag_TagArguments)
                     {
-                        MD_u8 b = bad_token.raw_string.str[i_byte];
-                        MD_S8ListPush(arena, &bytes, MD_CStyleHexStringFromU64(arena, b, 1));
+                        for(MD_Node *a_tag_arg = a_tag->first_child, *b_tag_arg = b_tag->first_child;
+                            !MD_NodeIsNil(a_tag_arg) || !MD_NodeIsNil(b_tag_arg);
+                            a_tag_arg = a_tag_arg->next, b_tag_arg = b_tag_arg->next)
+                        {
+                            if(!MD_NodeDeepMatch(a_tag_arg, b_tag_arg, flags))
+                            {
+                                result = 0;
+                                goto end;
+                            }
+                        }
                     }
-                    
-                    MD_StringJoin join = MD_ZERO_STRUCT;
-                    join.mid = MD_S8Lit(" ");
-                    MD_String8 byte_string = MD_S8ListJoin(arena, bytes, &join);
-                    
-                    // NOTE(rjf): @error Bad character
-                    MD_String8 error_str = MD_S8Fmt(arena, "Non-ASCII character \"%.*s\"",
-                                                    MD_S8VArg(byte_string));
-                    MD_Message *error = MD_MakeTokenError(arena, string, bad_token, MD_MessageKind_Error,
-                                                          error_str);
-                    MD_MessageListPush(&result.errors, error);
-                }break;
-                
-                case MD_TokenKind_BrokenComment:
-                {
-                    // NOTE(rjf): @error Broken Comments
-                    MD_Message *error = MD_MakeTokenError(arena, string, bad_token, MD_MessageKind_Error,
-                                                          MD_S8Lit("Unterminated comment"));
-                    MD_MessageListPush(&result.errors, error);
-                }break;
-                
-                case MD_TokenKind_BrokenStringLiteral:
+                }
+                else
                 {
-                    // NOTE(rjf): @error Broken String Literals
-                    MD_Message *error = MD_MakeTokenError(arena, string, bad_token, MD_MessageKind_Error,
-                                                          MD_S8Lit("Unterminated string literal"));
-                    MD_MessageListPush(&result.errors, error);
-                }break;
+                    result = 0;
+                    goto end;
+                }
             }
-            goto retry;
         }
     }
+    end:;
+    return result;
+}
+
+static MD_b32
+MD_NodeDeepMatchWithHashes(MD_TreeHashes *a_hashes, MD_Node *a, MD_TreeHashes *b_hashes, MD_Node *b,
+                           MD_MatchFlags flags)
+{
+    MD_b32 result = 1;
     
-    end_parse:;
+    // NOTE: hashes can only rule out a match when they cover no more than
+    // the flags compare. Equal hashes prove nothing, so the walk below still
+    // confirms them.
+    if(a_hashes != 0 && b_hashes != 0 && a_hashes->flags == b_hashes->flags &&
+       (a_hashes->flags & ~flags) == 0 && !(flags & MD_StringMatchFlag_RightSideSloppy))
+    {
+        MD_u64 a_hash = MD_HashFromNode(a_hashes, a);
+        MD_u64 b_hash = MD_HashFromNode(b_hashes, b);
+        result = (a_hash == 0 || b_hash == 0 || a_hash == b_hash);
+    }
     
-    //- rjf: parse comments after nodes.
-    MD_String8 next_comment = MD_ZERO_STRUCT;
+    // NOTE: both trees are walked in step, visiting what MD_NodeMatch would
+    // compare: tags only with MD_NodeMatchFlag_Tags, and the arguments of
+    // tags only with MD_NodeMatchFlag_TagArguments as well. The same nodes at
+    // the same depths in pre-order means the same shape.
+    if(result)
     {
-        MD_Token comment_token = MD_ZERO_STRUCT;
-        for(;;)
+        MD_NodeIterFlags iter_flags = MD_NodeIterFlag_Children;
+        if(flags & MD_NodeMatchFlag_Tags)
         {
-            MD_Token token = MD_TokenFromString(MD_S8Skip(string, off));
-            if(token.kind == MD_TokenKind_Comment)
+            iter_flags |= MD_NodeIterFlag_Tags;
+            if(flags & MD_NodeMatchFlag_TagArguments)
             {
-                comment_token = token;
-                off += token.raw_string.size;
-                break;
+                iter_flags |= MD_NodeIterFlag_TagArguments;
             }
-            
-            else if(token.kind == MD_TokenKind_Newline)
+        }
+        MD_ArenaTemp scratch = MD_GetScratch(0, 0);
+        MD_NodeIter a_it = MD_NodeIterBegin(scratch.arena, a, iter_flags);
+        MD_NodeIter b_it = MD_NodeIterBegin(scratch.arena, b, iter_flags);
+        for(;;)
+        {
+            MD_Node *x = MD_NodeIterNext(&a_it);
+            MD_Node *y = MD_NodeIterNext(&b_it);
+            if(MD_NodeIsNil(x) || MD_NodeIsNil(y))
             {
+                result = (MD_NodeIsNil(x) && MD_NodeIsNil(y));
                 break;
             }
-            else if((token.kind & MD_TokenGroup_Whitespace) != 0)
-            {
-                off += token.raw_string.size;
-            }
-            else
+            if(a_it.depth != b_it.depth ||
+               x->kind != y->kind || !MD_S8Match(x->string, y->string, flags) ||
+               ((flags & MD_NodeMatchFlag_NodeFlags) && x->flags != y->flags))
             {
+                result = 0;
                 break;
             }
         }
-        next_comment = comment_token.string;
-    }
-    
-    //- rjf: fill result
-    parsed_node->prev_comment = prev_comment;
-    parsed_node->next_comment = next_comment;
-    result.node = parsed_node;
-    if(!MD_NodeIsNil(result.node))
-    {
-        result.node->first_tag = first_tag;
-        result.node->last_tag = last_tag;
-        for(MD_Node *tag = first_tag; !MD_NodeIsNil(tag); tag = tag->next)
-        {
-            tag->parent = result.node;
-        }
+        MD_ReleaseScratch(scratch);
     }
-    result.string_advance = off - offset;
-    
     return result;
 }
 
-MD_FUNCTION MD_ParseResult
-MD_ParseWholeString(MD_Arena *arena, MD_String8 filename, MD_String8 contents)
+MD_FUNCTION MD_b32
+MD_NodeDeepMatch(MD_Node *a, MD_Node *b, MD_MatchFlags flags)
 {
-    MD_Node *root = MD_MakeNode(arena, MD_NodeKind_File, filename, contents, 0);
-    MD_ParseResult result = MD_ParseNodeSet(arena, contents, 0, root, MD_ParseSetRule_Global);
-    result.node = root;
-    for(MD_Message *error = result.errors.first; error != 0; error = error->next)
-    {
-        if(MD_NodeIsNil(error->node->parent))
-        {
-            error->node->parent = root;
-        }
-    }
-    return result;
+    return MD_NodeDeepMatchWithHashes(0, a, 0, b, flags);
 }
 
-MD_FUNCTION MD_ParseResult
-MD_ParseWholeFile(MD_Arena *arena, MD_String8 filename)
+MD_FUNCTION MD_b32
+MD_NodeDeepMatchHashed(MD_TreeHashes *a_hashes, MD_Node *a, MD_TreeHashes *b_hashes, MD_Node *b,
+                       MD_MatchFlags flags)
 {
-    MD_String8 file_contents = MD_LoadEntireFile(arena, filename);
-    MD_ParseResult parse = MD_ParseWholeString(arena, filename, file_contents);
-    if(file_contents.str == 0)
+    return MD_NodeDeepMatchWithHashes(a_hashes, a, b_hashes, b, flags);
+}
+
+//~ Tree Diffs
+
+// The children of one side of a diffed node. partner[i] is 1 + the index of
+// the child's match on the other side, or 0 while it has none.
+typedef struct MD_TreeDiffSide MD_TreeDiffSide;
+struct MD_TreeDiffSide
+{
+    MD_TreeHashes *hashes;
+    MD_Node **nodes;
+    MD_u64 *partner;
+    MD_u64 count;
+};
+
+static MD_TreeDiffSide
+MD_TreeDiffSideFromNode(MD_Arena *arena, MD_TreeHashes *hashes, MD_Node *node)
+{
+    MD_TreeDiffSide result = MD_ZERO_STRUCT;
+    result.hashes = hashes;
+    result.count = node->child_count;
+    result.nodes = MD_PushArray(arena, MD_Node *, result.count);
+    result.partner = MD_PushArrayZero(arena, MD_u64, result.count);
+    MD_u64 idx = 0;
+    for(MD_EachNode(child, node->first_child))
     {
-        // NOTE(rjf): @error File failing to load
-        MD_String8 error_str = MD_S8Fmt(arena, "Could not read file \"%.*s\"", MD_S8VArg(filename));
-        MD_Message *error = MD_MakeNodeError(arena, parse.node, MD_MessageKind_FatalError,
-                                             error_str);
-        MD_MessageListPush(&parse.errors, error);
+        result.nodes[idx] = child;
+        idx += 1;
     }
-    return parse;
+    return result;
 }
 
-//~ Messages (Errors/Warnings)
+static void
+MD_TreeDiffPushEdit(MD_Arena *arena, MD_TreeEditList *list, MD_TreeEditKind kind,
+                    MD_Node *old_node, MD_Node *new_node)
+{
+    MD_TreeEdit *edit = MD_PushArrayZero(arena, MD_TreeEdit, 1);
+    edit->kind = kind;
+    edit->old_node = old_node;
+    edit->new_node = new_node;
+    MD_QueuePush(list->first, list->last, edit);
+    list->count += 1;
+}
 
-MD_FUNCTION MD_Node*
-MD_MakeErrorMarkerNode(MD_Arena *arena, MD_String8 parse_contents, MD_u64 offset)
+static MD_u64
+MD_TreeDiffKey(MD_TreeDiffSide *side, MD_Node *node, MD_b32 by_subtree)
 {
-    MD_Node *result = MD_MakeNode(arena, MD_NodeKind_ErrorMarker, MD_S8Lit(""), parse_contents,
-                                  offset);
-    return(result);
+    return(by_subtree ? MD_HashFromNode(side->hashes, node) : MD_HashNodeLocal(node, 0));
 }
 
-MD_FUNCTION MD_Message*
-MD_MakeNodeError(MD_Arena *arena, MD_Node *node, MD_MessageKind kind, MD_String8 str)
+// Pairs each unmatched new child with the first unmatched old child with the
+// same key: either an identical subtree, or the same kind and string.
+static void
+MD_TreeDiffMatch(MD_Arena *arena, MD_TreeDiffSide *old_side, MD_TreeDiffSide *new_side,
+                 MD_b32 by_subtree, MD_MatchFlags flags)
 {
-    MD_Message *error = MD_PushArrayZero(arena, MD_Message, 1);
-    error->node = node;
-    error->kind = kind;
-    error->string = str;
-    return error;
+    //- chain the unmatched old children into buckets, each in child order
+    MD_u64 bucket_count = old_side->count*2 + 1;
+    MD_u64 *bucket_first = MD_PushArrayZero(arena, MD_u64, bucket_count);
+    MD_u64 *next = MD_PushArrayZero(arena, MD_u64, old_side->count);
+    for(MD_u64 idx = old_side->count; idx > 0; idx -= 1)
+    {
+        if(old_side->partner[idx - 1] == 0)
+        {
+            MD_u64 bucket = MD_TreeDiffKey(old_side, old_side->nodes[idx - 1], by_subtree) % bucket_count;
+            next[idx - 1] = bucket_first[bucket];
+            bucket_first[bucket] = idx;
+        }
+    }
+    
+    //- match the new children in order
+    for(MD_u64 new_idx = 0; new_idx < new_side->count; new_idx += 1)
+    {
+        if(new_side->partner[new_idx] == 0)
+        {
+            MD_Node *new_node = new_side->nodes[new_idx];
+            MD_u64 key = MD_TreeDiffKey(new_side, new_node, by_subtree);
+            MD_u64 bucket = key % bucket_count;
+            
+            // NOTE: matched children at the front of a chain are dropped, so
+            // runs of equal children are matched in linear time.
+            while(bucket_first[bucket] != 0 && old_side->partner[bucket_first[bucket] - 1] != 0)
+            {
+                bucket_first[bucket] = next[bucket_first[bucket] - 1];
+            }
+            for(MD_u64 idx = bucket_first[bucket]; idx != 0; idx = next[idx - 1])
+            {
+                MD_Node *old_node = old_side->nodes[idx - 1];
+                if(old_side->partner[idx - 1] == 0 && MD_TreeDiffKey(old_side, old_node, by_subtree) == key &&
+                   (by_subtree ?
+                    MD_NodeDeepMatchHashed(old_side->hashes, old_node, new_side->hashes, new_node, flags) :
+                    old_node->kind == new_node->kind && MD_S8Match(old_node->string, new_node->string, flags)))
+                {
+                    old_side->partner[idx - 1] = new_idx + 1;
+                    new_side->partner[new_idx] = idx;
+                    break;
+                }
+            }
+        }
+    }
 }
 
-MD_FUNCTION MD_Message *
-MD_MakeTokenError(MD_Arena *arena, MD_String8 parse_contents, MD_Token token,
-                  MD_MessageKind kind, MD_String8 str)
+// Pairs the leaf children left over after matching, in order, so that a
+// changed value like the `2` in `a: 2` reads as modified rather than as
+// deleted and inserted.
+static void
+MD_TreeDiffMatchLeaves(MD_TreeDiffSide *old_side, MD_TreeDiffSide *new_side)
 {
-    MD_u64 offset = token.raw_string.str - parse_contents.str;
-    MD_Node *err_node = MD_MakeErrorMarkerNode(arena, parse_contents, offset);
-    return MD_MakeNodeError(arena, err_node, kind, str);
+    MD_u64 old_idx = 0;
+    for(MD_u64 new_idx = 0; new_idx < new_side->count; new_idx += 1)
+    {
+        MD_Node *new_node = new_side->nodes[new_idx];
+        if(new_side->partner[new_idx] == 0 && MD_NodeIsNil(new_node->first_child))
+        {
+            for(; old_idx < old_side->count; old_idx += 1)
+            {
+                MD_Node *old_node = old_side->nodes[old_idx];
+                if(old_side->partner[old_idx] == 0 && MD_NodeIsNil(old_node->first_child))
+                {
+                    break;
+                }
+            }
+            if(old_idx < old_side->count)
+            {
+                if(old_side->nodes[old_idx]->kind == new_node->kind)
+                {
+                    old_side->partner[old_idx] = new_idx + 1;
+                    new_side->partner[new_idx] = old_idx + 1;
+                }
+                old_idx += 1;
+            }
+        }
+    }
 }
 
-MD_FUNCTION void
-MD_MessageListPush(MD_MessageList *list, MD_Message *message)
+// Marks the matched new children that keep their order relative to each
+// other, as the longest run of them with increasing old indices. The other
+// matched children have moved.
+static MD_b32 *
+MD_TreeDiffStableFromSide(MD_Arena *arena, MD_TreeDiffSide *new_side)
 {
-    MD_QueuePush(list->first, list->last, message);
-    if(message->kind > list->max_message_kind)
+    MD_b32 *result = MD_PushArrayZero(arena, MD_b32, new_side->count);
+    MD_u64 *tails = MD_PushArrayZero(arena, MD_u64, new_side->count + 1);
+    MD_u64 *prev = MD_PushArrayZero(arena, MD_u64, new_side->count);
+    MD_u64 length = 0;
+    for(MD_u64 new_idx = 0; new_idx < new_side->count; new_idx += 1)
+    {
+        MD_u64 old_idx = new_side->partner[new_idx];
+        if(old_idx != 0)
+        {
+            // NOTE: tails[n] is 1 + the new index ending the best run of
+            // length n, by binary search on the old index it ends with.
+            MD_u64 lo = 1;
+            MD_u64 hi = length + 1;
+            while(lo < hi)
+            {
+                MD_u64 mid = lo + (hi - lo)/2;
+                if(new_side->partner[tails[mid] - 1] < old_idx)
+                {
+                    lo = mid + 1;
+                }
+                else
+                {
+                    hi = mid;
+                }
+            }
+            prev[new_idx] = tails[lo - 1];
+            tails[lo] = new_idx + 1;
+            if(lo > length)
+            {
+                length = lo;
+            }
+        }
+    }
+    for(MD_u64 idx = tails[length]; idx != 0; idx = prev[idx - 1])
     {
-        list->max_message_kind = message->kind;
+        result[idx - 1] = 1;
     }
-    list->node_count += 1;
+    return result;
 }
 
-MD_FUNCTION void
-MD_MessageListConcat(MD_MessageList *list, MD_MessageList *to_push)
+// A pair of matched nodes whose children are being diffed. The frame and its
+// arrays live in temp, so popping the frame frees them.
+typedef struct MD_TreeDiffFrame MD_TreeDiffFrame;
+struct MD_TreeDiffFrame
 {
-    if(to_push->node_count != 0)
+    MD_TreeDiffFrame *next;
+    MD_ArenaTemp temp;
+    MD_TreeDiffSide old_side;
+    MD_TreeDiffSide new_side;
+    MD_b32 *identical;
+    MD_b32 *stable;
+    MD_u64 idx;
+};
+
+// Matches the children of old_node against those of new_node and reports the
+// deleted ones. The rest are reported as the frame is stepped through.
+static MD_TreeDiffFrame *
+MD_TreeDiffPushFrame(MD_Arena *arena, MD_Arena *scratch_arena, MD_TreeEditList *edits,
+                     MD_TreeDiffFrame **top, MD_TreeHashes *old_hashes, MD_Node *old_node,
+                     MD_TreeHashes *new_hashes, MD_Node *new_node, MD_MatchFlags flags)
+{
+    MD_ArenaTemp temp = MD_ArenaBeginTemp(scratch_arena);
+    MD_TreeDiffFrame *frame = MD_PushArrayZero(scratch_arena, MD_TreeDiffFrame, 1);
+    frame->temp = temp;
+    frame->old_side = MD_TreeDiffSideFromNode(scratch_arena, old_hashes, old_node);
+    frame->new_side = MD_TreeDiffSideFromNode(scratch_arena, new_hashes, new_node);
+    MD_TreeDiffSide *old_side = &frame->old_side;
+    MD_TreeDiffSide *new_side = &frame->new_side;
+    
+    //- match identical subtrees first, then the remaining children by label,
+    // then the remaining leaves by position
+    MD_TreeDiffMatch(scratch_arena, old_side, new_side, 1, flags);
+    frame->identical = MD_PushArrayZero(scratch_arena, MD_b32, new_side->count);
+    for(MD_u64 idx = 0; idx < new_side->count; idx += 1)
     {
-        if(list->last != 0)
-        {
-            list->last->next = to_push->first;
-            list->last = to_push->last;
-            list->node_count += to_push->node_count;
-            if(to_push->max_message_kind > list->max_message_kind)
-            {
-                list->max_message_kind = to_push->max_message_kind;
-            }
-        }
-        else
+        frame->identical[idx] = (new_side->partner[idx] != 0);
+    }
+    MD_TreeDiffMatch(scratch_arena, old_side, new_side, 0, flags);
+    MD_TreeDiffMatchLeaves(old_side, new_side);
+    frame->stable = MD_TreeDiffStableFromSide(scratch_arena, new_side);
+    
+    //- report deletions
+    for(MD_u64 idx = 0; idx < old_side->count; idx += 1)
+    {
+        if(old_side->partner[idx] == 0)
         {
-            *list = *to_push;
+            MD_TreeDiffPushEdit(arena, edits, MD_TreeEditKind_Delete, old_side->nodes[idx], MD_NilNode());
         }
-        MD_MemoryZeroStruct(to_push);
     }
+    
+    frame->next = *top;
+    *top = frame;
+    return frame;
 }
 
-//~ Location Conversions
-
-MD_FUNCTION MD_CodeLoc
-MD_CodeLocFromFileOffset(MD_String8 filename, MD_u8 *base, MD_u64 offset)
+// NOTE: the frames are kept on scratch rather than the call stack, so trees
+// of any depth can be diffed.
+static void
+MD_TreeDiffChildren(MD_Arena *arena, MD_Arena *scratch_arena, MD_TreeEditList *edits,
+                    MD_TreeHashes *old_hashes, MD_Node *old_node,
+                    MD_TreeHashes *new_hashes, MD_Node *new_node, MD_MatchFlags flags)
 {
-    MD_CodeLoc loc;
-    loc.filename = filename;
-    loc.line = 1;
-    loc.column = 1;
-    if(base != 0)
+    MD_TreeDiffFrame *top = 0;
+    MD_TreeDiffPushFrame(arena, scratch_arena, edits, &top, old_hashes, old_node, new_hashes, new_node, flags);
+    while(top != 0)
     {
-        MD_u8 *at = base + offset;
-        for(MD_u64 i = 0; base+i < at && base[i]; i += 1)
+        MD_TreeDiffFrame *frame = top;
+        if(frame->idx < frame->new_side.count)
         {
-            if(base[i] == '\n')
+            //- report the next new child, then diff its children if it changed
+            MD_u64 idx = frame->idx;
+            frame->idx += 1;
+            MD_Node *new_child = frame->new_side.nodes[idx];
+            if(frame->new_side.partner[idx] == 0)
             {
-                loc.line += 1;
-                loc.column = 1;
+                MD_TreeDiffPushEdit(arena, edits, MD_TreeEditKind_Insert, MD_NilNode(), new_child);
             }
             else
             {
-                loc.column += 1;
+                MD_Node *old_child = frame->old_side.nodes[frame->new_side.partner[idx] - 1];
+                if(!frame->stable[idx])
+                {
+                    MD_TreeDiffPushEdit(arena, edits, MD_TreeEditKind_Move, old_child, new_child);
+                }
+                if(!frame->identical[idx])
+                {
+                    if(!MD_NodeMatch(old_child, new_child, flags))
+                    {
+                        MD_TreeDiffPushEdit(arena, edits, MD_TreeEditKind_Modify, old_child, new_child);
+                    }
+                    MD_TreeDiffPushFrame(arena, scratch_arena, edits, &top,
+                                         old_hashes, old_child, new_hashes, new_child, flags);
+                }
             }
         }
+        else
+        {
+            top = frame->next;
+            MD_ArenaEndTemp(frame->temp);
+        }
     }
-    return loc;
 }
 
-MD_FUNCTION MD_CodeLoc
-MD_CodeLocFromNode(MD_Node *node)
+MD_FUNCTION MD_TreeEditList
+MD_TreeDiff(MD_Arena *arena, MD_Node *old_root, MD_Node *new_root, MD_MatchFlags flags)
 {
-    MD_Node *file_root = MD_NilNode();
-    for(MD_Node *parent = node->parent; !MD_NodeIsNil(parent); parent = parent->parent)
+    MD_TreeEditList result = MD_ZERO_STRUCT;
+    flags &= ~MD_StringMatchFlag_RightSideSloppy;
+    if(MD_NodeIsNil(old_root) && !MD_NodeIsNil(new_root))
     {
-        if(parent->kind == MD_NodeKind_File)
-        {
-            file_root = parent;
-            break;
-        }
+        MD_TreeDiffPushEdit(arena, &result, MD_TreeEditKind_Insert, MD_NilNode(), new_root);
     }
-    MD_Node *first_tag = file_root->first_tag;
-    MD_CodeLoc loc = {0};
-    if(MD_NodeIsNil(first_tag))
+    else if(!MD_NodeIsNil(old_root) && MD_NodeIsNil(new_root))
     {
-        loc = MD_CodeLocFromFileOffset(file_root->string, file_root->raw_string.str, node->offset);
+        MD_TreeDiffPushEdit(arena, &result, MD_TreeEditKind_Delete, old_root, MD_NilNode());
     }
-    else
+    else if(!MD_NodeIsNil(old_root))
     {
-        loc = MD_CodeLocFromFileOffset(file_root->string, first_tag->raw_string.str, node->offset);
+        MD_ArenaTemp scratch = MD_GetScratch(&arena, 1);
+        MD_TreeHashes old_hashes = MD_HashTree(scratch.arena, old_root, flags);
+        MD_TreeHashes new_hashes = MD_HashTree(scratch.arena, new_root, flags);
+        if(!MD_NodeMatch(old_root, new_root, flags))
+        {
+            MD_TreeDiffPushEdit(arena, &result, MD_TreeEditKind_Modify, old_root, new_root);
+        }
+        MD_TreeDiffChildren(arena, scratch.arena, &result, &old_hashes, old_root, &new_hashes, new_root, flags);
+        MD_ReleaseScratch(scratch);
     }
-    return loc;
+    return result;
 }
 
-//~ Tree/List Building
+//~ Shared Subtrees
 
-MD_FUNCTION MD_b32
-MD_NodeIsNil(MD_Node *node)
+// A list of nodes that has been copied, kept with the original that was
+// copied, so that matching never walks the shared tree.
+typedef struct MD_ShareList MD_ShareList;
+struct MD_ShareList
 {
-    return(node == 0 || node == &_md_nil_node || node->kind == MD_NodeKind_Nil);
-}
+    MD_Node *original;
+    MD_Node *first;
+    MD_Node *last;
+};
 
-MD_FUNCTION MD_Node *
-MD_NilNode(void) { return &_md_nil_node; }
+// A copied node whose tags and children are still to be copied.
+typedef struct MD_ShareFrame MD_ShareFrame;
+struct MD_ShareFrame
+{
+    MD_ShareFrame *next;
+    MD_Node *node;
+    MD_Node *copy;
+};
 
-MD_FUNCTION MD_Node *
-MD_MakeNode(MD_Arena *arena, MD_NodeKind kind, MD_String8 string, MD_String8 raw_string,
-            MD_u64 offset)
+typedef struct MD_ShareReference MD_ShareReference;
+struct MD_ShareReference
 {
-    MD_Node *node = MD_PushArrayZero(arena, MD_Node, 1);
-    node->kind = kind;
-    node->string = string;
-    node->raw_string = raw_string;
-    node->next = node->prev = node->parent =
-        node->first_child = node->last_child =
-        node->first_tag = node->last_tag = node->ref_target = MD_NilNode();
-    node->offset = offset;
-    return node;
-}
+    MD_ShareReference *next;
+    MD_Node *copy;
+};
 
-MD_FUNCTION void
-MD_PushChild(MD_Node *parent, MD_Node *new_child)
+typedef struct MD_ShareCtx MD_ShareCtx;
+struct MD_ShareCtx
 {
-    if (!MD_NodeIsNil(new_child))
-    {
-        MD_NodeDblPushBack(parent->first_child, parent->last_child, new_child);
-        new_child->parent = parent;
-    }
-}
+    MD_Arena *arena;
+    MD_Arena *scratch;
+    MD_TreeHashes hashes;
+    MD_Map lists;
+    
+    // Only kept when the tree has references: the copy of each copied node,
+    // and for each node of a duplicate list, the node that it duplicates.
+    MD_b32 has_references;
+    MD_Map copy_from_node;
+    MD_Map shared_from_node;
+    MD_ShareReference *first_reference;
+    MD_ShareFrame *top;
+    MD_ShareFrame *free_frame;
+};
 
-MD_FUNCTION void
-MD_PushTag(MD_Node *node, MD_Node *tag)
+static MD_u64
+MD_ShareListKey(MD_ShareCtx *ctx, MD_Node *first)
 {
-    if (!MD_NodeIsNil(tag))
+    MD_u64 result = 0x9e3779b97f4a7c15;
+    MD_u64 count = 0;
+    for(MD_EachNode(node, first))
     {
-        MD_NodeDblPushBack(node->first_tag, node->last_tag, tag);
-        tag->parent = node;
+        result = MD_HashCombine(result, MD_HashFromNode(&ctx->hashes, node));
+        count += 1;
     }
+    return MD_HashCombine(result, count);
 }
 
-MD_FUNCTION MD_Node*
-MD_MakeList(MD_Arena *arena)
-{
-    MD_String8 empty = {0};
-    MD_Node *result = MD_MakeNode(arena, MD_NodeKind_List, empty, empty, 0);
-    return(result);
-}
-
-MD_FUNCTION void
-MD_ListConcatInPlace(MD_Node *list, MD_Node *to_push)
+// Whether two lists hold the same subtrees, node for node. Lists with
+// references are never shared, since the targets may differ.
+static MD_b32
+MD_ShareListMatch(MD_Arena *scratch_arena, MD_TreeHashes *hashes, MD_Node *a_first, MD_Node *b_first)
 {
-    if (!MD_NodeIsNil(to_push->first_child))
+    MD_b32 result = 1;
+    MD_Node *a = a_first;
+    MD_Node *b = b_first;
+    MD_ArenaTemp scratch = MD_ArenaBeginTemp(scratch_arena);
+    for(; result && !MD_NodeIsNil(a) && !MD_NodeIsNil(b); a = a->next, b = b->next)
     {
-        if (!MD_NodeIsNil(list->first_child))
-        {
-            list->last_child->next = to_push->first_child;
-            list->last_child = to_push->last_child;
-        }
-        else
+        MD_NodeIter a_it = MD_NodeIterBegin(scratch_arena, a, MD_NodeIterFlags_Tree);
+        MD_NodeIter b_it = MD_NodeIterBegin(scratch_arena, b, MD_NodeIterFlags_Tree);
+        for(;;)
         {
-            list->first_child = to_push->first_child;
-            list->last_child = to_push->last_child;
+            MD_Node *x = MD_NodeIterNext(&a_it);
+            MD_Node *y = MD_NodeIterNext(&b_it);
+            if(MD_NodeIsNil(x) && MD_NodeIsNil(y))
+            {
+                break;
+            }
+            if(MD_HashFromNode(hashes, x) != MD_HashFromNode(hashes, y) || x->kind != y->kind || x->kind == MD_NodeKind_Reference ||
+               x->flags != y->flags || x->child_count != y->child_count || x->tag_count != y->tag_count ||
+               !MD_S8Match(x->string, y->string, 0))
+            {
+                result = 0;
+                break;
+            }
         }
-        to_push->first_child = to_push->last_child = MD_NilNode();
     }
+    MD_ArenaEndTemp(scratch);
+    return(result && MD_NodeIsNil(a) && MD_NodeIsNil(b));
 }
 
-MD_FUNCTION MD_Node*
-MD_PushNewReference(MD_Arena *arena, MD_Node *list, MD_Node *target)
+static MD_Node *
+MD_ShareCopyNode(MD_ShareCtx *ctx, MD_Node *node, MD_Node *parent)
 {
-    MD_Node *n = MD_MakeNode(arena, MD_NodeKind_Reference, target->string, target->raw_string,
-                             target->offset);
-    n->ref_target = target;
-    MD_PushChild(list, n);
-    return(n);
+    MD_Node *copy = MD_PushArray(ctx->arena, MD_Node, 1);
+    *copy = *node;
+    copy->next = copy->prev = MD_NilNode();
+    copy->first_child = copy->last_child = copy->first_tag = copy->last_tag = MD_NilNode();
+    copy->parent = parent;
+    if(ctx->has_references)
+    {
+        MD_MapInsert(ctx->scratch, &ctx->copy_from_node, MD_MapKeyPtr(node), copy);
+        if(node->kind == MD_NodeKind_Reference)
+        {
+            MD_ShareReference *reference = MD_PushArray(ctx->scratch, MD_ShareReference, 1);
+            reference->copy = copy;
+            MD_StackPush(ctx->first_reference, reference);
+        }
+    }
+    return copy;
 }
 
-//~ Introspection Helpers
-
-MD_FUNCTION MD_Node *
-MD_FirstNodeWithString(MD_Node *first, MD_String8 string, MD_MatchFlags flags)
+// Queues the nodes of a list that was just copied, with its first node on
+// top, so that the tree is copied in pre-order.
+static void
+MD_SharePushFrames(MD_ShareCtx *ctx, MD_Node *last, MD_ShareList list)
 {
-    MD_Node *result = MD_NilNode();
-    for(MD_Node *node = first; !MD_NodeIsNil(node); node = node->next)
+    for(MD_Node *node = last, *copy = list.last; !MD_NodeIsNil(copy); node = node->prev, copy = copy->prev)
     {
-        if(MD_S8Match(string, node->string, flags))
+        MD_ShareFrame *frame = ctx->free_frame;
+        if(frame != 0)
         {
-            result = node;
-            break;
+            ctx->free_frame = frame->next;
+        }
+        else
+        {
+            frame = MD_PushArray(ctx->scratch, MD_ShareFrame, 1);
         }
+        frame->node = node;
+        frame->copy = copy;
+        frame->next = ctx->top;
+        ctx->top = frame;
     }
-    return result;
 }
 
-MD_FUNCTION MD_Node *
-MD_NodeAtIndex(MD_Node *first, int n)
+// Returns the shared copy of a list if there is one, and otherwise copies it.
+static MD_ShareList
+MD_ShareListFromList(MD_ShareCtx *ctx, MD_Node *first, MD_Node *parent_copy)
 {
-    MD_Node *result = MD_NilNode();
-    if(n >= 0)
+    MD_ShareList result = {first, MD_NilNode(), MD_NilNode()};
+    if(!MD_NodeIsNil(first))
     {
-        int idx = 0;
-        for(MD_Node *node = first; !MD_NodeIsNil(node); node = node->next, idx += 1)
+        //- look for a shared copy
+        MD_u64 key = MD_ShareListKey(ctx, first);
+        MD_b32 found = 0;
+        for(MD_MapSlot *slot = ctx->lists.buckets[key%ctx->lists.bucket_count].first; slot != 0; slot = slot->next)
         {
-            if(idx == n)
+            MD_ShareList *list = (MD_ShareList *)slot->val;
+            if(slot->key.hash == key && MD_ShareListMatch(ctx->scratch, &ctx->hashes, list->original, first))
             {
-                result = node;
+                result = *list;
+                found = 1;
                 break;
             }
         }
+        
+        //- map the nodes of a duplicate to the nodes they duplicate
+        if(found)
+        {
+            if(ctx->has_references)
+            {
+                for(MD_Node *a = result.original, *b = first; !MD_NodeIsNil(a); a = a->next, b = b->next)
+                {
+                    MD_NodeIter a_it = MD_NodeIterBegin(ctx->scratch, a, MD_NodeIterFlags_Tree);
+                    MD_NodeIter b_it = MD_NodeIterBegin(ctx->scratch, b, MD_NodeIterFlags_Tree);
+                    for(;!MD_NodeIsNil(MD_NodeIterNext(&a_it)) && !MD_NodeIsNil(MD_NodeIterNext(&b_it));)
+                    {
+                        MD_MapInsert(ctx->scratch, &ctx->shared_from_node, MD_MapKeyPtr(b_it.node), a_it.node);
+                    }
+                }
+            }
+        }
+        
+        //- copy the list
+        else
+        {
+            for(MD_EachNode(node, first))
+            {
+                MD_Node *copy = MD_ShareCopyNode(ctx, node, parent_copy);
+                MD_NodeDblPushBack(result.first, result.last, copy);
+            }
+            MD_ShareList *list = MD_PushArray(ctx->scratch, MD_ShareList, 1);
+            *list = result;
+            MD_MapKey list_key = MD_ZERO_STRUCT;
+            list_key.hash = key;
+            list_key.ptr = first;
+            MD_MapInsert(ctx->scratch, &ctx->lists, list_key, list);
+        }
     }
     return result;
 }
 
 MD_FUNCTION MD_Node *
-MD_FirstNodeWithFlags(MD_Node *first, MD_NodeFlags flags)
+MD_ShareSubtrees(MD_Arena *arena, MD_Node *root)
 {
     MD_Node *result = MD_NilNode();
-    for(MD_Node *n = first; !MD_NodeIsNil(n); n = n->next)
+    if(!MD_NodeIsNil(root))
     {
-        if(n->flags & flags)
+        MD_ArenaTemp scratch = MD_GetScratch(&arena, 1);
+        MD_ShareCtx ctx = MD_ZERO_STRUCT;
+        ctx.arena = arena;
+        ctx.scratch = scratch.arena;
+        ctx.hashes = MD_HashTree(scratch.arena, root, MD_NodeMatchFlag_Tags|MD_NodeMatchFlag_TagArguments|
+                                 MD_NodeMatchFlag_NodeFlags);
+        MD_u64 count = 0;
+        for(MD_NodeIter it = MD_NodeIterBegin(scratch.arena, root, MD_NodeIterFlags_Tree);
+            !MD_NodeIsNil(MD_NodeIterNext(&it));)
         {
-            result = n;
-            break;
+            MD_Node *node = it.node;
+            count += 1;
+            ctx.has_references |= (node->kind == MD_NodeKind_Reference);
+        }
+        ctx.lists = MD_MapMakeBucketCount(scratch.arena, count/2 + 1);
+        if(ctx.has_references)
+        {
+            ctx.copy_from_node = MD_MapMakeBucketCount(scratch.arena, count);
+            ctx.shared_from_node = MD_MapMakeBucketCount(scratch.arena, count);
+        }
+        
+        //- copy the tree in pre-order, sharing lists that were copied before
+        // NOTE: a list that was just copied has itself as its original.
+        result = MD_ShareCopyNode(&ctx, root, MD_NilNode());
+        MD_ShareList root_list = {root, result, result};
+        MD_SharePushFrames(&ctx, root, root_list);
+        for(;ctx.top != 0;)
+        {
+            MD_ShareFrame *frame = ctx.top;
+            MD_Node *node = frame->node;
+            MD_Node *copy = frame->copy;
+            ctx.top = frame->next;
+            frame->next = ctx.free_frame;
+            ctx.free_frame = frame;
+            MD_ShareList tags = MD_ShareListFromList(&ctx, node->first_tag, copy);
+            copy->first_tag = tags.first;
+            copy->last_tag = tags.last;
+            MD_ShareList children = MD_ShareListFromList(&ctx, node->first_child, copy);
+            copy->first_child = children.first;
+            copy->last_child = children.last;
+            if(children.original == node->first_child)
+            {
+                MD_SharePushFrames(&ctx, node->last_child, children);
+            }
+            if(tags.original == node->first_tag)
+            {
+                MD_SharePushFrames(&ctx, node->last_tag, tags);
+            }
+        }
+        
+        //- point references at the copies of their targets
+        // NOTE: a duplicate can duplicate nodes that are themselves in an
+        // earlier duplicate, so targets are followed back to a copied node.
+        for(MD_ShareReference *reference = ctx.first_reference; reference != 0; reference = reference->next)
+        {
+            MD_Node *target = reference->copy->ref_target;
+            for(MD_MapSlot *slot = MD_MapLookup(&ctx.shared_from_node, MD_MapKeyPtr(target)); slot != 0;
+                slot = MD_MapLookup(&ctx.shared_from_node, MD_MapKeyPtr(target)))
+            {
+                target = (MD_Node *)slot->val;
+            }
+            MD_MapSlot *slot = MD_MapLookup(&ctx.copy_from_node, MD_MapKeyPtr(target));
+            reference->copy->ref_target = (slot != 0 ? (MD_Node *)slot->val : MD_NilNode());
         }
+        MD_ReleaseScratch(scratch);
     }
     return result;
 }
 
-MD_FUNCTION int
-MD_IndexFromNode(MD_Node *node)
-{
-    int idx = 0;
-    for(MD_Node *last = node->prev; !MD_NodeIsNil(last); last = last->prev, idx += 1);
-    return idx;
-}
+//~ Compact Trees
 
-MD_FUNCTION MD_Node *
-MD_RootFromNode(MD_Node *node)
+typedef struct MD_CompactOpenNode MD_CompactOpenNode;
+struct MD_CompactOpenNode
 {
-    MD_Node *parent = node;
-    for(MD_Node *p = parent; !MD_NodeIsNil(p); p = p->parent)
-    {
-        parent = p;
-    }
-    return parent;
-}
+    MD_CompactNode *compact;
+    MD_CompactNode *last_child;
+    MD_CompactNode *last_tag;
+};
 
-MD_FUNCTION MD_Node *
-MD_ChildFromString(MD_Node *node, MD_String8 child_string, MD_MatchFlags flags)
+MD_FUNCTION MD_CompactTree
+MD_CompactTreeFromNode(MD_Arena *arena, MD_Node *root, MD_SymbolTable *symbols)
 {
-    return MD_FirstNodeWithString(node->first_child, child_string, flags);
+    MD_CompactTree result = MD_ZERO_STRUCT;
+    MD_ArenaTemp scratch = MD_GetScratch(&arena, 1);
+    
+    //- count nodes, and nodes with comments or references
+    MD_u64 reference_count = 0;
+    for(MD_NodeIter it = MD_NodeIterBegin(scratch.arena, root, MD_NodeIterFlags_Tree);
+        !MD_NodeIsNil(MD_NodeIterNext(&it));)
+    {
+        MD_Node *node = it.node;
+        result.count += 1;
+        if(node->prev_comment.size != 0 || node->next_comment.size != 0 || node->kind == MD_NodeKind_Reference)
+        {
+            result.extra_count += 1;
+            reference_count += (node->kind == MD_NodeKind_Reference);
+        }
+    }
+    result.nodes = MD_PushArray(arena, MD_CompactNode, result.count);
+    result.raw_strings = MD_PushArray(arena, MD_String8, result.count);
+    result.offsets = MD_PushArray(arena, MD_u64, result.count);
+    result.extras = MD_PushArrayZero(arena, MD_CompactNodeExtra, result.extra_count);
+    
+    //- fill nodes, linking each to the open node one level up, its parent
+    MD_CompactOpenNode *open = MD_PushArray(scratch.arena, MD_CompactOpenNode, result.count);
+    MD_u64 open_count = 0;
+    MD_Node **ref_targets = MD_PushArray(scratch.arena, MD_Node *, result.extra_count);
+    MD_Map compact_from_node = MD_ZERO_STRUCT;
+    if(reference_count != 0)
+    {
+        compact_from_node = MD_MapMakeBucketCount(scratch.arena, result.count);
+    }
+    MD_u64 index = 0;
+    MD_u64 extra_index = 0;
+    for(MD_NodeIter it = MD_NodeIterBegin(scratch.arena, root, MD_NodeIterFlags_Tree);
+        !MD_NodeIsNil(MD_NodeIterNext(&it)); index += 1)
+    {
+        MD_Node *node = it.node;
+        MD_CompactNode *compact = &result.nodes[index];
+        compact->next = compact->parent = compact->first_child = compact->first_tag = MD_CompactNilNode();
+        compact->kind = node->kind;
+        compact->symbol = (symbols != 0 ? MD_SymbolFromNode(symbols, node) : 0);
+        compact->flags = node->flags;
+        compact->string = node->string;
+        result.raw_strings[index] = node->raw_string;
+        result.offsets[index] = node->offset;
+        
+        open_count = (MD_u64)it.depth;
+        if(open_count > 0)
+        {
+            MD_CompactOpenNode *parent = &open[open_count - 1];
+            compact->parent = parent->compact;
+            MD_CompactNode **last = (node->kind == MD_NodeKind_Tag ? &parent->last_tag : &parent->last_child);
+            if(*last == 0)
+            {
+                *(node->kind == MD_NodeKind_Tag ? &parent->compact->first_tag : &parent->compact->first_child) = compact;
+            }
+            else
+            {
+                (*last)->next = compact;
+            }
+            *last = compact;
+        }
+        MD_CompactOpenNode *opened = &open[open_count];
+        open_count += 1;
+        opened->compact = compact;
+        opened->last_child = opened->last_tag = 0;
+        
+        if(node->prev_comment.size != 0 || node->next_comment.size != 0 || node->kind == MD_NodeKind_Reference)
+        {
+            MD_CompactNodeExtra *extra = &result.extras[extra_index];
+            extra->index = index;
+            extra->ref_target = MD_CompactNilNode();
+            extra->prev_comment = node->prev_comment;
+            extra->next_comment = node->next_comment;
+            ref_targets[extra_index] = node->ref_target;
+            extra_index += 1;
+        }
+        if(reference_count != 0)
+        {
+            MD_MapInsert(scratch.arena, &compact_from_node, MD_MapKeyPtr(node), compact);
+        }
+    }
+    
+    //- resolve references to nodes in the tree
+    if(reference_count != 0)
+    {
+        for(MD_u64 i = 0; i < result.extra_count; i += 1)
+        {
+            MD_MapSlot *slot = MD_MapLookup(&compact_from_node, MD_MapKeyPtr(ref_targets[i]));
+            if(slot != 0)
+            {
+                result.extras[i].ref_target = (MD_CompactNode *)slot->val;
+            }
+        }
+    }
+    
+    MD_ReleaseScratch(scratch);
+    return result;
 }
 
-MD_FUNCTION MD_Node *
-MD_TagFromString(MD_Node *node, MD_String8 tag_string, MD_MatchFlags flags)
+MD_FUNCTION MD_CompactNode *
+MD_CompactNilNode(void)
 {
-    return MD_FirstNodeWithString(node->first_tag, tag_string, flags);
+    return &_md_nil_compact_node;
 }
 
-MD_FUNCTION MD_Node *
-MD_ChildFromIndex(MD_Node *node, int n)
+MD_FUNCTION MD_b32
+MD_CompactNodeIsNil(MD_CompactNode *node)
 {
-    return MD_NodeAtIndex(node->first_child, n);
+    return(node == 0 || node == &_md_nil_compact_node || node->kind == MD_NodeKind_Nil);
 }
 
-MD_FUNCTION MD_Node *
-MD_TagFromIndex(MD_Node *node, int n)
+static MD_u64
+MD_CompactIndexFromNode(MD_CompactTree *tree, MD_CompactNode *node)
 {
-    return MD_NodeAtIndex(node->first_tag, n);
+    MD_u64 result = tree->count;
+    if(!MD_CompactNodeIsNil(node) && tree->nodes <= node && node < tree->nodes + tree->count)
+    {
+        result = (MD_u64)(node - tree->nodes);
+    }
+    return result;
 }
 
-MD_FUNCTION MD_Node *
-MD_TagArgFromIndex(MD_Node *node, MD_String8 tag_string, MD_MatchFlags flags, int n)
+static MD_CompactNodeExtra *
+MD_CompactExtraFromNode(MD_CompactTree *tree, MD_CompactNode *node)
 {
-    MD_Node *tag = MD_TagFromString(node, tag_string, flags);
-    return MD_ChildFromIndex(tag, n);
+    MD_CompactNodeExtra *result = 0;
+    MD_u64 index = MD_CompactIndexFromNode(tree, node);
+    MD_u64 min = 0;
+    MD_u64 max = tree->extra_count;
+    for(;min < max;)
+    {
+        MD_u64 mid = min + (max - min)/2;
+        if(tree->extras[mid].index < index)
+        {
+            min = mid + 1;
+        }
+        else
+        {
+            max = mid;
+        }
+    }
+    if(min < tree->extra_count && tree->extras[min].index == index)
+    {
+        result = &tree->extras[min];
+    }
+    return result;
 }
 
-MD_FUNCTION MD_Node *
-MD_TagArgFromString(MD_Node *node, MD_String8 tag_string, MD_MatchFlags tag_str_flags, MD_String8 arg_string, MD_MatchFlags arg_str_flags)
+MD_FUNCTION MD_String8
+MD_RawStringFromCompactNode(MD_CompactTree *tree, MD_CompactNode *node)
 {
-    MD_Node *tag = MD_TagFromString(node, tag_string, tag_str_flags);
-    MD_Node *arg = MD_ChildFromString(tag, arg_string, arg_str_flags);
-    return arg;
+    MD_String8 result = MD_ZERO_STRUCT;
+    MD_u64 index = MD_CompactIndexFromNode(tree, node);
+    if(index < tree->count)
+    {
+        result = tree->raw_strings[index];
+    }
+    return result;
 }
 
-MD_FUNCTION MD_b32
-MD_NodeHasChild(MD_Node *node, MD_String8 string, MD_MatchFlags flags)
+MD_FUNCTION MD_u64
+MD_OffsetFromCompactNode(MD_CompactTree *tree, MD_CompactNode *node)
 {
-    return !MD_NodeIsNil(MD_ChildFromString(node, string, flags));
+    MD_u64 result = 0;
+    MD_u64 index = MD_CompactIndexFromNode(tree, node);
+    if(index < tree->count)
+    {
+        result = tree->offsets[index];
+    }
+    return result;
 }
 
-MD_FUNCTION MD_b32
-MD_NodeHasTag(MD_Node *node, MD_String8 string, MD_MatchFlags flags)
+MD_FUNCTION MD_String8
+MD_PrevCommentFromCompactNode(MD_CompactTree *tree, MD_CompactNode *node)
 {
-    return !MD_NodeIsNil(MD_TagFromString(node, string, flags));
+    MD_String8 result = MD_ZERO_STRUCT;
+    MD_CompactNodeExtra *extra = MD_CompactExtraFromNode(tree, node);
+    if(extra != 0)
+    {
+        result = extra->prev_comment;
+    }
+    return result;
 }
 
-MD_FUNCTION MD_i64
-MD_ChildCountFromNode(MD_Node *node)
+MD_FUNCTION MD_String8
+MD_NextCommentFromCompactNode(MD_CompactTree *tree, MD_CompactNode *node)
 {
-    MD_i64 result = 0;
-    for(MD_EachNode(child, node->first_child))
+    MD_String8 result = MD_ZERO_STRUCT;
+    MD_CompactNodeExtra *extra = MD_CompactExtraFromNode(tree, node);
+    if(extra != 0)
     {
-        result += 1;
+        result = extra->next_comment;
     }
     return result;
 }
 
-MD_FUNCTION MD_i64
-MD_TagCountFromNode(MD_Node *node)
+MD_FUNCTION MD_CompactNode *
+MD_RefTargetFromCompactNode(MD_CompactTree *tree, MD_CompactNode *node)
 {
-    MD_i64 result = 0;
-    for(MD_EachNode(tag, node->first_tag))
+    MD_CompactNode *result = MD_CompactNilNode();
+    MD_CompactNodeExtra *extra = MD_CompactExtraFromNode(tree, node);
+    if(extra != 0)
     {
-        result += 1;
+        result = extra->ref_target;
     }
     return result;
 }
 
-MD_FUNCTION MD_Node *
-MD_ResolveNodeFromReference(MD_Node *node)
+//~ Frozen Trees
+
+typedef struct MD_TreeOpenNode MD_TreeOpenNode;
+struct MD_TreeOpenNode
 {
-    MD_u64 safety = 100;
-    for(; safety > 0 && node->kind == MD_NodeKind_Reference;
-        safety -= 1, node = node->ref_target);
-    MD_Node *result = node;
-    return(result);
-}
+    MD_u32 index;
+    MD_u32 last_child;
+    MD_u32 last_tag;
+};
 
-MD_FUNCTION MD_Node*
-MD_NodeNextWithLimit(MD_Node *node, MD_Node *opl)
+MD_FUNCTION MD_Tree
+MD_FreezeTree(MD_Arena *arena, MD_Node *root)
 {
-    node = node->next;
-    if (node == opl)
+    MD_Tree result = MD_ZERO_STRUCT;
+    MD_ArenaTemp scratch = MD_GetScratch(&arena, 1);
+    
+    //- count nodes and string bytes
+    MD_u64 count = 1;
+    MD_u64 strings_size = 0;
+    for(MD_NodeIter it = MD_NodeIterBegin(scratch.arena, root, MD_NodeIterFlags_Tree);
+        !MD_NodeIsNil(MD_NodeIterNext(&it));)
     {
-        node = MD_NilNode();
+        MD_Node *node = it.node;
+        count += 1;
+        strings_size += node->string.size;
     }
-    return(node);
+    
+    // NOTE: indices and string offsets are 32-bit; larger trees are not frozen.
+    if(count <= 0xFFFFFFFFull && strings_size <= 0xFFFFFFFFull)
+    {
+        result.count = (MD_u32)count;
+        result.kinds = MD_PushArray(arena, MD_u8, count);
+        result.flags = MD_PushArray(arena, MD_u32, count);
+        result.string_offsets = MD_PushArray(arena, MD_u32, count);
+        result.string_sizes = MD_PushArray(arena, MD_u32, count);
+        result.first_child = MD_PushArray(arena, MD_u32, count);
+        result.first_tag = MD_PushArray(arena, MD_u32, count);
+        result.next_sibling = MD_PushArray(arena, MD_u32, count);
+        result.parent = MD_PushArray(arena, MD_u32, count);
+        result.strings = MD_S8(MD_PushArray(arena, MD_u8, strings_size), strings_size);
+        
+        //- fill the nil node
+        result.kinds[0] = MD_NodeKind_Nil;
+        result.flags[0] = 0;
+        result.string_offsets[0] = result.string_sizes[0] = 0;
+        result.first_child[0] = result.first_tag[0] = result.next_sibling[0] = result.parent[0] = 0;
+        
+        //- fill nodes, linking each to the open node one level up, its parent
+        MD_TreeOpenNode *open = MD_PushArray(scratch.arena, MD_TreeOpenNode, count);
+        MD_u64 open_count = 0;
+        MD_u32 index = 1;
+        MD_u64 string_offset = 0;
+        for(MD_NodeIter it = MD_NodeIterBegin(scratch.arena, root, MD_NodeIterFlags_Tree);
+            !MD_NodeIsNil(MD_NodeIterNext(&it)); index += 1)
+        {
+            MD_Node *node = it.node;
+            result.kinds[index] = (MD_u8)node->kind;
+            result.flags[index] = (MD_u32)node->flags;
+            result.string_offsets[index] = (MD_u32)string_offset;
+            result.string_sizes[index] = (MD_u32)node->string.size;
+            MD_MemoryCopy(result.strings.str + string_offset, node->string.str, node->string.size);
+            string_offset += node->string.size;
+            result.first_child[index] = result.first_tag[index] = result.next_sibling[index] = 0;
+            result.parent[index] = 0;
+            
+            open_count = (MD_u64)it.depth;
+            if(open_count > 0)
+            {
+                MD_TreeOpenNode *parent = &open[open_count - 1];
+                result.parent[index] = parent->index;
+                MD_b32 is_tag = (node->kind == MD_NodeKind_Tag);
+                MD_u32 *last = (is_tag ? &parent->last_tag : &parent->last_child);
+                if(*last == 0)
+                {
+                    (is_tag ? result.first_tag : result.first_child)[parent->index] = index;
+                }
+                else
+                {
+                    result.next_sibling[*last] = index;
+                }
+                *last = index;
+            }
+            MD_TreeOpenNode *opened = &open[open_count];
+            open_count += 1;
+            opened->index = index;
+            opened->last_child = opened->last_tag = 0;
+        }
+    }
+    
+    MD_ReleaseScratch(scratch);
+    return result;
 }
 
 MD_FUNCTION MD_String8
-MD_PrevCommentFromNode(MD_Node *node)
+MD_TreeStringFromNode(MD_Tree *tree, MD_u32 node)
 {
-    return(node->prev_comment);
+    return MD_S8(tree->strings.str + tree->string_offsets[node], tree->string_sizes[node]);
 }
 
-MD_FUNCTION MD_String8
-MD_NextCommentFromNode(MD_Node *node)
+MD_FUNCTION MD_u32
+MD_TreeChildFromString(MD_Tree *tree, MD_u32 node, MD_String8 child_string, MD_MatchFlags flags)
 {
-    return(node->next_comment);
+    MD_u32 result = 0;
+    for(MD_TreeEachChild(child, tree, node))
+    {
+        if(MD_S8Match(child_string, MD_TreeStringFromNode(tree, child), flags))
+        {
+            result = child;
+            break;
+        }
+    }
+    return result;
 }
 
-//~ Error/Warning Helpers
-
-MD_FUNCTION MD_String8
-MD_StringFromMessageKind(MD_MessageKind kind)
+MD_FUNCTION MD_u32
+MD_TreeTagFromString(MD_Tree *tree, MD_u32 node, MD_String8 tag_string, MD_MatchFlags flags)
 {
-    MD_String8 result = MD_ZERO_STRUCT;
-    switch (kind)
+    MD_u32 result = 0;
+    for(MD_TreeEachTag(tag, tree, node))
     {
-        default: break;
-        case MD_MessageKind_Note:       result = MD_S8Lit("note");        break;
-        case MD_MessageKind_Warning:    result = MD_S8Lit("warning");     break;
-        case MD_MessageKind_Error:      result = MD_S8Lit("error");       break;
-        case MD_MessageKind_FatalError: result = MD_S8Lit("fatal error"); break;
+        if(MD_S8Match(tag_string, MD_TreeStringFromNode(tree, tag), flags))
+        {
+            result = tag;
+            break;
+        }
     }
-    return(result);
+    return result;
 }
 
-MD_FUNCTION MD_String8
-MD_FormatMessage(MD_Arena *arena, MD_CodeLoc loc, MD_MessageKind kind, MD_String8 string)
+MD_FUNCTION MD_u32
+MD_TreeChildFromIndex(MD_Tree *tree, MD_u32 node, int n)
 {
-    MD_String8 kind_string = MD_StringFromMessageKind(kind);
-    MD_String8 result = MD_S8Fmt(arena, "" MD_FmtCodeLoc " %.*s: %.*s\n",
-                                 MD_CodeLocVArg(loc), MD_S8VArg(kind_string), MD_S8VArg(string));
-    return(result);
+    MD_u32 result = 0;
+    for(MD_TreeEachChild(child, tree, node))
+    {
+        if(n == 0)
+        {
+            result = child;
+            break;
+        }
+        n -= 1;
+    }
+    return result;
 }
 
-#if !MD_DISABLE_PRINT_HELPERS
-
-MD_FUNCTION void
-MD_PrintMessage(FILE *file, MD_CodeLoc code_loc, MD_MessageKind kind, MD_String8 string)
+MD_FUNCTION MD_u32
+MD_TreeTagFromIndex(MD_Tree *tree, MD_u32 node, int n)
 {
-    MD_ArenaTemp scratch = MD_GetScratch(0, 0);
-    MD_String8 message = MD_FormatMessage(scratch.arena, code_loc, kind, string);
-    fwrite(message.str, message.size, 1, file);
-    MD_ReleaseScratch(scratch);
+    MD_u32 result = 0;
+    for(MD_TreeEachTag(tag, tree, node))
+    {
+        if(n == 0)
+        {
+            result = tag;
+            break;
+        }
+        n -= 1;
+    }
+    return result;
 }
 
-MD_FUNCTION void
-MD_PrintMessageFmt(FILE *file, MD_CodeLoc code_loc, MD_MessageKind kind, char *fmt, ...)
+MD_FUNCTION MD_b32
+MD_TreeNodeHasTag(MD_Tree *tree, MD_u32 node, MD_String8 string, MD_MatchFlags flags)
 {
-    MD_ArenaTemp scratch = MD_GetScratch(0, 0);
-    va_list args;
-    va_start(args, fmt);
-    MD_String8 string = MD_S8FmtV(scratch.arena, fmt, args);
-    va_end(args);
-    MD_String8 message = MD_FormatMessage(scratch.arena, code_loc, kind, string);
-    fwrite(message.str, message.size, 1, file);
-    MD_ReleaseScratch(scratch);
+    return MD_TreeTagFromString(tree, node, string, flags) != 0;
 }
 
-#endif
-
-//~ Tree Comparison/Verification
-
-MD_FUNCTION MD_b32
-MD_NodeMatch(MD_Node *a, MD_Node *b, MD_MatchFlags flags)
+MD_FUNCTION MD_i64
+MD_TreeChildCountFromNode(MD_Tree *tree, MD_u32 node)
 {
-    MD_b32 result = 0;
-    if(a->kind == b->kind && MD_S8Match(a->string, b->string, flags))
+    MD_i64 result = 0;
+    for(MD_TreeEachChild(child, tree, node))
     {
-        result = 1;
-        if(result && flags & MD_NodeMatchFlag_NodeFlags)
-        {
-            result = result && a->flags == b->flags;
-        }
-        if(result && a->kind != MD_NodeKind_Tag && (flags & MD_NodeMatchFlag_Tags))
-        {
-            for(MD_Node *a_tag = a->first_tag, *b_tag = b->first_tag;
-                !MD_NodeIsNil(a_tag) || !MD_NodeIsNil(b_tag);
-                a_tag = a_tag->next, b_tag = b_tag->next)
-            {
-                if(MD_NodeMatch(a_tag, b_tag, flags))
-                {
-                    if(flags & MD_NodeMatchFlag_TagArguments)
-                    {
-                        for(MD_Node *a_tag_arg = a_tag->first_child, *b_tag_arg = b_tag->first_child;
-                            !MD_NodeIsNil(a_tag_arg) || !MD_NodeIsNil(b_tag_arg);
-                            a_tag_arg = a_tag_arg->next, b_tag_arg = b_tag_arg->next)
-                        {
-                            if(!MD_NodeDeepMatch(a_tag_arg, b_tag_arg, flags))
-                            {
-                                result = 0;
-                                goto end;
-                            }
-                        }
-                    }
-                }
-                else
-                {
-                    result = 0;
-                    goto end;
-                }
-            }
-        }
+        result += 1;
     }
-    end:;
     return result;
 }
 
-MD_FUNCTION MD_b32
-MD_NodeDeepMatch(MD_Node *a, MD_Node *b, MD_MatchFlags flags)
+MD_FUNCTION MD_i64
+MD_TreeTagCountFromNode(MD_Tree *tree, MD_u32 node)
 {
-    MD_b32 result = MD_NodeMatch(a, b, flags);
-    if(result)
+    MD_i64 result = 0;
+    for(MD_TreeEachTag(tag, tree, node))
     {
-        for(MD_Node *a_child = a->first_child, *b_child = b->first_child;
-            !MD_NodeIsNil(a_child) || !MD_NodeIsNil(b_child);
-            a_child = a_child->next, b_child = b_child->next)
-        {
-            if(!MD_NodeDeepMatch(a_child, b_child, flags))
-            {
-                result = 0;
-                goto end;
-            }
-        }
+        result += 1;
     }
-    end:;
     return result;
 }
 
@@ -3721,7 +8795,7 @@ MD_ExprParse_Atom(MD_Arena *arena, MD_ExprParseCtx *ctx, MD_Node **iter,
             (node->flags & MD_NodeFlag_HasParenRight))
     { // NOTE(mal): Parens
         *iter = MD_NodeNextWithLimit(*iter, opl);
-        result = MD_ExprParse_TopLevel(arena, ctx, node->first_child, MD_NilNode());
+        result = MD_ExprParse_TopLevel(arena, ctx, MD_FirstChildFromNode(node), MD_NilNode());
     }
     else if(((node->flags & MD_NodeFlag_HasBraceLeft)   && (node->flags & MD_NodeFlag_HasBraceRight))   ||
             ((node->flags & MD_NodeFlag_HasBracketLeft) && (node->flags & MD_NodeFlag_HasBracketRight)) ||
@@ -3841,10 +8915,65 @@ MD_ExprParse_MinPrecedence(MD_Arena *arena, MD_ExprParseCtx *ctx,
 
 //~ String Generation
 
-MD_FUNCTION void
-MD_DebugDumpFromNode(MD_Arena *arena, MD_String8List *out, MD_Node *node,
-                     int indent, MD_String8 indent_string, MD_GenerateFlags flags)
+// NOTE: the generators walk with an MD_NodeIter and keep, for each node
+// entered but not yet left, what the recursive version kept on its stack.
+typedef struct MD_GenerateFrame MD_GenerateFrame;
+struct MD_GenerateFrame
+{
+    MD_GenerateFrame *next;
+    MD_Node *node;
+    int indent;
+    MD_String8 indent_string;
+    MD_b32 is_tag;
+    
+    // Used by MD_ReconstructionFromNode. For a tag, last_line is the line
+    // of its last argument so far; otherwise, of its last child so far.
+    MD_CodeLoc code_loc;
+    MD_u32 tag_first_line;
+    MD_u32 tag_last_line;
+    MD_u32 last_line;
+    MD_String8 closer;
+};
+
+static MD_GenerateFrame *
+MD_PushGenerateFrame(MD_Arena *arena, MD_GenerateFrame **top, MD_GenerateFrame **free_frame, MD_Node *node)
+{
+    MD_GenerateFrame *frame = *free_frame;
+    if(frame != 0)
+    {
+        *free_frame = frame->next;
+    }
+    else
+    {
+        frame = MD_PushArray(arena, MD_GenerateFrame, 1);
+    }
+    MD_MemoryZeroStruct(frame);
+    frame->node = node;
+    frame->is_tag = (*top != 0 && !(*top)->is_tag && node->kind == MD_NodeKind_Tag);
+    frame->next = *top;
+    *top = frame;
+    return frame;
+}
+
+static MD_NodeIterFlags
+MD_NodeIterFlagsFromGenerateFlags(MD_GenerateFlags flags)
 {
+    MD_NodeIterFlags result = MD_NodeIterFlag_PreOrder|MD_NodeIterFlag_PostOrder;
+    if(flags & MD_GenerateFlag_Children)
+    {
+        result |= MD_NodeIterFlag_Children;
+    }
+    if(flags & MD_GenerateFlag_Tags)
+    {
+        result |= MD_NodeIterFlag_Tags;
+    }
+    if(flags & MD_GenerateFlag_TagArguments)
+    {
+        result |= MD_NodeIterFlag_TagArguments;
+    }
+    return result;
+}
+
 #define MD_PrintIndent(_indent_level) do\
 {\
 for(int i = 0; i < (_indent_level); i += 1)\
@@ -3852,54 +8981,13 @@ for(int i = 0; i < (_indent_level); i += 1)\
 MD_S8ListPush(arena, out, indent_string);\
 }\
 }while(0)
-    
-    //- rjf: prev-comment
-    if(flags & MD_GenerateFlag_Comments && node->prev_comment.size != 0)
-    {
-        MD_PrintIndent(indent);
-        MD_S8ListPush(arena, out, MD_S8Lit("/*\n"));
-        MD_PrintIndent(indent);
-        MD_S8ListPush(arena, out, node->prev_comment);
-        MD_PrintIndent(indent);
-        MD_S8ListPush(arena, out, MD_S8Lit("\n"));
-        MD_PrintIndent(indent);
-        MD_S8ListPush(arena, out, MD_S8Lit("*/\n"));
-    }
-    
-    //- rjf: tags of node
-    if(flags & MD_GenerateFlag_Tags)
-    {
-        for(MD_EachNode(tag, node->first_tag))
-        {
-            MD_PrintIndent(indent);
-            MD_S8ListPush(arena, out, MD_S8Lit("@"));
-            MD_S8ListPush(arena, out, tag->string);
-            if(flags & MD_GenerateFlag_TagArguments && !MD_NodeIsNil(tag->first_child))
-            {
-                int tag_arg_indent = (int)(indent + 1 + tag->string.size + 1);
-                MD_S8ListPush(arena, out, MD_S8Lit("("));
-                for(MD_EachNode(child, tag->first_child))
-                {
-                    int child_indent = tag_arg_indent;
-                    if(MD_NodeIsNil(child->prev))
-                    {
-                        child_indent = 0;
-                    }
-                    MD_DebugDumpFromNode(arena, out, child, child_indent, MD_S8Lit(" "), flags);
-                    if(!MD_NodeIsNil(child->next))
-                    {
-                        MD_S8ListPush(arena, out, MD_S8Lit(",\n"));
-                    }
-                }
-                MD_S8ListPush(arena, out, MD_S8Lit(")\n"));
-            }
-            else
-            {
-                MD_S8ListPush(arena, out, MD_S8Lit("\n"));
-            }
-        }
-    }
-    
+
+// The part of a dumped node that comes after its tags and before its
+// children.
+static void
+MD_DebugDumpNodeHeader(MD_Arena *arena, MD_String8List *out, MD_Node *node,
+                       int indent, MD_String8 indent_string, MD_GenerateFlags flags)
+{
     //- rjf: node kind
     if(flags & MD_GenerateFlag_NodeKind)
     {
@@ -3948,8 +9036,8 @@ MD_S8ListPush(arena, out, indent_string);\
         }
     }
     
-    //- rjf: children list
-    if(flags & MD_GenerateFlag_Children && !MD_NodeIsNil(node->first_child))
+    //- rjf: children list opener
+    if(flags & MD_GenerateFlag_Children && !MD_NodeIsNil(MD_FirstChildFromNode(node)))
     {
         if(node->string.size != 0)
         {
@@ -3957,125 +9045,158 @@ MD_S8ListPush(arena, out, indent_string);\
         }
         MD_PrintIndent(indent);
         MD_S8ListPush(arena, out, MD_S8Lit("{\n"));
-        for(MD_EachNode(child, node->first_child))
-        {
-            MD_DebugDumpFromNode(arena, out, child, indent+1, indent_string, flags);
-            MD_S8ListPush(arena, out, MD_S8Lit(",\n"));
-        }
-        MD_PrintIndent(indent);
-        MD_S8ListPush(arena, out, MD_S8Lit("}"));
-    }
-    
-    //- rjf: next-comment
-    if(flags & MD_GenerateFlag_Comments && node->next_comment.size != 0)
-    {
-        MD_PrintIndent(indent);
-        MD_S8ListPush(arena, out, MD_S8Lit("\n/*\n"));
-        MD_PrintIndent(indent);
-        MD_S8ListPush(arena, out, node->next_comment);
-        MD_PrintIndent(indent);
-        MD_S8ListPush(arena, out, MD_S8Lit("\n"));
-        MD_PrintIndent(indent);
-        MD_S8ListPush(arena, out, MD_S8Lit("*/\n"));
     }
-    
-#undef MD_PrintIndent
 }
 
 MD_FUNCTION void
-MD_ReconstructionFromNode(MD_Arena *arena, MD_String8List *out, MD_Node *node,
-                          int indent, MD_String8 indent_string)
+MD_DebugDumpFromNode(MD_Arena *arena, MD_String8List *out, MD_Node *node,
+                     int indent, MD_String8 indent_string, MD_GenerateFlags flags)
 {
-    MD_CodeLoc code_loc = MD_CodeLocFromNode(node);
-    
-#define MD_PrintIndent(_indent_level) do\
-{\
-for(int i = 0; i < (_indent_level); i += 1)\
-{\
-MD_S8ListPush(arena, out, indent_string);\
-}\
-}while(0)
-    
-    //- rjf: prev-comment
-    if(node->prev_comment.size != 0)
-    {
-        MD_String8 comment = MD_S8SkipWhitespace(MD_S8ChopWhitespace(node->prev_comment));
-        MD_b32 requires_multiline = MD_S8FindSubstring(comment, MD_S8Lit("\n"), 0, 0) < comment.size;
-        MD_PrintIndent(indent);
-        if(requires_multiline)
-        {
-            MD_S8ListPush(arena, out, MD_S8Lit("/*\n"));
-        }
-        else
-        {
-            MD_S8ListPush(arena, out, MD_S8Lit("// "));
-        }
-        MD_S8ListPush(arena, out, comment);
-        if(requires_multiline)
-        {
-            MD_S8ListPush(arena, out, MD_S8Lit("\n*/\n"));
-        }
-        else
-        {
-            MD_S8ListPush(arena, out, MD_S8Lit("\n"));
-        }
-    }
-    
-    //- rjf: tags of node
-    MD_u32 tag_first_line = MD_CodeLocFromNode(node->first_tag).line;
-    MD_u32 tag_last_line = tag_first_line;
+    MD_ArenaTemp scratch = MD_GetScratch(&arena, 1);
+    MD_GenerateFrame *top = 0;
+    MD_GenerateFrame *free_frame = 0;
+    MD_NodeIter it = MD_NodeIterBegin(scratch.arena, node, MD_NodeIterFlagsFromGenerateFlags(flags));
+    for(;!MD_NodeIsNil(MD_NodeIterNext(&it));)
     {
-        for(MD_EachNode(tag, node->first_tag))
+        node = it.node;
+        
+        //- entering a node
+        if(!it.leaving)
         {
-            MD_u32 tag_line = MD_CodeLocFromNode(tag).line;
-            if(tag_line != tag_last_line)
+            MD_GenerateFrame *parent = top;
+            MD_GenerateFrame *frame = MD_PushGenerateFrame(scratch.arena, &top, &free_frame, node);
+            if(parent == 0)
             {
-                MD_S8ListPush(arena, out, MD_S8Lit("\n"));
-                tag_last_line = tag_line;
+                frame->indent = indent;
+                frame->indent_string = indent_string;
             }
-            else if(!MD_NodeIsNil(tag->prev))
+            else if(frame->is_tag)
             {
-                MD_S8ListPush(arena, out, MD_S8Lit(" "));
+                frame->indent = parent->indent;
+                frame->indent_string = parent->indent_string;
+            }
+            else if(parent->is_tag)
+            {
+                int tag_arg_indent = (int)(parent->indent + 1 + parent->node->string.size + 1);
+                frame->indent = MD_NodeIsNil(node->prev) ? 0 : tag_arg_indent;
+                frame->indent_string = MD_S8Lit(" ");
+            }
+            else
+            {
+                frame->indent = parent->indent + 1;
+                frame->indent_string = parent->indent_string;
             }
+            indent = frame->indent;
+            indent_string = frame->indent_string;
             
-            MD_PrintIndent(indent);
-            MD_S8ListPush(arena, out, MD_S8Lit("@"));
-            MD_S8ListPush(arena, out, tag->string);
-            if(!MD_NodeIsNil(tag->first_child))
+            //- rjf: tag
+            if(frame->is_tag)
             {
-                int tag_arg_indent = (int)(indent + 1 + tag->string.size + 1);
-                MD_S8ListPush(arena, out, MD_S8Lit("("));
-                MD_u32 last_line = MD_CodeLocFromNode(tag).line;
-                for(MD_EachNode(child, tag->first_child))
+                MD_PrintIndent(indent);
+                MD_S8ListPush(arena, out, MD_S8Lit("@"));
+                MD_S8ListPush(arena, out, node->string);
+                if(flags & MD_GenerateFlag_TagArguments && !MD_NodeIsNil(node->first_child))
                 {
-                    MD_CodeLoc child_loc = MD_CodeLocFromNode(child);
-                    if(child_loc.line != last_line)
-                    {
-                        MD_S8ListPush(arena, out, MD_S8Lit("\n"));
-                        MD_PrintIndent(indent);
-                    }
-                    last_line = child_loc.line;
-                    
-                    int child_indent = tag_arg_indent;
-                    if(MD_NodeIsNil(child->prev))
-                    {
-                        child_indent = 0;
-                    }
-                    MD_ReconstructionFromNode(arena, out, child, child_indent, MD_S8Lit(" "));
-                    if(!MD_NodeIsNil(child->next))
-                    {
-                        MD_S8ListPush(arena, out, MD_S8Lit(",\n"));
-                    }
+                    MD_S8ListPush(arena, out, MD_S8Lit("("));
+                }
+                else
+                {
+                    MD_S8ListPush(arena, out, MD_S8Lit("\n"));
+                }
+            }
+            else
+            {
+                //- rjf: prev-comment
+                if(flags & MD_GenerateFlag_Comments && node->prev_comment.size != 0)
+                {
+                    MD_PrintIndent(indent);
+                    MD_S8ListPush(arena, out, MD_S8Lit("/*\n"));
+                    MD_PrintIndent(indent);
+                    MD_S8ListPush(arena, out, node->prev_comment);
+                    MD_PrintIndent(indent);
+                    MD_S8ListPush(arena, out, MD_S8Lit("\n"));
+                    MD_PrintIndent(indent);
+                    MD_S8ListPush(arena, out, MD_S8Lit("*/\n"));
+                }
+                
+                // NOTE: otherwise this comes after the last tag is left.
+                if(!(flags & MD_GenerateFlag_Tags) || MD_NodeIsNil(node->first_tag))
+                {
+                    MD_DebugDumpNodeHeader(arena, out, node, indent, indent_string, flags);
+                }
+            }
+        }
+        
+        //- leaving a node
+        else
+        {
+            MD_GenerateFrame *frame = top;
+            MD_GenerateFrame *parent = frame->next;
+            indent = frame->indent;
+            indent_string = frame->indent_string;
+            
+            //- rjf: tag
+            if(frame->is_tag)
+            {
+                if(flags & MD_GenerateFlag_TagArguments && !MD_NodeIsNil(node->first_child))
+                {
+                    MD_S8ListPush(arena, out, MD_S8Lit(")\n"));
+                }
+                if(MD_NodeIsNil(node->next))
+                {
+                    MD_DebugDumpNodeHeader(arena, out, parent->node, indent, indent_string, flags);
+                }
+            }
+            else
+            {
+                //- rjf: children list closer
+                if(flags & MD_GenerateFlag_Children && !MD_NodeIsNil(MD_FirstChildFromNode(node)))
+                {
+                    MD_PrintIndent(indent);
+                    MD_S8ListPush(arena, out, MD_S8Lit("}"));
+                }
+                
+                //- rjf: next-comment
+                if(flags & MD_GenerateFlag_Comments && node->next_comment.size != 0)
+                {
+                    MD_PrintIndent(indent);
+                    MD_S8ListPush(arena, out, MD_S8Lit("\n/*\n"));
+                    MD_PrintIndent(indent);
+                    MD_S8ListPush(arena, out, node->next_comment);
+                    MD_PrintIndent(indent);
+                    MD_S8ListPush(arena, out, MD_S8Lit("\n"));
+                    MD_PrintIndent(indent);
+                    MD_S8ListPush(arena, out, MD_S8Lit("*/\n"));
+                }
+                
+                //- rjf: separator, in the list that holds the node
+                if(parent != 0 && (!parent->is_tag || !MD_NodeIsNil(node->next)))
+                {
+                    MD_S8ListPush(arena, out, MD_S8Lit(",\n"));
                 }
-                MD_S8ListPush(arena, out, MD_S8Lit(")"));
             }
+            
+            top = parent;
+            frame->next = free_frame;
+            free_frame = frame;
         }
     }
+    MD_ReleaseScratch(scratch);
+}
+
+// The part of a reconstructed node that comes after its tags and before its
+// children.
+static void
+MD_ReconstructionNodeHeader(MD_Arena *arena, MD_String8List *out, MD_GenerateFrame *frame)
+{
+    MD_Node *node = frame->node;
+    int indent = frame->indent;
+    MD_String8 indent_string = frame->indent_string;
     
     //- rjf: name of node
     if(node->string.size != 0)
     {
-        if(tag_first_line != tag_last_line)
+        if(frame->tag_first_line != frame->tag_last_line)
         {
             MD_S8ListPush(arena, out, MD_S8Lit("\n"));
             MD_PrintIndent(indent);
@@ -4096,8 +9217,8 @@ MD_S8ListPush(arena, out, indent_string);\
         }
     }
     
-    //- rjf: children list
-    if(!MD_NodeIsNil(node->first_child))
+    //- rjf: children list opener
+    if(!MD_NodeIsNil(MD_FirstChildFromNode(node)))
     {
         if(node->string.size != 0)
         {
@@ -4105,27 +9226,29 @@ MD_S8ListPush(arena, out, indent_string);\
         }
         
         // rjf: figure out opener/closer symbols
-        MD_u8 opener_char = 0;
-        MD_u8 closer_char = 0;
-        if(node->flags & MD_NodeFlag_HasParenLeft)        { opener_char = '('; }
-        else if(node->flags & MD_NodeFlag_HasBracketLeft) { opener_char = '['; }
-        else if(node->flags & MD_NodeFlag_HasBraceLeft)   { opener_char = '{'; }
-        if(node->flags & MD_NodeFlag_HasParenRight)       { closer_char = ')'; }
-        else if(node->flags & MD_NodeFlag_HasBracketRight){ closer_char = ']'; }
-        else if(node->flags & MD_NodeFlag_HasBraceRight)  { closer_char = '}'; }
+        // NOTE: these are literals rather than characters on the stack, since
+        // the list keeps pointing at them after the node is done.
+        MD_String8 opener = MD_ZERO_STRUCT;
+        MD_String8 closer = MD_ZERO_STRUCT;
+        if(node->flags & MD_NodeFlag_HasParenLeft)        { opener = MD_S8Lit("("); }
+        else if(node->flags & MD_NodeFlag_HasBracketLeft) { opener = MD_S8Lit("["); }
+        else if(node->flags & MD_NodeFlag_HasBraceLeft)   { opener = MD_S8Lit("{"); }
+        if(node->flags & MD_NodeFlag_HasParenRight)       { closer = MD_S8Lit(")"); }
+        else if(node->flags & MD_NodeFlag_HasBracketRight){ closer = MD_S8Lit("]"); }
+        else if(node->flags & MD_NodeFlag_HasBraceRight)  { closer = MD_S8Lit("}"); }
         
         MD_b32 multiline = 0;
-        for(MD_EachNode(child, node->first_child))
+        for(MD_EachNode(child, MD_FirstChildFromNode(node)))
         {
             MD_CodeLoc child_loc = MD_CodeLocFromNode(child);
-            if(child_loc.line != code_loc.line)
+            if(child_loc.line != frame->code_loc.line)
             {
                 multiline = 1;
                 break;
             }
         }
         
-        if(opener_char != 0)
+        if(opener.size != 0)
         {
             if(multiline)
             {
@@ -4136,82 +9259,239 @@ MD_S8ListPush(arena, out, indent_string);\
             {
                 MD_S8ListPush(arena, out, MD_S8Lit(" "));
             }
-            MD_S8ListPush(arena, out, MD_S8(&opener_char, 1));
+            MD_S8ListPush(arena, out, opener);
             if(multiline)
             {
                 MD_S8ListPush(arena, out, MD_S8Lit("\n"));
                 MD_PrintIndent(indent+1);
             }
         }
-        MD_u32 last_line = MD_CodeLocFromNode(node->first_child).line;
-        for(MD_EachNode(child, node->first_child))
+        frame->closer = closer;
+        frame->last_line = MD_CodeLocFromNode(MD_FirstChildFromNode(node)).line;
+    }
+}
+
+MD_FUNCTION void
+MD_ReconstructionFromNode(MD_Arena *arena, MD_String8List *out, MD_Node *node,
+                          int indent, MD_String8 indent_string)
+{
+    MD_ArenaTemp scratch = MD_GetScratch(&arena, 1);
+    MD_GenerateFrame *top = 0;
+    MD_GenerateFrame *free_frame = 0;
+    MD_NodeIter it = MD_NodeIterBegin(scratch.arena, node, MD_NodeIterFlags_Tree|MD_NodeIterFlag_PreOrder|MD_NodeIterFlag_PostOrder);
+    for(;!MD_NodeIsNil(MD_NodeIterNext(&it));)
+    {
+        node = it.node;
+        
+        //- entering a node
+        if(!it.leaving)
         {
-            int child_indent = 0;
-            MD_CodeLoc child_loc = MD_CodeLocFromNode(child);
-            if(child_loc.line != last_line)
+            MD_GenerateFrame *parent = top;
+            MD_GenerateFrame *frame = MD_PushGenerateFrame(scratch.arena, &top, &free_frame, node);
+            
+            //- rjf: tag, in the tags of the parent
+            if(frame->is_tag)
             {
-                MD_S8ListPush(arena, out, MD_S8Lit("\n"));
+                frame->indent = parent->indent;
+                frame->indent_string = parent->indent_string;
+                indent = frame->indent;
+                indent_string = frame->indent_string;
+                
+                MD_u32 tag_line = MD_CodeLocFromNode(node).line;
+                if(tag_line != parent->tag_last_line)
+                {
+                    MD_S8ListPush(arena, out, MD_S8Lit("\n"));
+                    parent->tag_last_line = tag_line;
+                }
+                else if(!MD_NodeIsNil(node->prev))
+                {
+                    MD_S8ListPush(arena, out, MD_S8Lit(" "));
+                }
+                
                 MD_PrintIndent(indent);
-                child_indent = indent+1;
+                MD_S8ListPush(arena, out, MD_S8Lit("@"));
+                MD_S8ListPush(arena, out, node->string);
+                if(!MD_NodeIsNil(node->first_child))
+                {
+                    MD_S8ListPush(arena, out, MD_S8Lit("("));
+                    frame->last_line = tag_line;
+                }
+                continue;
             }
-            last_line = child_loc.line;
-            MD_ReconstructionFromNode(arena, out, child, child_indent, indent_string);
-        }
-        MD_PrintIndent(indent);
-        if(closer_char != 0)
-        {
-            if(last_line != code_loc.line)
+            
+            //- rjf: tag argument, in the arguments of the parent
+            if(parent != 0 && parent->is_tag)
             {
-                MD_S8ListPush(arena, out, MD_S8Lit("\n"));
-                MD_PrintIndent(indent);
+                indent = parent->indent;
+                indent_string = parent->indent_string;
+                MD_CodeLoc child_loc = MD_CodeLocFromNode(node);
+                if(child_loc.line != parent->last_line)
+                {
+                    MD_S8ListPush(arena, out, MD_S8Lit("\n"));
+                    MD_PrintIndent(indent);
+                }
+                parent->last_line = child_loc.line;
+                
+                int tag_arg_indent = (int)(parent->indent + 1 + parent->node->string.size + 1);
+                frame->indent = MD_NodeIsNil(node->prev) ? 0 : tag_arg_indent;
+                frame->indent_string = MD_S8Lit(" ");
+            }
+            
+            //- rjf: child, in the children of the parent
+            else if(parent != 0)
+            {
+                indent = parent->indent;
+                indent_string = parent->indent_string;
+                int child_indent = 0;
+                MD_CodeLoc child_loc = MD_CodeLocFromNode(node);
+                if(child_loc.line != parent->last_line)
+                {
+                    MD_S8ListPush(arena, out, MD_S8Lit("\n"));
+                    MD_PrintIndent(indent);
+                    child_indent = indent+1;
+                }
+                parent->last_line = child_loc.line;
+                
+                frame->indent = child_indent;
+                frame->indent_string = parent->indent_string;
             }
             else
             {
-                MD_S8ListPush(arena, out, MD_S8Lit(" "));
+                frame->indent = indent;
+                frame->indent_string = indent_string;
+            }
+            indent = frame->indent;
+            indent_string = frame->indent_string;
+            frame->code_loc = MD_CodeLocFromNode(node);
+            
+            //- rjf: prev-comment
+            if(node->prev_comment.size != 0)
+            {
+                MD_String8 comment = MD_S8SkipWhitespace(MD_S8ChopWhitespace(node->prev_comment));
+                MD_b32 requires_multiline = MD_S8FindSubstring(comment, MD_S8Lit("\n"), 0, 0) < comment.size;
+                MD_PrintIndent(indent);
+                if(requires_multiline)
+                {
+                    MD_S8ListPush(arena, out, MD_S8Lit("/*\n"));
+                }
+                else
+                {
+                    MD_S8ListPush(arena, out, MD_S8Lit("// "));
+                }
+                MD_S8ListPush(arena, out, comment);
+                if(requires_multiline)
+                {
+                    MD_S8ListPush(arena, out, MD_S8Lit("\n*/\n"));
+                }
+                else
+                {
+                    MD_S8ListPush(arena, out, MD_S8Lit("\n"));
+                }
+            }
+            
+            // NOTE: with tags, this comes after the last tag is left.
+            frame->tag_first_line = MD_CodeLocFromNode(node->first_tag).line;
+            frame->tag_last_line = frame->tag_first_line;
+            if(MD_NodeIsNil(node->first_tag))
+            {
+                MD_ReconstructionNodeHeader(arena, out, frame);
             }
-            MD_S8ListPush(arena, out, MD_S8(&closer_char, 1));
-        }
-    }
-    
-    //- rjf: trailing separator symbols
-    if(node->flags & MD_NodeFlag_IsBeforeSemicolon)
-    {
-        MD_S8ListPush(arena, out, MD_S8Lit(";"));
-    }
-    else if(node->flags & MD_NodeFlag_IsBeforeComma)
-    {
-        MD_S8ListPush(arena, out, MD_S8Lit(","));
-    }
-    
-    //- rjf: next-comment
-    // TODO(rjf): @node_comments
-    if(node->next_comment.size != 0)
-    {
-        MD_String8 comment = MD_S8SkipWhitespace(MD_S8ChopWhitespace(node->next_comment));
-        MD_b32 requires_multiline = MD_S8FindSubstring(comment, MD_S8Lit("\n"), 0, 0) < comment.size;
-        MD_PrintIndent(indent);
-        if(requires_multiline)
-        {
-            MD_S8ListPush(arena, out, MD_S8Lit("/*\n"));
-        }
-        else
-        {
-            MD_S8ListPush(arena, out, MD_S8Lit("// "));
-        }
-        MD_S8ListPush(arena, out, comment);
-        if(requires_multiline)
-        {
-            MD_S8ListPush(arena, out, MD_S8Lit("\n*/\n"));
         }
+        
+        //- leaving a node
         else
         {
-            MD_S8ListPush(arena, out, MD_S8Lit("\n"));
+            MD_GenerateFrame *frame = top;
+            MD_GenerateFrame *parent = frame->next;
+            indent = frame->indent;
+            indent_string = frame->indent_string;
+            
+            //- rjf: tag
+            if(frame->is_tag)
+            {
+                if(!MD_NodeIsNil(node->first_child))
+                {
+                    MD_S8ListPush(arena, out, MD_S8Lit(")"));
+                }
+                if(MD_NodeIsNil(node->next))
+                {
+                    MD_ReconstructionNodeHeader(arena, out, parent);
+                }
+            }
+            else
+            {
+                //- rjf: children list closer
+                if(!MD_NodeIsNil(MD_FirstChildFromNode(node)))
+                {
+                    MD_PrintIndent(indent);
+                    if(frame->closer.size != 0)
+                    {
+                        if(frame->last_line != frame->code_loc.line)
+                        {
+                            MD_S8ListPush(arena, out, MD_S8Lit("\n"));
+                            MD_PrintIndent(indent);
+                        }
+                        else
+                        {
+                            MD_S8ListPush(arena, out, MD_S8Lit(" "));
+                        }
+                        MD_S8ListPush(arena, out, frame->closer);
+                    }
+                }
+                
+                //- rjf: trailing separator symbols
+                if(node->flags & MD_NodeFlag_IsBeforeSemicolon)
+                {
+                    MD_S8ListPush(arena, out, MD_S8Lit(";"));
+                }
+                else if(node->flags & MD_NodeFlag_IsBeforeComma)
+                {
+                    MD_S8ListPush(arena, out, MD_S8Lit(","));
+                }
+                
+                //- rjf: next-comment
+                // TODO(rjf): @node_comments
+                if(node->next_comment.size != 0)
+                {
+                    MD_String8 comment = MD_S8SkipWhitespace(MD_S8ChopWhitespace(node->next_comment));
+                    MD_b32 requires_multiline = MD_S8FindSubstring(comment, MD_S8Lit("\n"), 0, 0) < comment.size;
+                    MD_PrintIndent(indent);
+                    if(requires_multiline)
+                    {
+                        MD_S8ListPush(arena, out, MD_S8Lit("/*\n"));
+                    }
+                    else
+                    {
+                        MD_S8ListPush(arena, out, MD_S8Lit("// "));
+                    }
+                    MD_S8ListPush(arena, out, comment);
+                    if(requires_multiline)
+                    {
+                        MD_S8ListPush(arena, out, MD_S8Lit("\n*/\n"));
+                    }
+                    else
+                    {
+                        MD_S8ListPush(arena, out, MD_S8Lit("\n"));
+                    }
+                }
+                
+                //- rjf: separator, in the arguments of a tag
+                if(parent != 0 && parent->is_tag && !MD_NodeIsNil(node->next))
+                {
+                    MD_S8ListPush(arena, out, MD_S8Lit(",\n"));
+                }
+            }
+            
+            top = parent;
+            frame->next = free_frame;
+            free_frame = frame;
         }
     }
-    
-#undef MD_PrintIndent
+    MD_ReleaseScratch(scratch);
 }
 
+#undef MD_PrintIndent
+
 
 #if !MD_DISABLE_PRINT_HELPERS
 MD_FUNCTION void
@@ -4410,6 +9690,16 @@ MD_LoadEntireFile(MD_Arena *arena, MD_String8 filename)
     return(result);
 }
 
+MD_FUNCTION MD_FileInfo
+MD_FileInfoFromPath(MD_Arena *arena, MD_String8 path)
+{
+    MD_FileInfo result = MD_ZERO_STRUCT;
+#if defined(MD_IMPL_FileInfoFromPath)
+    result = MD_IMPL_FileInfoFromPath(arena, path);
+#endif
+    return(result);
+}
+
 MD_FUNCTION MD_b32
 MD_FileIterBegin(MD_FileIter *it, MD_String8 path)
 {
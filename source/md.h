@@ -80,10 +80,16 @@
 #if !defined(MD_DEFAULT_SPRINTF)
 # define MD_DEFAULT_SPRINTF 1
 #endif
+#if !defined(MD_DEFAULT_THREADS)
+# define MD_DEFAULT_THREADS 0
+#endif
 
 #if !defined(MD_DISABLE_PRINT_HELPERS)
 # define MD_DISABLE_PRINT_HELPERS 0
 #endif
+#if !defined(MD_DISABLE_SIMD)
+# define MD_DISABLE_SIMD 0
+#endif
 
 
 //~/////////////////////////////////////////////////////////////////////////////
@@ -566,6 +572,9 @@ typedef enum MD_NodeKind
     MD_NodeKind_List,
     MD_NodeKind_Reference,
     
+    // NOTE: Generated by lazy parsing, in place of a set's children
+    MD_NodeKind_Unparsed,
+    
     MD_NodeKind_COUNT,
 }
 MD_NodeKind;
@@ -629,7 +638,11 @@ struct MD_Node
     
     // Node info.
     MD_NodeKind kind;
+    // Number of children, kept by MD_PushChild and the parser.
+    MD_u32 child_count;
     MD_NodeFlags flags;
+    // Number of tags, kept by MD_PushTag and the parser.
+    MD_u32 tag_count;
     MD_String8 string;
     MD_String8 raw_string;
     
@@ -647,6 +660,160 @@ struct MD_Node
     MD_String8 next_comment;
 };
 
+//~ Node iterators, for walking a tree without recursion.
+
+typedef MD_u32 MD_NodeIterFlags;
+enum
+{
+    MD_NodeIterFlag_Children     = (1<<0),
+    MD_NodeIterFlag_Tags         = (1<<1),
+    MD_NodeIterFlag_TagArguments = (1<<2),
+    MD_NodeIterFlag_PreOrder     = (1<<3),
+    MD_NodeIterFlag_PostOrder    = (1<<4),
+    
+    MD_NodeIterFlags_Tree = (MD_NodeIterFlag_Children |
+                             MD_NodeIterFlag_Tags |
+                             MD_NodeIterFlag_TagArguments),
+};
+
+// A list that the walk entered from a node other than the one its nodes'
+// parent links name, as with the lists shared by MD_ShareSubtrees. The walk
+// goes back up to owner when it leaves the list, which sits at depth.
+typedef struct MD_NodeIterFrame MD_NodeIterFrame;
+struct MD_NodeIterFrame
+{
+    MD_NodeIterFrame *next;
+    MD_Node *owner;
+    int depth;
+};
+
+// The position of a walk over a tree. Moving between nodes follows the
+// next and parent links, so the walk can go as deep as the tree does, and
+// only takes memory (from arena) for lists whose parent links lead elsewhere.
+typedef struct MD_NodeIter MD_NodeIter;
+struct MD_NodeIter
+{
+    MD_Arena *arena;
+    MD_Node *root;
+    MD_NodeIterFlags flags;
+    MD_NodeIterFrame *top;
+    MD_NodeIterFrame *free_frame;
+    
+    // The node being visited, 0 before the walk begins, and nil once it is
+    // done. When leaving is set, the nodes under it have all been visited.
+    MD_Node *node;
+    MD_b32 leaving;
+    MD_b32 skip;
+    int depth;
+};
+
+// Called by MD_ParallelVisit for each node, on the thread numbered
+// thread_idx. What is pushed on scratch is freed when the call returns.
+typedef void MD_ParallelVisitFunc(void *user_data, MD_Node *node, MD_u64 thread_idx, MD_Arena *scratch);
+
+//~ Tree diffs, for finding what changed between two versions of a tree.
+
+typedef MD_u32 MD_TreeEditKind;
+enum
+{
+    MD_TreeEditKind_Insert,
+    MD_TreeEditKind_Delete,
+    MD_TreeEditKind_Move,
+    MD_TreeEditKind_Modify,
+};
+
+// One change from the old tree to the new. Inserts have a nil old_node, and
+// deletes a nil new_node. A modified node has a different string, or tags or
+// node flags when the diff compares them; changes to its children are edits
+// of their own.
+typedef struct MD_TreeEdit MD_TreeEdit;
+struct MD_TreeEdit
+{
+    MD_TreeEdit *next;
+    MD_TreeEditKind kind;
+    MD_Node *old_node;
+    MD_Node *new_node;
+};
+
+typedef struct MD_TreeEditList MD_TreeEditList;
+struct MD_TreeEditList
+{
+    MD_TreeEdit *first;
+    MD_TreeEdit *last;
+    MD_u64 count;
+};
+
+//~ Compact trees, for traversing a finished tree with fewer cache misses.
+
+// The fields of a node that traversal touches, in 64 bytes. The rest of a
+// node's data is kept in side tables of its MD_CompactTree, and is read with
+// the MD_...FromCompactNode functions.
+typedef struct MD_CompactNode MD_CompactNode;
+struct MD_CompactNode
+{
+    // Tree relationship data.
+    MD_CompactNode *next;
+    MD_CompactNode *parent;
+    MD_CompactNode *first_child;
+    MD_CompactNode *first_tag;
+    
+    // Node info.
+    MD_NodeKind kind;
+    // The node's symbol in the table given to MD_CompactTreeFromNode, or 0.
+    MD_u32 symbol;
+    MD_NodeFlags flags;
+    MD_String8 string;
+};
+
+// Comments and reference targets, kept only for the nodes that have them.
+typedef struct MD_CompactNodeExtra MD_CompactNodeExtra;
+struct MD_CompactNodeExtra
+{
+    MD_u64 index;
+    MD_CompactNode *ref_target;
+    MD_String8 prev_comment;
+    MD_String8 next_comment;
+};
+
+typedef struct MD_CompactTree MD_CompactTree;
+struct MD_CompactTree
+{
+    // Each node is followed by its tags and then its children; nodes[0] is
+    // the root.
+    MD_CompactNode *nodes;
+    MD_u64 count;
+    
+    // Cold data, indexed like `nodes`.
+    MD_String8 *raw_strings;
+    MD_u64 *offsets;
+    
+    // Sorted by index.
+    MD_CompactNodeExtra *extras;
+    MD_u64 extra_count;
+};
+
+//~ Frozen trees, for scanning read-only trees as parallel arrays.
+
+// Nodes are numbered in pre-order, each followed by its tags and then its
+// children. Index 0 is the nil node, and index 1 is the root; links to no
+// node are 0.
+typedef struct MD_Tree MD_Tree;
+struct MD_Tree
+{
+    MD_u32 count;
+    MD_u8 *kinds;
+    // NOTE: every MD_NodeFlag fits in 32 bits.
+    MD_u32 *flags;
+    MD_u32 *string_offsets;
+    MD_u32 *string_sizes;
+    MD_u32 *first_child;
+    MD_u32 *first_tag;
+    MD_u32 *next_sibling;
+    MD_u32 *parent;
+    // The strings of all nodes, one after another, indexed by string_offsets.
+    MD_String8 strings;
+};
+
 //~ Code Location Info.
 
 typedef struct MD_CodeLoc MD_CodeLoc;
@@ -689,6 +856,89 @@ struct MD_Map
     MD_u64 bucket_count;
 };
 
+//~ Symbol tables
+
+// Gives each distinct string a nonzero 32-bit symbol and a single copy of
+// its bytes, so names can be compared as integers. Symbol 0 is never handed
+// out, and stands for "not interned".
+#define MD_SYMBOL_CHUNK_SIZE 1024
+
+typedef struct MD_SymbolTable MD_SymbolTable;
+struct MD_SymbolTable
+{
+    MD_Map map;
+    
+    // chunks[i] holds the strings of symbols [i*MD_SYMBOL_CHUNK_SIZE, (i+1)*MD_SYMBOL_CHUNK_SIZE).
+    MD_String8 **chunks;
+    MD_u64 chunk_cap;
+    MD_u32 count;
+};
+
+//~ Tag indices, for finding every node with a given tag.
+
+// The nodes that carry one tag, in the order of a depth-first walk of the
+// tree. nodes[i] carries the tag tags[i], whose children are its arguments.
+typedef struct MD_TaggedNodes MD_TaggedNodes;
+struct MD_TaggedNodes
+{
+    MD_TaggedNodes *next;
+    MD_String8 string;
+    MD_Node **nodes;
+    MD_Node **tags;
+    MD_u64 count;
+};
+
+// A snapshot of the tags in a tree; it is not updated when the tree changes.
+typedef struct MD_TagIndex MD_TagIndex;
+struct MD_TagIndex
+{
+    MD_Map map;
+    MD_TaggedNodes *first;
+    MD_TaggedNodes *last;
+    MD_u64 count;
+};
+
+//~ Child indices, for reading the children of wide nodes without walking them.
+
+// A node's children and tags as of when MD_BuildChildArray was called. Once
+// children or tags are pushed, the counts no longer match the node's, and
+// lookups go back to walking the lists until the arrays are rebuilt.
+typedef struct MD_ChildIndex MD_ChildIndex;
+struct MD_ChildIndex
+{
+    MD_Node **children;
+    MD_u64 child_count;
+    MD_Node **tags;
+    MD_u64 tag_count;
+    
+    // The children by string, hashed case-insensitively so that both exact
+    // and case-insensitive lookups can use it. 0 unless built with
+    // MD_BuildChildIndex.
+    MD_Map *child_names;
+};
+
+// The child indices built for some nodes of a tree, kept apart from the
+// nodes. A zero-initialized table is valid.
+typedef struct MD_ChildIndexTable MD_ChildIndexTable;
+struct MD_ChildIndexTable
+{
+    // Maps each indexed node to its MD_ChildIndex.
+    MD_Map map;
+};
+
+//~ Subtree hashes, for rejecting mismatched subtrees without walking them.
+
+// The hashes of every node of a tree, as of when MD_HashTree was called.
+// Changing the tree afterwards leaves them stale.
+typedef struct MD_TreeHashes MD_TreeHashes;
+struct MD_TreeHashes
+{
+    // Maps each node to a pointer to its MD_u64 hash.
+    MD_Map map;
+    // The MD_NodeMatchFlags that the hashes cover.
+    MD_MatchFlags flags;
+};
+
 //~ Tokens
 
 typedef MD_u32 MD_TokenKind;
@@ -734,6 +984,22 @@ struct MD_Token
     MD_String8 raw_string;
 };
 
+// Structure-of-arrays token buffer, produced by MD_TokenizeString. Token
+// i covers the bytes [offsets[i], offsets[i+1]) of `string`; its decoded
+// string skips `skips[i]` bytes from the front of that range and chops
+// `chops[i]` bytes from the back. `offsets` has `count + 1` entries.
+typedef struct MD_TokenArray MD_TokenArray;
+struct MD_TokenArray
+{
+    MD_String8 string;
+    MD_u64 count;
+    MD_TokenKind *kinds;
+    MD_u32 *node_flags;
+    MD_u64 *offsets;
+    MD_u8 *skips;
+    MD_u8 *chops;
+};
+
 //~ Parsing State
 
 typedef enum MD_MessageKind
@@ -774,12 +1040,123 @@ typedef enum MD_ParseSetRule
     MD_ParseSetRule_Global,
 } MD_ParseSetRule;
 
+typedef MD_u32 MD_ParseFlags;
+enum
+{
+    MD_ParseFlag_SkipComments  = (1<<0),
+    MD_ParseFlag_SkipLocations = (1<<1),
+    MD_ParseFlag_LazySets      = (1<<2),
+};
+
+typedef enum MD_ParseEventKind
+{
+    MD_ParseEventKind_Null,
+    MD_ParseEventKind_BeginNode,
+    MD_ParseEventKind_Tag,
+    MD_ParseEventKind_BeginChildren,
+    MD_ParseEventKind_EndChildren,
+    MD_ParseEventKind_EndNode,
+    MD_ParseEventKind_Error,
+}
+MD_ParseEventKind;
+
+typedef struct MD_ParseEvent MD_ParseEvent;
+struct MD_ParseEvent
+{
+    MD_ParseEventKind kind;
+    // The node, the tag, or the owner of the children. It is not linked to any
+    // other node, and is only valid until the callback returns.
+    MD_Node *node;
+    MD_u64 offset;
+    // Error events only. `node` is nil for errors at a token.
+    MD_MessageKind message_kind;
+    MD_String8 message;
+};
+
+typedef void MD_ParseEventFunc(void *user_data, MD_ParseEvent *event);
+
+// Returns whether a top-level node is kept. The node has its label, flags and
+// tags, but no children yet.
+typedef MD_b32 MD_ParseFilterFunc(void *user_data, MD_Node *node);
+
+typedef struct MD_ParseOptions MD_ParseOptions;
+struct MD_ParseOptions
+{
+    MD_ParseFlags flags;
+    // Labeled nodes and tags are interned into this table, when it is set.
+    MD_SymbolTable *symbols;
+    // When set, the parse is reported to this callback instead of building a tree.
+    MD_ParseEventFunc *event_func;
+    void *event_user_data;
+    // When set, only the top-level nodes that this callback keeps are parsed.
+    MD_ParseFilterFunc *filter_func;
+    void *filter_user_data;
+};
+
+// Shared by the sets that one parse with MD_ParseFlag_LazySets skipped, and by
+// the sets skipped again when their bodies are parsed. MD_ReparseWholeString
+// keeps one for the children it has yet to move onto the new string.
+typedef struct MD_ParseLazyState MD_ParseLazyState;
+struct MD_ParseLazyState
+{
+    // Held while a body is parsed, since every body allocates on `arena` and
+    // interns into `symbols`.
+    volatile MD_u64 lock;
+    MD_Arena *arena;
+    MD_String8 contents;
+    MD_SymbolTable *symbols;
+    MD_ParseFlags flags;
+    // Messages from the bodies that the introspection helpers parsed.
+    MD_MessageList errors;
+};
+
 typedef struct MD_ParseResult MD_ParseResult;
 struct MD_ParseResult
 {
     MD_Node *node;
     MD_u64 string_advance;
     MD_MessageList errors;
+    // Set by parses with MD_ParseFlag_LazySets, and by MD_ReparseWholeString.
+    MD_ParseLazyState *lazy;
+};
+
+// Fills up to `size` bytes of `buffer` with the next bytes of a stream, and
+// returns how many were written; returning 0 signals the end of the stream.
+typedef MD_u64 MD_ParseStreamReadFunc(void *user_data, MD_u8 *buffer, MD_u64 size);
+
+// State for parsing a stream one top-level node at a time. Input is pulled
+// through `read` into a window that only ever holds the unparsed bytes, and
+// grows only when a single top-level node does not fit.
+typedef struct MD_ParseStream MD_ParseStream;
+struct MD_ParseStream
+{
+    MD_Arena *arena;
+    MD_Node *root;
+    MD_ParseStreamReadFunc *read;
+    void *user_data;
+    MD_b32 eof;
+    
+    // Window over the stream; window[window_start] is the first byte not yet
+    // parsed, at stream offset `window_offset`, which is at line
+    // `window_line`, column `window_column`. window[window_size] is the
+    // first byte not yet read.
+    MD_Arena *window_arena;
+    MD_u8 *window;
+    MD_u64 window_cap;
+    MD_u64 window_start;
+    MD_u64 window_size;
+    MD_u64 window_offset;
+    MD_u32 window_line;
+    MD_u32 window_column;
+    
+    // Tokens of the window's unparsed bytes, from token_at on.
+    MD_Arena *token_arena;
+    MD_TokenArray tokens;
+    MD_u64 token_at;
+    
+    // Bytes of the previously returned node, dropped at the next call.
+    MD_u64 pending_discard;
+    MD_NodeFlags next_child_flags;
 };
 
 //~ Expression Parsing
@@ -1078,10 +1455,25 @@ MD_FUNCTION MD_MapSlot* MD_MapInsert(MD_Arena *arena, MD_Map *map, MD_MapKey key
 MD_FUNCTION MD_MapSlot* MD_MapOverwrite(MD_Arena *arena, MD_Map *map, MD_MapKey key,
                                         void *val);
 
+//~ Symbol Tables
+
+MD_FUNCTION MD_SymbolTable MD_SymbolTableMake(MD_Arena *arena);
+MD_FUNCTION MD_u32         MD_SymbolFromString(MD_Arena *arena, MD_SymbolTable *table, MD_String8 string);
+MD_FUNCTION MD_u32         MD_SymbolLookup(MD_SymbolTable *table, MD_String8 string);
+MD_FUNCTION MD_String8     MD_StringFromSymbol(MD_SymbolTable *table, MD_u32 symbol);
+MD_FUNCTION MD_u32         MD_SymbolFromNode(MD_SymbolTable *table, MD_Node *node);
+MD_FUNCTION void           MD_InternNodeSymbols(MD_Arena *arena, MD_SymbolTable *table, MD_Node *node);
+
 //~ Parsing
 
 MD_FUNCTION MD_Token       MD_TokenFromString(MD_String8 string);
 MD_FUNCTION MD_u64         MD_LexAdvanceFromSkips(MD_String8 string, MD_TokenKind skip_kinds);
+MD_FUNCTION MD_TokenArray  MD_TokenizeString(MD_Arena *arena, MD_String8 string);
+MD_FUNCTION MD_TokenArray  MD_TokenizeStringParallel(MD_Arena *arena, MD_String8 string,
+                                                    MD_u64 thread_count);
+MD_FUNCTION MD_Token       MD_TokenFromTokenArray(MD_TokenArray *tokens, MD_u64 idx);
+MD_FUNCTION MD_u64         MD_TokenIndexAdvanceFromSkips(MD_TokenArray *tokens, MD_u64 idx,
+                                                         MD_TokenKind skip_kinds);
 MD_FUNCTION MD_ParseResult MD_ParseResultZero(void);
 MD_FUNCTION MD_ParseResult MD_ParseNodeSet(MD_Arena *arena, MD_String8 string, MD_u64 offset, MD_Node *parent,
                                            MD_ParseSetRule rule);
@@ -1089,6 +1481,26 @@ MD_FUNCTION MD_ParseResult MD_ParseOneNode(MD_Arena *arena, MD_String8 string, M
 MD_FUNCTION MD_ParseResult MD_ParseWholeString(MD_Arena *arena, MD_String8 filename, MD_String8 contents);
 
 MD_FUNCTION MD_ParseResult MD_ParseWholeFile(MD_Arena *arena, MD_String8 filename);
+MD_FUNCTION MD_ParseResult MD_ParseWholeStringEx(MD_Arena *arena, MD_String8 filename, MD_String8 contents,
+                                                 MD_ParseOptions *options);
+MD_FUNCTION MD_ParseResult MD_ParseWholeFileEx(MD_Arena *arena, MD_String8 filename, MD_ParseOptions *options);
+MD_FUNCTION MD_b32         MD_ParseFilterTags(void *user_data, MD_Node *node);
+MD_FUNCTION MD_ParseResult MD_ParseWholeStringWithSymbols(MD_Arena *arena, MD_SymbolTable *symbols,
+                                                          MD_String8 filename, MD_String8 contents);
+MD_FUNCTION MD_ParseResult MD_ParseWholeStringLazy(MD_Arena *arena, MD_String8 filename, MD_String8 contents);
+MD_FUNCTION MD_ParseResult MD_ParseLazyChildren(MD_Node *node);
+MD_FUNCTION MD_ParseResult MD_ParseWholeStringParallel(MD_Arena **thread_arenas, MD_u64 thread_count,
+                                                       MD_String8 filename, MD_String8 contents);
+MD_FUNCTION MD_ParseResult MD_ParseFiles(MD_Arena **thread_arenas, MD_u64 thread_count, MD_String8List paths);
+MD_FUNCTION MD_ParseResult MD_ReparseWholeString(MD_Arena *arena, MD_ParseResult previous,
+                                                 MD_String8 old_contents, MD_String8 new_contents,
+                                                 MD_u64 edit_min, MD_u64 edit_max);
+
+MD_FUNCTION MD_ParseStream MD_ParseStreamBegin(MD_Arena *arena, MD_String8 filename,
+                                               MD_ParseStreamReadFunc *read, void *user_data,
+                                               MD_u64 window_size);
+MD_FUNCTION MD_ParseResult MD_ParseStreamNext(MD_ParseStream *stream);
+MD_FUNCTION void           MD_ParseStreamEnd(MD_ParseStream *stream);
 
 //~ Messages (Errors/Warnings)
 
@@ -1108,6 +1520,7 @@ MD_FUNCTION void       MD_MessageListConcat(MD_MessageList *list, MD_MessageList
 
 MD_FUNCTION MD_CodeLoc MD_CodeLocFromFileOffset(MD_String8 filename, MD_u8 *base, MD_u64 offset);
 MD_FUNCTION MD_CodeLoc MD_CodeLocFromNode(MD_Node *node);
+MD_FUNCTION MD_CodeLoc MD_CodeLocFromStreamOffset(MD_ParseStream *stream, MD_u64 offset);
 
 //~ Tree/List Building
 
@@ -1122,6 +1535,34 @@ MD_FUNCTION MD_Node *MD_MakeList(MD_Arena *arena);
 MD_FUNCTION void     MD_ListConcatInPlace(MD_Node *list, MD_Node *to_push);
 MD_FUNCTION MD_Node *MD_PushNewReference(MD_Arena *arena, MD_Node *list, MD_Node *target);
 
+//~ Child Indices
+
+// For nodes with many children that are read by index or looked up by
+// string. After MD_BuildChildArray, MD_IndexedChildFromIndex and
+// MD_IndexedTagFromIndex on the node take constant time, until a child or tag
+// is pushed to it. MD_BuildChildIndex also hashes the children's strings, for
+// MD_IndexedChildFromString and MD_IndexedNodeHasChild with no match flags or
+// only case-insensitivity. Nodes without an index in the table are walked.
+
+MD_FUNCTION MD_ChildIndex *MD_BuildChildArray(MD_Arena *arena, MD_ChildIndexTable *table, MD_Node *node);
+MD_FUNCTION void           MD_BuildChildArrays(MD_Arena *arena, MD_ChildIndexTable *table, MD_Node *root,
+                                               MD_u64 min_child_count);
+MD_FUNCTION MD_ChildIndex *MD_BuildChildIndex(MD_Arena *arena, MD_ChildIndexTable *table, MD_Node *node);
+MD_FUNCTION void           MD_BuildChildIndices(MD_Arena *arena, MD_ChildIndexTable *table, MD_Node *root,
+                                                MD_u64 min_child_count);
+MD_FUNCTION MD_ChildIndex *MD_ChildIndexFromNode(MD_ChildIndexTable *table, MD_Node *node);
+MD_FUNCTION MD_Node *      MD_IndexedChildFromIndex(MD_ChildIndexTable *table, MD_Node *node, int n);
+MD_FUNCTION MD_Node *      MD_IndexedTagFromIndex(MD_ChildIndexTable *table, MD_Node *node, int n);
+MD_FUNCTION MD_Node *      MD_IndexedChildFromString(MD_ChildIndexTable *table, MD_Node *node,
+                                                     MD_String8 child_string, MD_MatchFlags flags);
+MD_FUNCTION MD_b32         MD_IndexedNodeHasChild(MD_ChildIndexTable *table, MD_Node *node,
+                                                  MD_String8 string, MD_MatchFlags flags);
+
+//~ Tag Indices
+
+MD_FUNCTION MD_TagIndex    MD_TagIndexFromNode(MD_Arena *arena, MD_Node *root);
+MD_FUNCTION MD_TaggedNodes MD_TaggedNodesFromString(MD_TagIndex *index, MD_String8 tag_string);
+
 //~ Introspection Helpers
 
 // These calls are for getting info from nodes, and introspecting
@@ -1132,6 +1573,7 @@ MD_FUNCTION MD_Node *  MD_NodeAtIndex(MD_Node *first, int n);
 MD_FUNCTION MD_Node *  MD_FirstNodeWithFlags(MD_Node *first, MD_NodeFlags flags);
 MD_FUNCTION int        MD_IndexFromNode(MD_Node *node);
 MD_FUNCTION MD_Node *  MD_RootFromNode(MD_Node *node);
+MD_FUNCTION MD_Node *  MD_FirstChildFromNode(MD_Node *node);
 MD_FUNCTION MD_Node *  MD_ChildFromString(MD_Node *node, MD_String8 child_string, MD_MatchFlags flags);
 MD_FUNCTION MD_Node *  MD_TagFromString(MD_Node *node, MD_String8 tag_string, MD_MatchFlags flags);
 MD_FUNCTION MD_Node *  MD_ChildFromIndex(MD_Node *node, int n);
@@ -1140,6 +1582,11 @@ MD_FUNCTION MD_Node *  MD_TagArgFromIndex(MD_Node *node, MD_String8 tag_string,
 MD_FUNCTION MD_Node *  MD_TagArgFromString(MD_Node *node, MD_String8 tag_string, MD_MatchFlags tag_str_flags, MD_String8 arg_string, MD_MatchFlags arg_str_flags);
 MD_FUNCTION MD_b32     MD_NodeHasChild(MD_Node *node, MD_String8 string, MD_MatchFlags flags);
 MD_FUNCTION MD_b32     MD_NodeHasTag(MD_Node *node, MD_String8 string, MD_MatchFlags flags);
+MD_FUNCTION MD_Node *  MD_FirstNodeWithSymbol(MD_SymbolTable *table, MD_Node *first, MD_u32 symbol);
+MD_FUNCTION MD_Node *  MD_ChildFromSymbol(MD_SymbolTable *table, MD_Node *node, MD_u32 symbol);
+MD_FUNCTION MD_Node *  MD_TagFromSymbol(MD_SymbolTable *table, MD_Node *node, MD_u32 symbol);
+MD_FUNCTION MD_b32     MD_NodeHasChildSymbol(MD_SymbolTable *table, MD_Node *node, MD_u32 symbol);
+MD_FUNCTION MD_b32     MD_NodeHasTagSymbol(MD_SymbolTable *table, MD_Node *node, MD_u32 symbol);
 MD_FUNCTION MD_i64     MD_ChildCountFromNode(MD_Node *node);
 MD_FUNCTION MD_i64     MD_TagCountFromNode(MD_Node *node);
 MD_FUNCTION MD_Node *  MD_ResolveNodeFromReference(MD_Node *node);
@@ -1150,6 +1597,28 @@ MD_FUNCTION MD_String8 MD_NextCommentFromNode(MD_Node *node);
 
 // NOTE(rjf): For-Loop Helpers
 #define MD_EachNode(it, first) MD_Node *it = (first); !MD_NodeIsNil(it); it = it->next
+#define MD_EachChild(it, parent) MD_Node *it = MD_FirstChildFromNode(parent); !MD_NodeIsNil(it); it = it->next
+
+//~ Node Iterators
+
+// A walk visits each node before its tags and its tags before its children,
+// for the lists that the flags ask for. With MD_NodeIterFlag_PostOrder, a
+// node is visited again (with leaving set) once the nodes under it are done.
+// A list is always left for the node it was entered from, so a tree from
+// MD_ShareSubtrees is walked as the tree it stands for.
+//
+//  for(MD_NodeIter it = MD_NodeIterBegin(arena, root, MD_NodeIterFlags_Tree);
+//      !MD_NodeIsNil(MD_NodeIterNext(&it));)
+//  {
+//      // it.node, it.depth
+//  }
+
+MD_FUNCTION MD_NodeIter MD_NodeIterBegin(MD_Arena *arena, MD_Node *root, MD_NodeIterFlags flags);
+MD_FUNCTION MD_Node *   MD_NodeIterNext(MD_NodeIter *it);
+MD_FUNCTION void        MD_NodeIterSkipSubtree(MD_NodeIter *it);
+
+MD_FUNCTION void MD_ParallelVisit(MD_Node *root, MD_ParallelVisitFunc *callback, void *user_data,
+                                  MD_u64 thread_count);
 
 //~ Error/Warning Helpers
 
@@ -1176,6 +1645,52 @@ MD_FUNCTION void MD_PrintMessageFmt(FILE *file, MD_CodeLoc code_loc, MD_MessageK
 MD_FUNCTION MD_b32 MD_NodeMatch(MD_Node *a, MD_Node *b, MD_MatchFlags flags);
 MD_FUNCTION MD_b32 MD_NodeDeepMatch(MD_Node *a, MD_Node *b, MD_MatchFlags flags);
 
+// MD_NodeDeepMatchHashed rejects two subtrees whose hashes differ without
+// walking them, and only walks them when the hashes agree.
+
+MD_FUNCTION MD_TreeHashes MD_HashTree(MD_Arena *arena, MD_Node *root, MD_MatchFlags flags);
+MD_FUNCTION MD_u64        MD_HashFromNode(MD_TreeHashes *hashes, MD_Node *node);
+MD_FUNCTION MD_b32        MD_NodeDeepMatchHashed(MD_TreeHashes *a_hashes, MD_Node *a,
+                                                 MD_TreeHashes *b_hashes, MD_Node *b,
+                                                 MD_MatchFlags flags);
+
+//~ Tree Diffs
+
+MD_FUNCTION MD_TreeEditList MD_TreeDiff(MD_Arena *arena, MD_Node *old_root, MD_Node *new_root,
+                                        MD_MatchFlags flags);
+
+//~ Shared Subtrees
+
+MD_FUNCTION MD_Node *MD_ShareSubtrees(MD_Arena *arena, MD_Node *root);
+
+//~ Compact Trees
+
+MD_FUNCTION MD_CompactTree  MD_CompactTreeFromNode(MD_Arena *arena, MD_Node *root, MD_SymbolTable *symbols);
+MD_FUNCTION MD_CompactNode *MD_CompactNilNode(void);
+MD_FUNCTION MD_b32          MD_CompactNodeIsNil(MD_CompactNode *node);
+MD_FUNCTION MD_String8      MD_RawStringFromCompactNode(MD_CompactTree *tree, MD_CompactNode *node);
+MD_FUNCTION MD_u64          MD_OffsetFromCompactNode(MD_CompactTree *tree, MD_CompactNode *node);
+MD_FUNCTION MD_String8      MD_PrevCommentFromCompactNode(MD_CompactTree *tree, MD_CompactNode *node);
+MD_FUNCTION MD_String8      MD_NextCommentFromCompactNode(MD_CompactTree *tree, MD_CompactNode *node);
+MD_FUNCTION MD_CompactNode *MD_RefTargetFromCompactNode(MD_CompactTree *tree, MD_CompactNode *node);
+
+#define MD_EachCompactNode(it, first) MD_CompactNode *it = (first); !MD_CompactNodeIsNil(it); it = it->next
+
+//~ Frozen Trees
+
+MD_FUNCTION MD_Tree    MD_FreezeTree(MD_Arena *arena, MD_Node *root);
+MD_FUNCTION MD_String8 MD_TreeStringFromNode(MD_Tree *tree, MD_u32 node);
+MD_FUNCTION MD_u32     MD_TreeChildFromString(MD_Tree *tree, MD_u32 node, MD_String8 child_string, MD_MatchFlags flags);
+MD_FUNCTION MD_u32     MD_TreeTagFromString(MD_Tree *tree, MD_u32 node, MD_String8 tag_string, MD_MatchFlags flags);
+MD_FUNCTION MD_u32     MD_TreeChildFromIndex(MD_Tree *tree, MD_u32 node, int n);
+MD_FUNCTION MD_u32     MD_TreeTagFromIndex(MD_Tree *tree, MD_u32 node, int n);
+MD_FUNCTION MD_b32     MD_TreeNodeHasTag(MD_Tree *tree, MD_u32 node, MD_String8 string, MD_MatchFlags flags);
+MD_FUNCTION MD_i64     MD_TreeChildCountFromNode(MD_Tree *tree, MD_u32 node);
+MD_FUNCTION MD_i64     MD_TreeTagCountFromNode(MD_Tree *tree, MD_u32 node);
+
+#define MD_TreeEachChild(it, tree, node) MD_u32 it = (tree)->first_child[node]; it != 0; it = (tree)->next_sibling[it]
+#define MD_TreeEachTag(it, tree, node) MD_u32 it = (tree)->first_tag[node]; it != 0; it = (tree)->next_sibling[it]
+
 //~ Expression Parsing
 
 MD_FUNCTION void               MD_ExprOprPush(MD_Arena *arena, MD_ExprOprList *list,
@@ -1231,6 +1746,7 @@ MD_FUNCTION MD_i64 MD_CmdLineI64FromString(MD_CmdLine cmdln, MD_String8 name);
 //~ File System
 
 MD_FUNCTION MD_String8  MD_LoadEntireFile(MD_Arena *arena, MD_String8 filename);
+MD_FUNCTION MD_FileInfo MD_FileInfoFromPath(MD_Arena *arena, MD_String8 path);
 MD_FUNCTION MD_b32      MD_FileIterBegin(MD_FileIter *it, MD_String8 path);
 MD_FUNCTION MD_FileInfo MD_FileIterNext(MD_Arena *arena, MD_FileIter *it);
 MD_FUNCTION void        MD_FileIterEnd(MD_FileIter *it);
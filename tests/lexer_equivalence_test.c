@@ -0,0 +1,88 @@
+//$ exe //
+
+// Checks that the token array builders produce the same tokens as chaining
+// MD_TokenFromString one token at a time, over the files named on the command
+// line. The parallel tokenizer is checked at several thread counts, since its
+// chunk boundaries move with the count.
+
+#include "md.h"
+#include "md.c"
+
+static MD_b32
+TokensMatch(MD_Token a, MD_Token b)
+{
+    return (a.kind == b.kind &&
+            a.node_flags == b.node_flags &&
+            a.raw_string.str == b.raw_string.str && a.raw_string.size == b.raw_string.size &&
+            a.string.str == b.string.str && a.string.size == b.string.size);
+}
+
+static MD_b32
+CheckTokens(MD_String8 filename, MD_String8 contents, char *name, MD_TokenArray *actual)
+{
+    MD_b32 result = 1;
+    MD_u64 idx = 0;
+    for(MD_u64 off = 0; result && off < contents.size; idx += 1)
+    {
+        MD_Token expected = MD_TokenFromString(MD_S8Skip(contents, off));
+        if(idx >= actual->count)
+        {
+            fprintf(stderr, "%.*s: %s ended early, at token %llu (offset %llu)\n",
+                    MD_S8VArg(filename), name, (unsigned long long)idx, (unsigned long long)off);
+            result = 0;
+        }
+        else if(!TokensMatch(expected, MD_TokenFromTokenArray(actual, idx)))
+        {
+            fprintf(stderr, "%.*s: %s differs at token %llu (offset %llu)\n",
+                    MD_S8VArg(filename), name, (unsigned long long)idx, (unsigned long long)off);
+            result = 0;
+        }
+        off += expected.raw_string.size;
+    }
+    if(result && idx != actual->count)
+    {
+        fprintf(stderr, "%.*s: %s produced %llu tokens, expected %llu\n",
+                MD_S8VArg(filename), name,
+                (unsigned long long)actual->count, (unsigned long long)idx);
+        result = 0;
+    }
+    return result;
+}
+
+int main(int argument_count, char **arguments)
+{
+    MD_Arena *arena = MD_ArenaAlloc();
+    int failed = 0;
+    int checked = 0;
+    
+    for(int i = 1; i < argument_count; i += 1)
+    {
+        MD_String8 filename = MD_S8CString(arguments[i]);
+        MD_ArenaTemp temp = MD_ArenaBeginTemp(arena);
+        MD_String8 contents = MD_LoadEntireFile(arena, filename);
+        if(contents.str == 0)
+        {
+            // directories and unreadable paths from shell globs are skipped
+            MD_ArenaEndTemp(temp);
+            continue;
+        }
+        MD_TokenArray tokens = MD_TokenizeString(arena, contents);
+        if(!CheckTokens(filename, contents, "MD_TokenizeString", &tokens))
+        {
+            failed += 1;
+        }
+        for(MD_u64 thread_count = 2; thread_count <= 8; thread_count *= 2)
+        {
+            MD_TokenArray parallel = MD_TokenizeStringParallel(arena, contents, thread_count);
+            if(!CheckTokens(filename, contents, "MD_TokenizeStringParallel", &parallel))
+            {
+                failed += 1;
+            }
+        }
+        checked += 1;
+        MD_ArenaEndTemp(temp);
+    }
+    
+    printf("lexer equivalence: %d file(s) checked, %d mismatch(es)\n", checked, failed);
+    return failed != 0;
+}
@@ -1,5 +1,6 @@
 //$ exe //
 
+#define MD_DEFAULT_THREADS 1
 #include "md.h"
 #include "md.c"
 
@@ -82,6 +83,65 @@ TokenMatch(MD_Token token, MD_String8 string, MD_TokenKind kind)
     return MD_S8Match(string, token.string, 0) && token.kind == kind;
 }
 
+// Hands out the rest of a string a few bytes at a time.
+static MD_u64
+ReadFromString(void *user_data, MD_u8 *buffer, MD_u64 size)
+{
+    MD_String8 *string = (MD_String8 *)user_data;
+    MD_u64 read_size = MD_Min(MD_Min(size, string->size), 7);
+    MD_MemoryCopy(buffer, string->str, read_size);
+    *string = MD_S8Skip(*string, read_size);
+    return read_size;
+}
+
+// Writes each parse event as a word, like "a{" for a node with children.
+static void
+RecordParseEvent(void *user_data, MD_ParseEvent *event)
+{
+    MD_String8List *list = (MD_String8List *)user_data;
+    switch(event->kind)
+    {
+        default: break;
+        case MD_ParseEventKind_BeginNode:     MD_S8ListPushFmt(arena, list, "%.*s", MD_S8VArg(event->node->string)); break;
+        case MD_ParseEventKind_Tag:           MD_S8ListPushFmt(arena, list, "@%.*s", MD_S8VArg(event->node->string)); break;
+        case MD_ParseEventKind_BeginChildren: MD_S8ListPush(arena, list, MD_S8Lit("{")); break;
+        case MD_ParseEventKind_EndChildren:   MD_S8ListPush(arena, list, MD_S8Lit("}")); break;
+        case MD_ParseEventKind_EndNode:       MD_S8ListPush(arena, list, MD_S8Lit(".")); break;
+        case MD_ParseEventKind_Error:         MD_S8ListPushFmt(arena, list, "!%llu", event->offset); break;
+    }
+}
+
+// Counts events by kind, into an array indexed by MD_ParseEventKind.
+static void
+CountParseEvent(void *user_data, MD_ParseEvent *event)
+{
+    MD_u64 *counts = (MD_u64 *)user_data;
+    counts[event->kind] += 1;
+}
+
+// Counts visits and sums offsets, in a row per thread. A row is 8 values wide
+// so that threads do not share cache lines.
+static void
+CountParallelVisit(void *user_data, MD_Node *node, MD_u64 thread_idx, MD_Arena *scratch)
+{
+    MD_u64 *row = (MD_u64 *)user_data + thread_idx*8;
+    MD_u64 *copy = MD_PushArray(scratch, MD_u64, 1);
+    *copy = node->offset;
+    row[0] += 1;
+    row[1] += *copy;
+}
+
+// Parses every lazy set under a node, for threads that race to do so.
+static void
+ForceLazySets(void *params)
+{
+    MD_Node *node = (MD_Node *)params;
+    for(MD_EachNode(child, MD_FirstChildFromNode(node)))
+    {
+        ForceLazySets(child);
+    }
+}
+
 int main(void)
 {
     arena = MD_ArenaAlloc();
@@ -667,6 +727,15 @@ int main(void)
             TestResult(MD_ChildCountFromNode(result.node->first_child) == 1);
         }
         
+        // unscoped set starting on the next line, closed by a separator
+        {
+            MD_String8 text = MD_S8Lit("a:\nx, y");
+            MD_ParseResult result = MD_ParseWholeString(arena, file_name, text);
+            TestResult(result.errors.first == 0);
+            TestResult(MD_ChildCountFromNode(result.node) == 2);
+            TestResult(MD_ChildCountFromNode(result.node->first_child) == 1);
+        }
+        
         // scoped set is not unscoped
         {
             MD_String8 text = MD_S8Lit("a: {\nx\ny\n} c");
@@ -877,5 +946,966 @@ int main(void)
         }
     }
     
+    Test("Token Arrays")
+    {
+        MD_String8 string = MD_S8Lit("@tag(1, 2) foo: { bar; 'baz' } // comment\n"
+                                     "/* nested /* block */ comment */ 1.5e+3 +-* \"broken\n");
+        MD_TokenArray tokens = MD_TokenizeString(arena, string);
+        MD_b32 all_match = 1;
+        MD_u64 pos = 0;
+        MD_u64 idx = 0;
+        for(; pos < string.size; idx += 1)
+        {
+            MD_Token expected = MD_TokenFromString(MD_S8Skip(string, pos));
+            MD_Token token = MD_TokenFromTokenArray(&tokens, idx);
+            all_match = (all_match &&
+                         tokens.offsets[idx] == pos &&
+                         token.kind == expected.kind &&
+                         token.node_flags == expected.node_flags &&
+                         MD_S8Match(token.string, expected.string, 0) &&
+                         MD_S8Match(token.raw_string, expected.raw_string, 0));
+            pos += expected.raw_string.size;
+        }
+        TestResult(all_match);
+        TestResult(tokens.count == idx);
+        TestResult(tokens.offsets[tokens.count] == string.size);
+        TestResult(MD_TokenFromTokenArray(&tokens, tokens.count).kind == 0);
+        
+        MD_u64 label_idx = MD_TokenIndexAdvanceFromSkips(&tokens, 8, MD_TokenGroup_Irregular);
+        TestResult(TokenMatch(MD_TokenFromTokenArray(&tokens, label_idx), MD_S8Lit("foo"), MD_TokenKind_Identifier));
+        TestResult(MD_TokenIndexAdvanceFromSkips(&tokens, tokens.count, MD_TokenGroup_Irregular) == tokens.count);
+    }
+    
+    Test("One Node At A Time")
+    {
+        MD_String8List strings = {0};
+        for(int i = 0; i < 50000; i += 1)
+        {
+            MD_S8ListPushFmt(arena, &strings, "n%d: { a, b: (c) } // %d\n", i, i);
+        }
+        MD_String8 string = MD_S8ListJoin(arena, strings, 0);
+        MD_ParseResult whole = MD_ParseWholeString(arena, MD_S8Lit("whole"), string);
+        MD_Node *expected = whole.node->first_child;
+        MD_b32 all_match = 1;
+        MD_u64 count = 0;
+        for(MD_u64 offset = 0; offset < string.size;)
+        {
+            MD_ParseResult parse = MD_ParseOneNode(arena, string, offset);
+            if(parse.string_advance == 0)
+            {
+                break;
+            }
+            if(!MD_NodeIsNil(parse.node))
+            {
+                all_match = (all_match && parse.node->offset == expected->offset &&
+                             MD_NodeDeepMatch(parse.node, expected, MD_NodeMatchFlag_Tags|MD_NodeMatchFlag_NodeFlags) &&
+                             MD_S8Match(parse.node->next_comment, expected->next_comment, 0));
+                expected = expected->next;
+                count += 1;
+            }
+            offset += parse.string_advance;
+        }
+        TestResult(all_match && count == 50000 && MD_NodeIsNil(expected));
+        
+        MD_String8 braced = MD_S8Fmt(arena, "{\n%.*s}\n%.*s", MD_S8VArg(string), MD_S8VArg(string));
+        MD_Node *parent = MD_MakeNode(arena, MD_NodeKind_Main, MD_S8Lit("p"), MD_S8Lit("p"), 0);
+        MD_ParseResult set = MD_ParseNodeSet(arena, braced, 0, parent, MD_ParseSetRule_EndOnDelimiter);
+        TestResult(set.errors.node_count == 0 && MD_ChildCountFromNode(parent) == 50000 &&
+                   set.string_advance == string.size + 3);
+    }
+    
+    Test("Long Token Runs")
+    {
+        MD_String8 ident = MD_S8Lit("a_very_long_identifier_that_spans_several_simd_blocks_0123456789_ABCDEFGHIJKLMNOPQRSTUVWXYZ");
+        MD_String8 space = MD_S8Lit("  \t \f\v \r                                                   \t\t\t   ");
+        MD_String8 number = MD_S8Lit("123456789012345678901234567890.1234567890e+12345678901234567890E-9_0x1f");
+        MD_String8 string = MD_S8Fmt(arena, "%.*s%.*s%.*s\n%.*s+", MD_S8VArg(ident), MD_S8VArg(space),
+                                     MD_S8VArg(number), MD_S8VArg(ident));
+        MD_Token t0 = MD_TokenFromString(string);
+        MD_Token t1 = MD_TokenFromString(MD_S8Skip(string, ident.size));
+        MD_Token t2 = MD_TokenFromString(MD_S8Skip(string, ident.size + space.size));
+        MD_Token t3 = MD_TokenFromString(MD_S8Skip(string, ident.size + space.size + number.size + 1));
+        TestResult(TokenMatch(t0, ident, MD_TokenKind_Identifier));
+        TestResult(TokenMatch(t1, space, MD_TokenKind_Whitespace));
+        TestResult(TokenMatch(t2, number, MD_TokenKind_Numeric));
+        TestResult(TokenMatch(t3, ident, MD_TokenKind_Identifier));
+        TestResult(TokenMatch(MD_TokenFromString(MD_S8Lit("1e+")), MD_S8Lit("1e+"), MD_TokenKind_Numeric));
+        TestResult(TokenMatch(MD_TokenFromString(MD_S8Lit("1+")), MD_S8Lit("1"), MD_TokenKind_Numeric));
+        TestResult(TokenMatch(MD_TokenFromString(MD_S8Lit("abc\x80" "def")), MD_S8Lit("abc"), MD_TokenKind_Identifier));
+    }
+    
+    Test("Long Strings And Comments")
+    {
+        MD_String8 blob = MD_S8Lit("void main() { gl_FragColor = vec4(1.0, 0.5, 0.25, 1.0); } // \"quoted\" \\\"\"\" and ``` ticks\n"
+                                   "uniform sampler2D tex; /* not a comment */ float x = texture(tex, uv).r * 2.0;\n");
+        MD_String8 triplet = MD_S8Fmt(arena, "\"\"\"%.*s\"\"\"", MD_S8VArg(blob));
+        MD_Token t = MD_TokenFromString(triplet);
+        TestResult(TokenMatch(t, blob, MD_TokenKind_StringLiteral) && t.raw_string.size == triplet.size);
+        
+        MD_String8 single = MD_S8Lit("'a single quoted string that is long enough to cover a few blocks, with \\' escapes'");
+        t = MD_TokenFromString(single);
+        TestResult(t.kind == MD_TokenKind_StringLiteral && t.raw_string.size == single.size);
+        
+        MD_String8 broken = MD_S8Lit("`a tick string that runs past the end of its line without closing\n`");
+        t = MD_TokenFromString(broken);
+        TestResult(t.kind == MD_TokenKind_BrokenStringLiteral && t.raw_string.size == broken.size - 2);
+        
+        MD_String8 nested = MD_S8Lit("/* outer comment with some padding /* and a nested one, also padded */ still outer */x");
+        t = MD_TokenFromString(nested);
+        TestResult(t.kind == MD_TokenKind_Comment && t.raw_string.size == nested.size - 1);
+        
+        MD_String8 line = MD_S8Lit("// a line comment which is long enough to need more than one block\r\nx");
+        t = MD_TokenFromString(line);
+        TestResult(t.kind == MD_TokenKind_Comment && t.raw_string.size == line.size - 3);
+    }
+    
+    Test("Parallel Tokenizing")
+    {
+        // big enough to be split, with long strings and comments that
+        // chunk boundaries will land inside of
+        MD_String8List pieces = {0};
+        for(int i = 0; i < 20000; i += 1)
+        {
+            MD_S8ListPush(arena, &pieces, MD_S8Lit("foo: { bar: 1.5e-3, \"baz\\\"\" } // comment\n"));
+            if(i % 997 == 0)
+            {
+                MD_S8ListPush(arena, &pieces, MD_S8Lit("/* long\n /* nested \"\n comment */ with \"\"\" inside\n"));
+                for(int j = 0; j < 2000; j += 1)
+                {
+                    MD_S8ListPush(arena, &pieces, MD_S8Lit("x: 'y' // \"\"\" \n"));
+                }
+                MD_S8ListPush(arena, &pieces, MD_S8Lit("*/\n\"\"\"\n"));
+                for(int j = 0; j < 2000; j += 1)
+                {
+                    MD_S8ListPush(arena, &pieces, MD_S8Lit("x: 'y' /* \n"));
+                }
+                MD_S8ListPush(arena, &pieces, MD_S8Lit("\"\"\"\n"));
+            }
+        }
+        MD_String8 string = MD_S8ListJoin(arena, pieces, 0);
+        MD_TokenArray serial = MD_TokenizeString(arena, string);
+        for(MD_u64 thread_count = 2; thread_count <= 8; thread_count *= 2)
+        {
+            MD_TokenArray parallel = MD_TokenizeStringParallel(arena, string, thread_count);
+            MD_b32 match = (serial.count == parallel.count);
+            for(MD_u64 idx = 0; match && idx <= serial.count; idx += 1)
+            {
+                match = (serial.offsets[idx] == parallel.offsets[idx] &&
+                         (idx == serial.count ||
+                          (serial.kinds[idx] == parallel.kinds[idx] &&
+                           serial.node_flags[idx] == parallel.node_flags[idx] &&
+                           serial.skips[idx] == parallel.skips[idx] &&
+                           serial.chops[idx] == parallel.chops[idx])));
+            }
+            TestResult(match);
+        }
+    }
+    
+    Test("Streaming Parse")
+    {
+        MD_String8List pieces = {0};
+        MD_S8ListPush(arena, &pieces, MD_S8Lit("// first\n@tag a: { b, c } ;\n"));
+        for(int i = 0; i < 300; i += 1)
+        {
+            MD_S8ListPush(arena, &pieces, MD_S8Lit("foo: (1 2 3) bar: \"baz\" /* trailing */\n"));
+        }
+        MD_S8ListPush(arena, &pieces, MD_S8Lit("big: {"));
+        for(int i = 0; i < 1000; i += 1)
+        {
+            MD_S8ListPush(arena, &pieces, MD_S8Lit("x: y, "));
+        }
+        MD_S8ListPush(arena, &pieces, MD_S8Lit("} 'unterminated\n last,"));
+        MD_String8 string = MD_S8ListJoin(arena, pieces, 0);
+        MD_ParseResult whole = MD_ParseWholeString(arena, MD_S8Lit("stream.mdesk"), string);
+        
+        MD_String8 remaining = string;
+        MD_ParseStream stream = MD_ParseStreamBegin(arena, MD_S8Lit("stream.mdesk"), ReadFromString,
+                                                    &remaining, 16);
+        MD_Node *expected = whole.node->first_child;
+        MD_Message *expected_error = whole.errors.first;
+        MD_b32 nodes_match = 1;
+        MD_b32 errors_match = 1;
+        MD_b32 locations_match = 1;
+        for(;;)
+        {
+            MD_ParseResult parse = MD_ParseStreamNext(&stream);
+            for(MD_Message *error = parse.errors.first; error != 0; error = error->next)
+            {
+                errors_match = (errors_match && expected_error != 0 &&
+                                MD_S8Match(error->string, expected_error->string, 0) &&
+                                error->node->offset == expected_error->node->offset);
+                expected_error = expected_error ? expected_error->next : 0;
+            }
+            if(MD_NodeIsNil(parse.node))
+            {
+                break;
+            }
+            MD_CodeLoc loc = MD_CodeLocFromStreamOffset(&stream, parse.node->offset);
+            MD_CodeLoc expected_loc = MD_CodeLocFromNode(expected);
+            locations_match = (locations_match &&
+                               loc.line == expected_loc.line && loc.column == expected_loc.column);
+            nodes_match = (nodes_match && !MD_NodeIsNil(expected) &&
+                           MD_NodeDeepMatch(parse.node, expected, MD_NodeMatchFlag_Tags |
+                                            MD_NodeMatchFlag_TagArguments | MD_NodeMatchFlag_NodeFlags) &&
+                           parse.node->offset == expected->offset &&
+                           parse.node->parent == stream.root &&
+                           MD_S8Match(parse.node->prev_comment, expected->prev_comment, 0) &&
+                           MD_S8Match(parse.node->next_comment, expected->next_comment, 0));
+            expected = expected->next;
+        }
+        MD_u64 window_cap = stream.window_cap;
+        MD_ParseStreamEnd(&stream);
+        TestResult(nodes_match && MD_NodeIsNil(expected));
+        TestResult(window_cap <= 16384 && window_cap < string.size);
+        TestResult(errors_match && expected_error == 0);
+        TestResult(locations_match);
+    }
+    
+    Test("Symbol Interning")
+    {
+        MD_SymbolTable symbols = MD_SymbolTableMake(arena);
+        MD_String8 string = MD_S8Lit("@foo a: { b @foo c: (d) } @bar b: { a, \"a\" } ()");
+        MD_ParseResult parse = MD_ParseWholeStringWithSymbols(arena, &symbols, MD_S8Lit("symbols"), string);
+        MD_Node *a = parse.node->first_child;
+        MD_Node *b = a->next;
+        MD_u32 a_symbol = MD_SymbolFromNode(&symbols, a);
+        MD_u32 b_symbol = MD_SymbolFromNode(&symbols, b);
+        TestResult(a_symbol != 0 && b_symbol != 0 && a_symbol != b_symbol);
+        TestResult(MD_ChildFromSymbol(&symbols, b, a_symbol) == b->first_child);
+        TestResult(MD_SymbolFromNode(&symbols, b->first_child) == MD_SymbolFromNode(&symbols, b->first_child->next));
+        TestResult(b->first_child->string.str == a->string.str);
+        TestResult(MD_ChildFromSymbol(&symbols, a, b_symbol) == a->first_child);
+        TestResult(MD_NodeHasTagSymbol(&symbols, a->first_child->next, MD_SymbolLookup(&symbols, MD_S8Lit("foo"))));
+        TestResult(!MD_NodeHasTagSymbol(&symbols, b, MD_SymbolLookup(&symbols, MD_S8Lit("foo"))));
+        TestResult(MD_SymbolLookup(&symbols, MD_S8Lit("nope")) == 0);
+        TestResult(MD_NodeIsNil(MD_ChildFromSymbol(&symbols, a, 0)));
+        TestResult(MD_SymbolFromNode(&symbols, b->next) == 0);
+        TestResult(MD_S8Match(MD_StringFromSymbol(&symbols, MD_SymbolLookup(&symbols, MD_S8Lit("bar"))),
+                              MD_S8Lit("bar"), 0));
+        TestResult(MD_CompactTreeFromNode(arena, parse.node, &symbols).nodes[1].symbol == a_symbol);
+        
+        MD_ParseResult plain = MD_ParseWholeString(arena, MD_S8Lit("symbols"), string);
+        TestResult(MD_NodeDeepMatch(plain.node, parse.node, MD_NodeMatchFlag_Tags |
+                                    MD_NodeMatchFlag_TagArguments | MD_NodeMatchFlag_NodeFlags));
+        TestResult(MD_SymbolFromNode(&symbols, plain.node->first_child) == 0 &&
+                   MD_NodeIsNil(MD_ChildFromSymbol(&symbols, plain.node, a_symbol)));
+        MD_InternNodeSymbols(arena, &symbols, plain.node->first_child);
+        TestResult(MD_SymbolFromNode(&symbols, plain.node->first_child) == a_symbol);
+        
+        // enough distinct strings to grow the chunk directory and rehash
+        MD_SymbolTable many = MD_ZERO_STRUCT;
+        MD_b32 round_trips = 1;
+        for(int i = 0; i < 20000; i += 1)
+        {
+            MD_String8 name = MD_S8Fmt(arena, "name_%d", i);
+            MD_u32 symbol = MD_SymbolFromString(arena, &many, name);
+            round_trips = (round_trips && symbol == (MD_u32)(i + 1) &&
+                           MD_SymbolFromString(arena, &many, name) == symbol);
+        }
+        for(int i = 0; i < 20000; i += 1)
+        {
+            MD_String8 name = MD_S8Fmt(arena, "name_%d", i);
+            round_trips = (round_trips && MD_SymbolLookup(&many, name) == (MD_u32)(i + 1) &&
+                           MD_S8Match(MD_StringFromSymbol(&many, (MD_u32)(i + 1)), name, 0));
+        }
+        TestResult(round_trips);
+    }
+    
+    Test("Deep Nesting")
+    {
+        // deep enough that a recursive parser would overflow a small stack
+        int depth = 200000;
+        MD_String8List pieces = {0};
+        for(int i = 0; i < depth; i += 1)
+        {
+            MD_S8ListPush(arena, &pieces, MD_S8Lit("@t(x) a: {"));
+        }
+        for(int i = 0; i < depth; i += 1)
+        {
+            MD_S8ListPush(arena, &pieces, MD_S8Lit("}"));
+        }
+        MD_String8 string = MD_S8ListJoin(arena, pieces, 0);
+        MD_ParseResult parse = MD_ParseWholeString(arena, MD_S8Lit("deep"), string);
+        TestResult(parse.errors.first == 0);
+        
+        int reached_depth = 0;
+        MD_b32 shape_ok = 1;
+        for(MD_Node *node = parse.node->first_child; !MD_NodeIsNil(node); node = node->first_child)
+        {
+            shape_ok = (shape_ok && MD_S8Match(node->string, MD_S8Lit("a"), 0) &&
+                        MD_NodeHasTag(node, MD_S8Lit("t"), 0) &&
+                        node->flags & MD_NodeFlag_HasBraceLeft &&
+                        node->flags & MD_NodeFlag_HasBraceRight);
+            reached_depth += 1;
+        }
+        TestResult(shape_ok && reached_depth == depth);
+        
+        MD_String8 remaining = string;
+        MD_ParseStream stream = MD_ParseStreamBegin(arena, MD_S8Lit("deep"), ReadFromString, &remaining, 4096);
+        MD_ParseResult streamed = MD_ParseStreamNext(&stream);
+        MD_b32 stream_done = MD_NodeIsNil(MD_ParseStreamNext(&stream).node);
+        MD_ParseStreamEnd(&stream);
+        TestResult(streamed.errors.first == 0 && stream_done &&
+                   MD_NodeDeepMatch(streamed.node, parse.node->first_child,
+                                    MD_NodeMatchFlag_Tags|MD_NodeMatchFlag_TagArguments));
+        MD_Node *streamed_deepest = streamed.node;
+        MD_Node *parsed_deepest = parse.node->first_child;
+        for(; !MD_NodeIsNil(parsed_deepest->first_child); parsed_deepest = parsed_deepest->first_child)
+        {
+            streamed_deepest = streamed_deepest->first_child;
+        }
+        TestResult(streamed_deepest->offset == parsed_deepest->offset &&
+                   streamed_deepest->first_tag->offset == parsed_deepest->first_tag->offset);
+        
+        MD_SymbolTable symbols = MD_ZERO_STRUCT;
+        MD_InternNodeSymbols(arena, &symbols, parse.node);
+        MD_Node *deepest = parse.node->first_child;
+        for(; !MD_NodeIsNil(deepest->first_child); deepest = deepest->first_child);
+        TestResult(MD_SymbolFromNode(&symbols, deepest) == MD_SymbolLookup(&symbols, MD_S8Lit("a")) &&
+                   MD_SymbolFromNode(&symbols, deepest->first_tag->first_child) == MD_SymbolLookup(&symbols, MD_S8Lit("x")));
+    }
+    
+    Test("Parallel Parse")
+    {
+        // big enough to be split, with top-level nodes that are not on lines
+        // of their own, and brackets inside strings and comments
+        MD_String8List pieces = {0};
+        for(int i = 0; i < 6000; i += 1)
+        {
+            MD_S8ListPush(arena, &pieces, MD_S8Lit("@struct @doc(\"}{\") Type: {\n  a: U32, // }\n  b: [1, 2],\n}\n"));
+            MD_S8ListPush(arena, &pieces, MD_S8Lit("x; y, z\n/* {\n\n*/\nimplicit: a b\nc\n\n"));
+            if(i % 1000 == 999)
+            {
+                MD_S8ListPush(arena, &pieces, MD_S8Lit("} unbalanced\n"));
+            }
+        }
+        MD_String8 string = MD_S8ListJoin(arena, pieces, 0);
+        MD_ParseResult serial = MD_ParseWholeString(arena, MD_S8Lit("parallel"), string);
+        MD_Arena *thread_arenas[8];
+        for(int i = 0; i < 8; i += 1)
+        {
+            thread_arenas[i] = MD_ArenaAlloc();
+        }
+        for(MD_u64 thread_count = 2; thread_count <= 8; thread_count *= 2)
+        {
+            MD_ParseResult parallel = MD_ParseWholeStringParallel(thread_arenas, thread_count,
+                                                                  MD_S8Lit("parallel"), string);
+            MD_b32 match = (MD_NodeDeepMatch(serial.node, parallel.node, MD_NodeMatchFlag_Tags |
+                                             MD_NodeMatchFlag_TagArguments | MD_NodeMatchFlag_NodeFlags) &&
+                            serial.errors.node_count == parallel.errors.node_count &&
+                            serial.string_advance == parallel.string_advance);
+            for(MD_Node *a = serial.node->first_child, *b = parallel.node->first_child;
+                match && !MD_NodeIsNil(a);
+                a = a->next, b = b->next)
+            {
+                match = (a->offset == b->offset && b->parent == parallel.node &&
+                         MD_S8Match(a->prev_comment, b->prev_comment, 0) &&
+                         MD_S8Match(a->next_comment, b->next_comment, 0));
+            }
+            for(MD_Message *a = serial.errors.first, *b = parallel.errors.first;
+                match && a != 0;
+                a = a->next, b = b->next)
+            {
+                match = (a->kind == b->kind && a->node->offset == b->node->offset &&
+                         MD_S8Match(a->string, b->string, 0));
+            }
+            TestResult(match);
+        }
+        for(int i = 0; i < 8; i += 1)
+        {
+            MD_ArenaRelease(thread_arenas[i]);
+        }
+    }
+    
+    Test("Parse Files")
+    {
+        // files of different sizes, one with an error, and one that is missing
+        char *names[] = {"__parse_files_0.mdesk", "__parse_files_1.mdesk", "__parse_files_2.mdesk",
+            "__parse_files_3.mdesk", "__parse_files_4.mdesk", "__parse_files_5.mdesk"};
+        MD_String8List paths = {0};
+        for(int i = 0; i < MD_ArrayCount(names); i += 1)
+        {
+            MD_S8ListPush(arena, &paths, MD_S8CString(names[i]));
+            if(i == 4)
+            {
+                continue;
+            }
+            FILE *file = fopen(names[i], "wb");
+            for(int j = 0; j < (i*7) % 5 + 1; j += 1)
+            {
+                fprintf(file, "file_%d_%d: {a, b, c}\n", i, j);
+            }
+            if(i == 2)
+            {
+                fprintf(file, "} oops\n");
+            }
+            fclose(file);
+        }
+        MD_Arena *thread_arenas[4];
+        for(int i = 0; i < 4; i += 1)
+        {
+            thread_arenas[i] = MD_ArenaAlloc();
+        }
+        for(MD_u64 thread_count = 1; thread_count <= 4; thread_count *= 2)
+        {
+            MD_ParseResult parse = MD_ParseFiles(thread_arenas, thread_count, paths);
+            MD_b32 match = (parse.node->kind == MD_NodeKind_List);
+            MD_u64 error_count = 0;
+            MD_String8Node *path = paths.first;
+            for(MD_EachNode(ref, parse.node->first_child))
+            {
+                MD_Node *file = MD_ResolveNodeFromReference(ref);
+                MD_ParseResult serial = MD_ParseWholeFile(arena, path->string);
+                match = (match && file->kind == MD_NodeKind_File && MD_S8Match(file->string, path->string, 0) &&
+                         MD_NodeDeepMatch(file, serial.node, 0));
+                error_count += serial.errors.node_count;
+                path = path->next;
+            }
+            TestResult(match && path == 0 && error_count == 2 && parse.errors.node_count == error_count);
+        }
+        for(int i = 0; i < 4; i += 1)
+        {
+            MD_ArenaRelease(thread_arenas[i]);
+        }
+        for(int i = 0; i < MD_ArrayCount(names); i += 1)
+        {
+            remove(names[i]);
+        }
+    }
+    
+    Test("Incremental Reparse")
+    {
+        // each edit replaces [min, max) of the previous string with the
+        // inserted text, and is reparsed on top of the previous edit's result
+        struct
+        {
+            MD_u64 min;
+            MD_u64 max;
+            char *insert;
+        }
+        edits[] =
+        {
+            {  6,  7, "A" },
+            { 28, 28, "// comment\nd: {x}\n" },
+            {  0,  0, "@tag " },
+            { 12, 12, "{" },
+            { 12, 13, "" },
+            { 30, 40, "" },
+            { 10, 10, "\"" },
+            { 10, 11, "" },
+        };
+        MD_String8 contents = MD_S8Lit("a: {b c};\nbb: (1, 2)\nc: [3]\n/* doc */\ne: f;\ng\n");
+        MD_ParseResult parse = MD_ParseWholeString(arena, MD_S8Lit("reparse"), contents);
+        for(int i = 0; i < MD_ArrayCount(edits); i += 1)
+        {
+            MD_String8 new_contents = MD_S8Fmt(arena, "%.*s%s%.*s",
+                                               MD_S8VArg(MD_S8Prefix(contents, edits[i].min)),
+                                               edits[i].insert,
+                                               MD_S8VArg(MD_S8Skip(contents, edits[i].max)));
+            MD_ParseResult full = MD_ParseWholeString(arena, MD_S8Lit("reparse"), new_contents);
+            parse = MD_ReparseWholeString(arena, parse, contents, new_contents, edits[i].min, edits[i].max);
+            MD_b32 match = (MD_NodeDeepMatch(full.node, parse.node, MD_NodeMatchFlag_TagArguments|MD_NodeMatchFlag_NodeFlags) &&
+                            full.errors.node_count == parse.errors.node_count &&
+                            full.string_advance == parse.string_advance);
+            for(MD_Node *a = full.node->first_child, *b = parse.node->first_child;
+                match && !MD_NodeIsNil(a);
+                a = a->next, b = b->next)
+            {
+                match = (a->offset == b->offset && b->parent == parse.node &&
+                         a->raw_string.size == b->raw_string.size &&
+                         (b->raw_string.size == 0 || b->raw_string.str == new_contents.str + b->offset) &&
+                         MD_S8Match(a->prev_comment, b->prev_comment, 0));
+            }
+            for(MD_Message *a = full.errors.first, *b = parse.errors.first;
+                match && a != 0;
+                a = a->next, b = b->next)
+            {
+                match = (a->kind == b->kind && a->node->offset == b->node->offset &&
+                         MD_S8Match(a->string, b->string, 0));
+            }
+            TestResult(match);
+            contents = new_contents;
+        }
+        
+        // children of kept nodes are moved onto the newest string when they
+        // are first read, however many edits ago they were kept
+        MD_String8 strings[] =
+        {
+            MD_S8Lit("a\nb: {c: {d}}\n"),
+            MD_S8Lit("x a\nb: {c: {d}}\n"),
+            MD_S8Lit("y x a\nb: {c: {d}}\n"),
+        };
+        MD_ParseResult kept = MD_ParseWholeString(arena, MD_S8Lit("reparse"), strings[0]);
+        kept = MD_ReparseWholeString(arena, kept, strings[0], strings[1], 0, 0);
+        kept = MD_ReparseWholeString(arena, kept, strings[1], strings[2], 0, 0);
+        MD_Node *b = MD_ChildFromString(kept.node, MD_S8Lit("b"), 0);
+        TestResult(b->offset == 6 && b->first_child->kind == MD_NodeKind_Unparsed);
+        MD_Node *c = MD_ChildFromString(b, MD_S8Lit("c"), 0);
+        MD_Node *d = MD_FirstChildFromNode(c);
+        TestResult(c->offset == 10 && d->offset == 14 && MD_ChildCountFromNode(b) == 1 &&
+                   c->string.str == strings[2].str + c->offset && d->string.str == strings[2].str + d->offset);
+    }
+    
+    Test("Lazy Parse")
+    {
+        MD_String8 string = MD_S8Lit("@type(struct) foo: { a: { x, y }, @tag(z, {w}) b: (1 2) }\n"
+                                     "bar: [c d] baz\n"
+                                     "qux: { x ] y }\n");
+        MD_ParseResult eager = MD_ParseWholeString(arena, MD_S8Lit("lazy"), string);
+        MD_ParseResult lazy = MD_ParseWholeStringLazy(arena, MD_S8Lit("lazy"), string);
+        MD_Node *foo = MD_ChildFromString(lazy.node, MD_S8Lit("foo"), 0);
+        MD_Node *bar = MD_ChildFromString(lazy.node, MD_S8Lit("bar"), 0);
+        TestResult(foo->first_child->kind == MD_NodeKind_Unparsed &&
+                   bar->first_child->kind == MD_NodeKind_Unparsed &&
+                   foo->flags == (MD_NodeFlag_Identifier|MD_NodeFlag_HasBraceLeft|MD_NodeFlag_HasBraceRight) &&
+                   MD_NodeHasTag(foo, MD_S8Lit("type"), 0));
+        
+        // mismatched closers are parsed as usual, to keep their errors
+        TestResult(lazy.errors.node_count == eager.errors.node_count && lazy.errors.node_count != 0);
+        
+        MD_Node *a = MD_ChildFromString(foo, MD_S8Lit("a"), 0);
+        TestResult(a->first_child->kind == MD_NodeKind_Unparsed && MD_ChildCountFromNode(a) == 2 &&
+                   MD_NodeHasChild(MD_ChildFromString(foo, MD_S8Lit("b"), 0), MD_S8Lit("2"), 0));
+        TestResult(MD_NodeDeepMatch(eager.node, lazy.node, MD_NodeMatchFlag_Tags|MD_NodeMatchFlag_TagArguments|
+                                    MD_NodeMatchFlag_NodeFlags));
+        
+        MD_ParseResult errors = MD_ParseLazyChildren(foo);
+        TestResult(errors.node == foo && errors.errors.node_count == 0);
+        
+        // threads that reach the same set parse it once, and see it whole
+        MD_ParseResult shared = MD_ParseWholeStringLazy(arena, MD_S8Lit("lazy"), string);
+        MD_ThreadJob jobs[4];
+        for(int i = 0; i < 4; i += 1)
+        {
+            MD_ThreadJobLaunch(&jobs[i], ForceLazySets, shared.node);
+        }
+        for(int i = 0; i < 4; i += 1)
+        {
+            MD_ThreadJobJoin(&jobs[i]);
+        }
+        TestResult(MD_NodeDeepMatch(eager.node, shared.node, MD_NodeMatchFlag_Tags|MD_NodeMatchFlag_TagArguments|
+                                    MD_NodeMatchFlag_NodeFlags));
+        TestResult(eager.lazy == 0 && lazy.lazy != 0 && shared.lazy != 0 && shared.lazy != lazy.lazy);
+        
+        // messages from bodies that a helper parses are kept on the tree's state
+        MD_String8 bad_string = MD_S8Lit("a: { b: { @ c } }\n");
+        MD_ParseResult bad_eager = MD_ParseWholeString(arena, MD_S8Lit("lazy"), bad_string);
+        MD_ParseResult bad = MD_ParseWholeStringLazy(arena, MD_S8Lit("lazy"), bad_string);
+        TestResult(bad.errors.node_count == 0 && bad.lazy->errors.node_count == 0);
+        ForceLazySets(bad.node);
+        TestResult(bad_eager.errors.node_count != 0 &&
+                   bad.lazy->errors.node_count == bad_eager.errors.node_count &&
+                   MD_S8Match(bad.lazy->errors.first->string, bad_eager.errors.first->string, 0) &&
+                   bad.lazy->errors.first->node->offset == bad_eager.errors.first->node->offset);
+    }
+    
+    Test("Parse Options")
+    {
+        MD_String8 string = MD_S8Lit("// before\n@tag a: { b // after\n c }\n\"d\"\n");
+        MD_ParseResult plain = MD_ParseWholeString(arena, MD_S8Lit("options"), string);
+        MD_ParseOptions options = {0};
+        options.flags = MD_ParseFlag_SkipComments|MD_ParseFlag_SkipLocations;
+        MD_ParseResult parse = MD_ParseWholeStringEx(arena, MD_S8Lit("options"), string, &options);
+        MD_Node *a = MD_ChildFromString(parse.node, MD_S8Lit("a"), 0);
+        MD_Node *b = MD_ChildFromString(a, MD_S8Lit("b"), 0);
+        MD_Node *d = MD_ChildFromIndex(parse.node, 1);
+        TestResult(MD_NodeDeepMatch(plain.node, parse.node, MD_NodeMatchFlag_Tags|MD_NodeMatchFlag_NodeFlags));
+        TestResult(MD_PrevCommentFromNode(MD_ChildFromIndex(plain.node, 0)).size != 0 &&
+                   MD_PrevCommentFromNode(a).size == 0 && MD_NextCommentFromNode(b).size == 0);
+        TestResult(a->offset == 0 && a->raw_string.size == 0 && a->first_tag->offset == 0 &&
+                   d->offset == 0 && d->raw_string.size == 0 && MD_S8Match(d->string, MD_S8Lit("d"), 0));
+        
+        options.flags = MD_ParseFlag_SkipComments;
+        parse = MD_ParseWholeStringEx(arena, MD_S8Lit("options"), string, &options);
+        d = MD_ChildFromIndex(parse.node, 1);
+        TestResult(d->offset == MD_ChildFromIndex(plain.node, 1)->offset &&
+                   MD_S8Match(d->raw_string, MD_S8Lit("\"d\""), 0));
+    }
+    
+    Test("Parse Events")
+    {
+        MD_String8 string = MD_S8Lit("@t(x) a: { b, c }\n@u ]\nd");
+        MD_String8List events = {0};
+        MD_ParseOptions options = {0};
+        options.event_func = RecordParseEvent;
+        options.event_user_data = &events;
+        MD_ParseResult parse = MD_ParseWholeStringEx(arena, MD_S8Lit("events"), string, &options);
+        MD_StringJoin join = {0};
+        join.mid = MD_S8Lit(" ");
+        MD_String8 joined = MD_S8ListJoin(arena, events, &join);
+        TestResult(MD_S8Match(joined, MD_S8Lit("@t { x . } a { b . c . } . @u !21 . d ."), 0));
+        TestResult(MD_NodeIsNil(parse.node->first_child) && parse.errors.first == 0 &&
+                   parse.errors.max_message_kind == MD_MessageKind_FatalError);
+        
+        // big enough to take several token windows
+        MD_String8 big = MD_S8Lit("a: { b, c }\n");
+        for(int i = 0; i < 14; i += 1)
+        {
+            big = MD_S8Fmt(arena, "%.*s%.*s", MD_S8VArg(big), MD_S8VArg(big));
+        }
+        MD_u64 event_counts[MD_ParseEventKind_Error + 1] = {0};
+        options.event_func = CountParseEvent;
+        options.event_user_data = event_counts;
+        MD_ArenaTemp before = MD_ArenaBeginTemp(arena);
+        MD_ParseWholeStringEx(arena, MD_S8Lit("events"), big, &options);
+        MD_ArenaTemp after = MD_ArenaBeginTemp(arena);
+        TestResult(event_counts[MD_ParseEventKind_BeginNode] == 16384*3 &&
+                   event_counts[MD_ParseEventKind_EndNode] == 16384*3 &&
+                   event_counts[MD_ParseEventKind_BeginChildren] == 16384 &&
+                   event_counts[MD_ParseEventKind_EndChildren] == 16384 &&
+                   event_counts[MD_ParseEventKind_Tag] == 0 && event_counts[MD_ParseEventKind_Error] == 0);
+        TestResult(after.pos - before.pos <= 2*sizeof(MD_Node));
+    }
+    
+    Test("Parse Filter")
+    {
+        MD_String8 string = MD_S8Lit("@type A: { x y }\n@other B: { z, @type w }\n@map C: (1)\nD: e f\n"
+                                     "@other G: { @x ] }\n@type H");
+        MD_String8List tags = {0};
+        MD_S8ListPush(arena, &tags, MD_S8Lit("type"));
+        MD_S8ListPush(arena, &tags, MD_S8Lit("map"));
+        MD_ParseOptions options = {0};
+        options.filter_func = MD_ParseFilterTags;
+        options.filter_user_data = &tags;
+        MD_ParseResult parse = MD_ParseWholeStringEx(arena, MD_S8Lit("filter"), string, &options);
+        MD_ParseResult plain = MD_ParseWholeString(arena, MD_S8Lit("filter"), string);
+        TestResult(MD_ChildCountFromNode(parse.node) == 3);
+        TestResult(MD_NodeDeepMatch(MD_ChildFromString(plain.node, MD_S8Lit("A"), 0),
+                                    MD_ChildFromIndex(parse.node, 0), MD_NodeMatchFlag_Tags));
+        TestResult(MD_NodeDeepMatch(MD_ChildFromString(plain.node, MD_S8Lit("C"), 0),
+                                    MD_ChildFromIndex(parse.node, 1), MD_NodeMatchFlag_Tags));
+        TestResult(MD_S8Match(MD_ChildFromIndex(parse.node, 2)->string, MD_S8Lit("H"), 0));
+        TestResult(parse.errors.node_count == plain.errors.node_count);
+    }
+    
+    Test("Compact Tree")
+    {
+        MD_String8 string = MD_S8Lit("@a(x) foo: { // first\n bar\n baz: (1 2) }\nqux\n");
+        MD_ParseResult parse = MD_ParseWholeString(arena, MD_S8Lit("compact"), string);
+        MD_Node *list = MD_MakeList(arena);
+        MD_PushNewReference(arena, list, MD_ChildFromString(parse.node, MD_S8Lit("qux"), 0));
+        MD_PushChild(parse.node, list);
+        MD_CompactTree tree = MD_CompactTreeFromNode(arena, parse.node, 0);
+        MD_CompactNode *root = &tree.nodes[0];
+        MD_CompactNode *foo = root->first_child;
+        MD_CompactNode *bar = foo->first_child;
+        MD_CompactNode *baz = bar->next;
+        MD_CompactNode *qux = foo->next;
+        MD_CompactNode *ref = qux->next->first_child;
+        TestResult(sizeof(MD_CompactNode) <= 64 && tree.count == 11);
+        TestResult(MD_S8Match(foo->first_tag->string, MD_S8Lit("a"), 0) &&
+                   MD_S8Match(foo->first_tag->first_child->string, MD_S8Lit("x"), 0) &&
+                   foo->first_tag->parent == foo);
+        TestResult(MD_S8Match(bar->string, MD_S8Lit("bar"), 0) && bar->parent == foo &&
+                   MD_S8Match(MD_PrevCommentFromCompactNode(&tree, bar), MD_S8Lit(" first"), 0) &&
+                   MD_PrevCommentFromCompactNode(&tree, baz).size == 0);
+        TestResult(MD_S8Match(MD_RawStringFromCompactNode(&tree, baz), MD_S8Lit("baz"), 0) &&
+                   MD_OffsetFromCompactNode(&tree, baz) == 28 &&
+                   baz->flags == MD_ChildFromString(MD_ChildFromIndex(parse.node, 0), MD_S8Lit("baz"), 0)->flags);
+        TestResult(MD_RefTargetFromCompactNode(&tree, ref) == qux &&
+                   MD_CompactNodeIsNil(MD_RefTargetFromCompactNode(&tree, qux)));
+        MD_u64 count = 0;
+        for(MD_EachCompactNode(child, baz->first_child))
+        {
+            count += 1;
+        }
+        TestResult(count == 2);
+    }
+    
+    Test("Frozen Tree")
+    {
+        MD_String8 string = MD_S8Lit("@a(x) foo: { bar, @b baz: (1 2) }\nqux\n");
+        MD_ParseResult parse = MD_ParseWholeString(arena, MD_S8Lit("frozen"), string);
+        MD_Tree tree = MD_FreezeTree(arena, parse.node);
+        MD_u32 foo = MD_TreeChildFromString(&tree, 1, MD_S8Lit("foo"), 0);
+        MD_u32 baz = MD_TreeChildFromIndex(&tree, foo, 1);
+        TestResult(tree.count == 11 && tree.kinds[1] == MD_NodeKind_File && foo == 2);
+        TestResult(MD_TreeTagCountFromNode(&tree, foo) == 1 && MD_TreeNodeHasTag(&tree, foo, MD_S8Lit("a"), 0) &&
+                   MD_S8Match(MD_TreeStringFromNode(&tree, tree.first_child[tree.first_tag[foo]]), MD_S8Lit("x"), 0));
+        TestResult(MD_S8Match(MD_TreeStringFromNode(&tree, baz), MD_S8Lit("baz"), 0) && tree.parent[baz] == foo &&
+                   MD_TreeChildCountFromNode(&tree, baz) == 2 && MD_TreeTagFromIndex(&tree, baz, 0) == baz + 1);
+        TestResult(tree.flags[baz] == MD_ChildFromString(MD_ChildFromIndex(parse.node, 0), MD_S8Lit("baz"), 0)->flags);
+        MD_u32 last = 0;
+        for(MD_TreeEachChild(child, &tree, 1))
+        {
+            last = child;
+        }
+        TestResult(MD_S8Match(MD_TreeStringFromNode(&tree, last), MD_S8Lit("qux"), 0) && last == tree.count - 1);
+        TestResult(MD_TreeChildFromString(&tree, foo, MD_S8Lit("nope"), 0) == 0 && tree.first_child[0] == 0);
+    }
+    
+    Test("Child Arrays")
+    {
+        MD_String8 string = MD_S8Lit("@a @b(1) table: { x, y, z }\nrow: (1 2)\n");
+        MD_ParseResult parse = MD_ParseWholeString(arena, MD_S8Lit("arrays"), string);
+        MD_Node *table = MD_ChildFromIndex(parse.node, 0);
+        TestResult(parse.node->child_count == 2 && table->child_count == 3 && table->tag_count == 2);
+        MD_ChildIndexTable indices = MD_ZERO_STRUCT;
+        MD_BuildChildArrays(arena, &indices, parse.node, 2);
+        TestResult(MD_ChildIndexFromNode(&indices, table) != 0 &&
+                   MD_ChildIndexFromNode(&indices, MD_ChildFromString(parse.node, MD_S8Lit("row"), 0)) != 0 &&
+                   MD_ChildIndexFromNode(&indices, MD_TagFromString(table, MD_S8Lit("b"), 0)) == 0);
+        TestResult(MD_S8Match(MD_IndexedChildFromIndex(&indices, table, 2)->string, MD_S8Lit("z"), 0) &&
+                   MD_S8Match(MD_IndexedTagFromIndex(&indices, table, 1)->string, MD_S8Lit("b"), 0) &&
+                   MD_NodeIsNil(MD_IndexedChildFromIndex(&indices, table, 3)) &&
+                   MD_NodeIsNil(MD_IndexedChildFromIndex(&indices, table, -1)));
+        MD_Node *w = MD_MakeNode(arena, MD_NodeKind_Main, MD_S8Lit("w"), MD_S8Lit("w"), 0);
+        MD_PushChild(table, w);
+        TestResult(MD_ChildCountFromNode(table) == 4 && MD_IndexedChildFromIndex(&indices, table, 3) == w);
+        MD_BuildChildArray(arena, &indices, table);
+        TestResult(MD_ChildIndexFromNode(&indices, table)->child_count == 4 &&
+                   MD_IndexedChildFromIndex(&indices, table, 3) == w);
+        
+        MD_ParseOptions options = MD_ZERO_STRUCT;
+        options.flags = MD_ParseFlag_LazySets;
+        MD_ParseResult lazy = MD_ParseWholeStringEx(arena, MD_S8Lit("arrays"), string, &options);
+        MD_Node *lazy_table = MD_ChildFromIndex(lazy.node, 0);
+        MD_ChildIndexTable lazy_indices = MD_ZERO_STRUCT;
+        MD_BuildChildArray(arena, &lazy_indices, lazy_table);
+        TestResult(MD_ChildCountFromNode(lazy_table) == 3 &&
+                   MD_S8Match(MD_IndexedChildFromIndex(&lazy_indices, lazy_table, 1)->string, MD_S8Lit("y"), 0));
+    }
+    
+    Test("Child Name Index")
+    {
+        MD_String8 string = MD_S8Lit("registry: { Alpha: 1, beta: 2, alpha: 3, \"path/to\": 4 }");
+        MD_ParseResult parse = MD_ParseWholeString(arena, MD_S8Lit("names"), string);
+        MD_Node *registry = MD_ChildFromIndex(parse.node, 0);
+        MD_ChildIndexTable indices = MD_ZERO_STRUCT;
+        MD_BuildChildIndices(arena, &indices, parse.node, 4);
+        TestResult(MD_ChildIndexFromNode(&indices, registry) != 0 &&
+                   MD_ChildIndexFromNode(&indices, registry)->child_names != 0 &&
+                   MD_ChildIndexFromNode(&indices, parse.node) == 0);
+        TestResult(MD_IndexedChildFromString(&indices, registry, MD_S8Lit("alpha"), 0) == MD_ChildFromIndex(registry, 2) &&
+                   MD_IndexedChildFromString(&indices, registry, MD_S8Lit("ALPHA"), MD_StringMatchFlag_CaseInsensitive) ==
+                   MD_ChildFromIndex(registry, 0));
+        TestResult(!MD_IndexedNodeHasChild(&indices, registry, MD_S8Lit("BETA"), 0) &&
+                   MD_IndexedNodeHasChild(&indices, registry, MD_S8Lit("BETA"), MD_StringMatchFlag_CaseInsensitive) &&
+                   !MD_IndexedNodeHasChild(&indices, registry, MD_S8Lit("gamma"), MD_StringMatchFlag_CaseInsensitive));
+        TestResult(MD_IndexedChildFromString(&indices, registry, MD_S8Lit("path\\to"), MD_StringMatchFlag_SlashInsensitive) ==
+                   MD_ChildFromIndex(registry, 3));
+        MD_Node *gamma = MD_MakeNode(arena, MD_NodeKind_Main, MD_S8Lit("gamma"), MD_S8Lit("gamma"), 0);
+        MD_PushChild(registry, gamma);
+        TestResult(MD_IndexedChildFromString(&indices, registry, MD_S8Lit("gamma"), 0) == gamma);
+    }
+    
+    Test("Tag Index")
+    {
+        MD_String8 string = MD_S8Lit("@gen(c) foo: { @gen(h) @gen(x) bar, baz }\n@skip qux: (@gen(d) 1)\n");
+        MD_ParseResult parse = MD_ParseWholeString(arena, MD_S8Lit("tags"), string);
+        MD_TagIndex index = MD_TagIndexFromNode(arena, parse.node);
+        MD_TaggedNodes gen = MD_TaggedNodesFromString(&index, MD_S8Lit("gen"));
+        MD_TaggedNodes skip = MD_TaggedNodesFromString(&index, MD_S8Lit("skip"));
+        TestResult(index.count == 2 && gen.count == 3 && skip.count == 1);
+        TestResult(MD_S8Match(gen.nodes[0]->string, MD_S8Lit("foo"), 0) &&
+                   MD_S8Match(gen.nodes[1]->string, MD_S8Lit("bar"), 0) &&
+                   MD_S8Match(gen.nodes[2]->string, MD_S8Lit("1"), 0));
+        TestResult(MD_S8Match(MD_ChildFromIndex(gen.tags[1], 0)->string, MD_S8Lit("h"), 0) &&
+                   gen.tags[1]->parent == gen.nodes[1]);
+        TestResult(MD_S8Match(skip.nodes[0]->string, MD_S8Lit("qux"), 0) &&
+                   MD_TaggedNodesFromString(&index, MD_S8Lit("GEN")).count == 0);
+    }
+    
+    Test("Tree Hashes")
+    {
+        MD_String8 string = MD_S8Lit("@a(1) x: { y, z }\n@a(2) x: { y, z }\n@a(1) X: { Y, z }\n@a(1) x: { y, z }\n");
+        MD_ParseResult parse = MD_ParseWholeString(arena, MD_S8Lit("hashes"), string);
+        MD_MatchFlags flags = MD_NodeMatchFlag_Tags|MD_NodeMatchFlag_TagArguments;
+        MD_TreeHashes hashes = MD_HashTree(arena, parse.node, flags);
+        MD_Node *x0 = MD_ChildFromIndex(parse.node, 0);
+        MD_Node *x1 = MD_ChildFromIndex(parse.node, 1);
+        MD_Node *x2 = MD_ChildFromIndex(parse.node, 2);
+        MD_Node *x3 = MD_ChildFromIndex(parse.node, 3);
+        MD_u64 x0_hash = MD_HashFromNode(&hashes, x0);
+        TestResult(x0_hash != 0 && x0_hash == MD_HashFromNode(&hashes, x3) &&
+                   x0_hash != MD_HashFromNode(&hashes, x1) && hashes.flags == flags);
+        TestResult(MD_NodeDeepMatchHashed(&hashes, x0, &hashes, x3, flags) &&
+                   !MD_NodeDeepMatchHashed(&hashes, x0, &hashes, x1, flags) &&
+                   MD_NodeDeepMatchHashed(&hashes, x0, &hashes, x1, 0));
+        TestResult(MD_NodeDeepMatchHashed(&hashes, x0, &hashes, x2, flags|MD_StringMatchFlag_CaseInsensitive) &&
+                   !MD_NodeDeepMatchHashed(&hashes, x0, &hashes, x2, flags));
+        
+        // hashes are a snapshot, which only the hashed match reads
+        x1->first_tag->first_child->string = MD_S8Lit("1");
+        TestResult(MD_NodeDeepMatch(x0, x1, flags) && !MD_NodeDeepMatchHashed(&hashes, x0, &hashes, x1, flags));
+        MD_PushChild(x3->first_child, MD_MakeNode(arena, MD_NodeKind_Main, MD_S8Lit("w"), MD_S8Lit("w"), 0));
+        MD_TreeHashes rehashed = MD_HashTree(arena, parse.node, flags);
+        TestResult(MD_HashFromNode(&rehashed, x1) == x0_hash && MD_HashFromNode(&rehashed, x3) != x0_hash &&
+                   !MD_NodeDeepMatchHashed(&rehashed, x0, &rehashed, x3, flags) &&
+                   MD_NodeDeepMatchHashed(&rehashed, x0, &rehashed, x1, flags));
+    }
+    
+    Test("Tree Diff")
+    {
+        MD_String8 old_string = MD_S8Lit("a: 1\nb: { x, y }\nc: 3\nd: 4\n@old e: 5\n");
+        MD_String8 new_string = MD_S8Lit("d: 4\na: 2\nb: { x, y, z }\n@new e: 5\nf: 6\n");
+        MD_ParseResult old_parse = MD_ParseWholeString(arena, MD_S8Lit("config"), old_string);
+        MD_ParseResult new_parse = MD_ParseWholeString(arena, MD_S8Lit("config"), new_string);
+        MD_TreeEditList edits = MD_TreeDiff(arena, old_parse.node, new_parse.node, MD_NodeMatchFlag_Tags);
+        MD_TreeEdit *edit = edits.first;
+        TestResult(edits.count == 6);
+        TestResult(edit->kind == MD_TreeEditKind_Delete && MD_S8Match(edit->old_node->string, MD_S8Lit("c"), 0) &&
+                   MD_NodeIsNil(edit->new_node));
+        edit = edit->next;
+        TestResult(edit->kind == MD_TreeEditKind_Move && MD_S8Match(edit->new_node->string, MD_S8Lit("d"), 0) &&
+                   edit->old_node->parent == old_parse.node);
+        edit = edit->next;
+        TestResult(edit->kind == MD_TreeEditKind_Modify && MD_S8Match(edit->old_node->string, MD_S8Lit("1"), 0) &&
+                   MD_S8Match(edit->new_node->string, MD_S8Lit("2"), 0));
+        edit = edit->next;
+        TestResult(edit->kind == MD_TreeEditKind_Insert && MD_NodeIsNil(edit->old_node) &&
+                   MD_S8Match(edit->new_node->string, MD_S8Lit("z"), 0));
+        edit = edit->next;
+        TestResult(edit->kind == MD_TreeEditKind_Modify && MD_S8Match(edit->new_node->string, MD_S8Lit("e"), 0) &&
+                   edit->next->kind == MD_TreeEditKind_Insert &&
+                   MD_S8Match(edit->next->new_node->string, MD_S8Lit("f"), 0));
+        TestResult(MD_TreeDiff(arena, old_parse.node, new_parse.node, 0).count == 5 &&
+                   MD_TreeDiff(arena, old_parse.node, old_parse.node, 0).count == 0);
+        
+        // trees that differ only at a leaf far too deep to diff recursively
+        int depth = 300000;
+        MD_String8List deep_pieces[2] = {0};
+        for(int side = 0; side < 2; side += 1)
+        {
+            for(int i = 0; i < depth; i += 1)
+            {
+                MD_S8ListPush(arena, &deep_pieces[side], MD_S8Lit("a: {"));
+            }
+            MD_S8ListPush(arena, &deep_pieces[side], side == 0 ? MD_S8Lit("1") : MD_S8Lit("2"));
+            for(int i = 0; i < depth; i += 1)
+            {
+                MD_S8ListPush(arena, &deep_pieces[side], MD_S8Lit("}"));
+            }
+        }
+        MD_Node *deep_old = MD_ParseWholeString(arena, MD_S8Lit("deep"), MD_S8ListJoin(arena, deep_pieces[0], 0)).node;
+        MD_Node *deep_new = MD_ParseWholeString(arena, MD_S8Lit("deep"), MD_S8ListJoin(arena, deep_pieces[1], 0)).node;
+        MD_TreeEditList deep_edits = MD_TreeDiff(arena, deep_old, deep_new, 0);
+        TestResult(deep_edits.count == 1 && deep_edits.first->kind == MD_TreeEditKind_Modify &&
+                   MD_S8Match(deep_edits.first->old_node->string, MD_S8Lit("1"), 0) &&
+                   MD_S8Match(deep_edits.first->new_node->string, MD_S8Lit("2"), 0));
+    }
+    
+    Test("Shared Subtrees")
+    {
+        MD_String8 string = MD_S8Lit("a: { b, c }\nq: { b, c }\nr: { b, C }\n@t(x) s: { @t(x) u }\n");
+        MD_ParseResult parse = MD_ParseWholeString(arena, MD_S8Lit("shared"), string);
+        MD_Node *shared = MD_ShareSubtrees(arena, parse.node);
+        MD_Node *a = MD_ChildFromString(shared, MD_S8Lit("a"), 0);
+        MD_Node *q = MD_ChildFromString(shared, MD_S8Lit("q"), 0);
+        MD_Node *r = MD_ChildFromString(shared, MD_S8Lit("r"), 0);
+        MD_Node *s = MD_ChildFromString(shared, MD_S8Lit("s"), 0);
+        MD_MatchFlags flags = MD_NodeMatchFlag_Tags|MD_NodeMatchFlag_TagArguments|MD_NodeMatchFlag_NodeFlags;
+        TestResult(MD_NodeDeepMatch(parse.node, shared, flags) && shared != parse.node &&
+                   MD_ChildCountFromNode(shared) == 4);
+        TestResult(a->first_child == q->first_child && a->first_child->parent == a &&
+                   r->first_child != a->first_child && a->child_count == 2);
+        TestResult(s->first_tag->first_child == s->first_child->first_tag->first_child);
+        TestResult(MD_NodeIsNil(MD_ShareSubtrees(arena, MD_NilNode())));
+        
+        // the walk leaves a shared list for the node it entered it from
+        MD_NodeIterFlags iter_flags = MD_NodeIterFlags_Tree|MD_NodeIterFlag_PreOrder|MD_NodeIterFlag_PostOrder;
+        MD_NodeIter it = MD_NodeIterBegin(arena, parse.node, iter_flags);
+        MD_NodeIter shared_it = MD_NodeIterBegin(arena, shared, iter_flags);
+        MD_b32 walks_match = 1;
+        for(;walks_match;)
+        {
+            MD_Node *node = MD_NodeIterNext(&it);
+            MD_Node *shared_node = MD_NodeIterNext(&shared_it);
+            walks_match = (MD_NodeMatch(node, shared_node, 0) && it.depth == shared_it.depth &&
+                           it.leaving == shared_it.leaving);
+            if(MD_NodeIsNil(node))
+            {
+                break;
+            }
+        }
+        TestResult(walks_match && MD_NodeIsNil(shared_it.node));
+        
+        MD_String8List dump = {0};
+        MD_String8List shared_dump = {0};
+        MD_DebugDumpFromNode(arena, &dump, parse.node, 0, MD_S8Lit(" "), MD_GenerateFlags_Tree);
+        MD_DebugDumpFromNode(arena, &shared_dump, shared, 0, MD_S8Lit(" "), MD_GenerateFlags_Tree);
+        TestResult(MD_S8Match(MD_S8ListJoin(arena, dump, 0), MD_S8ListJoin(arena, shared_dump, 0), 0));
+        MD_TreeHashes hashes = MD_HashTree(arena, parse.node, flags);
+        MD_TreeHashes shared_hashes = MD_HashTree(arena, shared, flags);
+        MD_CompactTree compact = MD_CompactTreeFromNode(arena, parse.node, 0);
+        MD_CompactTree shared_compact = MD_CompactTreeFromNode(arena, shared, 0);
+        TestResult(MD_HashFromNode(&shared_hashes, shared) == MD_HashFromNode(&hashes, parse.node) &&
+                   shared_compact.count == compact.count &&
+                   MD_S8Match(shared_compact.nodes[compact.count - 1].parent->parent->string, MD_S8Lit("u"), 0));
+    }
+    
+    Test("Node Iterator")
+    {
+        MD_String8 string = MD_S8Lit("@t(x) a: { b, c: { d } }\ne\n");
+        MD_ParseResult parse = MD_ParseWholeString(arena, MD_S8Lit("iter"), string);
+        MD_Node *a = parse.node->first_child;
+        MD_String8List pre = {0};
+        MD_String8List post = {0};
+        MD_String8List skipped = {0};
+        int max_depth = 0;
+        for(MD_NodeIter it = MD_NodeIterBegin(arena, a, MD_NodeIterFlags_Tree); !MD_NodeIsNil(MD_NodeIterNext(&it));)
+        {
+            MD_S8ListPush(arena, &pre, it.node->string);
+            max_depth = it.depth > max_depth ? it.depth : max_depth;
+        }
+        for(MD_NodeIter it = MD_NodeIterBegin(arena, a, MD_NodeIterFlag_Children|MD_NodeIterFlag_PostOrder);
+            !MD_NodeIsNil(MD_NodeIterNext(&it));)
+        {
+            MD_S8ListPush(arena, &post, it.node->string);
+        }
+        for(MD_NodeIter it = MD_NodeIterBegin(arena, parse.node, MD_NodeIterFlag_Children|MD_NodeIterFlag_PreOrder|MD_NodeIterFlag_PostOrder);
+            !MD_NodeIsNil(MD_NodeIterNext(&it));)
+        {
+            if(!it.leaving)
+            {
+                MD_S8ListPush(arena, &skipped, it.node->string);
+                if(MD_S8Match(it.node->string, MD_S8Lit("c"), 0))
+                {
+                    MD_NodeIterSkipSubtree(&it);
+                }
+            }
+        }
+        TestResult(MD_S8Match(MD_S8ListJoin(arena, pre, 0), MD_S8Lit("atxbcd"), 0) && max_depth == 2);
+        TestResult(MD_S8Match(MD_S8ListJoin(arena, post, 0), MD_S8Lit("bdca"), 0));
+        TestResult(MD_S8Match(MD_S8ListJoin(arena, skipped, 0), MD_S8Lit("iterabce"), 0));
+    }
+    
+    Test("Parallel Visit")
+    {
+        MD_String8List strings = {0};
+        for(int i = 0; i < 200; i += 1)
+        {
+            MD_S8ListPushFmt(arena, &strings, "e%d: { x: %d, y: { a, b, c } }\n", i, i);
+        }
+        MD_String8 string = MD_S8ListJoin(arena, strings, 0);
+        MD_ParseResult parse = MD_ParseWholeString(arena, MD_S8Lit("visit"), string);
+        MD_u64 expected_count = 0;
+        MD_u64 expected_sum = 0;
+        for(MD_NodeIter it = MD_NodeIterBegin(arena, parse.node, MD_NodeIterFlag_Children); !MD_NodeIsNil(MD_NodeIterNext(&it));)
+        {
+            expected_count += 1;
+            expected_sum += it.node->offset;
+        }
+        for(MD_u64 thread_count = 1; thread_count <= 8; thread_count *= 2)
+        {
+            MD_ParseOptions options = MD_ZERO_STRUCT;
+            options.flags = MD_ParseFlag_LazySets;
+            MD_Node *lazy_root = MD_ParseWholeStringEx(arena, MD_S8Lit("visit"), string, &options).node;
+            MD_u64 rows[9*8] = {0};
+            MD_ParallelVisit(lazy_root, CountParallelVisit, rows, thread_count);
+            MD_u64 count = 0;
+            MD_u64 sum = 0;
+            for(MD_u64 thread_idx = 0; thread_idx < thread_count; thread_idx += 1)
+            {
+                count += rows[thread_idx*8 + 0];
+                sum += rows[thread_idx*8 + 1];
+            }
+            TestResult(count == expected_count && sum == expected_sum && rows[thread_count*8] == 0);
+        }
+        MD_u64 rows[8] = {0};
+        MD_ParallelVisit(MD_NilNode(), CountParallelVisit, rows, 4);
+        TestResult(rows[0] == 0);
+    }
+    
     return 0;
 }